@@ -0,0 +1,35 @@
+/* Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved. */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace rdf
+{
+namespace benchmark
+{
+    class Timer final
+    {
+    public:
+        Timer() : start_(std::chrono::steady_clock::now()) {}
+
+        double GetElapsedSeconds() const
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+                .count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    inline double ToMegabytesPerSecond(const std::int64_t bytes, const double seconds)
+    {
+        return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0;
+    }
+
+    int RunCompressionBenchmark(int argc, char* argv[]);
+    int RunDirectIOBenchmark(int argc, char* argv[]);
+    int RunCachedStreamBenchmark(int argc, char* argv[]);
+}  // namespace benchmark
+}  // namespace rdf
@@ -0,0 +1,169 @@
+/* Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved. */
+#include "benchmarks.h"
+
+#include "amdrdf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+/**
+Read-only user stream over a memory buffer, which simulates a remote stream
+by sleeping on every callback.
+*/
+struct LatencyStream
+{
+    std::vector<unsigned char> data;
+    std::chrono::microseconds latency;
+    int callCount = 0;
+};
+
+int LatencyStreamReadAt(void* ctx,
+                        const std::int64_t offset,
+                        const std::int64_t count,
+                        void* buffer,
+                        std::int64_t* bytesRead)
+{
+    auto stream = static_cast<LatencyStream*>(ctx);
+    std::this_thread::sleep_for(stream->latency);
+    ++stream->callCount;
+
+    const std::int64_t size = stream->data.size();
+    const auto n = std::max<std::int64_t>(0, std::min(count, size - offset));
+    if (n > 0) {
+        ::memcpy(buffer, stream->data.data() + offset, n);
+    }
+
+    *bytesRead = n;
+    return rdfResultOk;
+}
+
+int LatencyStreamGetSize(void* ctx, std::int64_t* size)
+{
+    auto stream = static_cast<LatencyStream*>(ctx);
+    std::this_thread::sleep_for(stream->latency);
+    ++stream->callCount;
+
+    *size = stream->data.size();
+    return rdfResultOk;
+}
+
+/**
+Open the file and read every chunk header and all chunk data, like a tool
+listing and loading a capture would.
+*/
+void ReadAllChunks(rdf::Stream& stream)
+{
+    rdf::ChunkFile cf(stream);
+
+    std::vector<unsigned char> buffer;
+    auto it = cf.GetIterator();
+    while (!it.IsAtEnd()) {
+        char id[RDF_IDENTIFIER_SIZE + 1] = {};
+        it.GetChunkIdentifier(id);
+        const auto index = it.GetChunkIndex();
+
+        buffer.resize(std::max(cf.GetChunkHeaderSize(id, index), cf.GetChunkDataSize(id, index)));
+        if (cf.GetChunkHeaderSize(id, index) > 0) {
+            cf.ReadChunkHeaderToBuffer(id, index, buffer.data());
+        }
+        if (cf.GetChunkDataSize(id, index) > 0) {
+            cf.ReadChunkDataToBuffer(id, index, buffer.data());
+        }
+
+        it.Advance();
+    }
+}
+}  // namespace
+
+namespace rdf
+{
+namespace benchmark
+{
+    int RunCachedStreamBenchmark(int argc, char* argv[])
+    {
+        const int latencyMicroseconds = argc > 0 ? std::atoi(argv[0]) : 200;
+        const int chunkCount = argc > 1 ? std::atoi(argv[1]) : 500;
+
+        LatencyStream source;
+        source.latency = std::chrono::microseconds(latencyMicroseconds);
+
+        // Many small chunks with small headers, like markers and metadata
+        // in a typical capture
+        {
+            auto memory = rdf::Stream::CreateMemoryStream();
+            {
+                rdf::ChunkFileWriter writer(memory);
+
+                std::vector<unsigned char> data(512);
+                for (int i = 0; i < chunkCount; ++i) {
+                    std::fill(data.begin(), data.end(), static_cast<unsigned char>(i));
+                    writer.WriteChunk("marker", sizeof(i), &i, data.size(), data.data());
+                }
+                writer.Close();
+            }
+
+            source.data.resize(memory.GetSize());
+            memory.Seek(0);
+            memory.Read(source.data.size(), source.data.data());
+        }
+
+        rdfUserStream2 userStream = {};
+        userStream.ReadAt = LatencyStreamReadAt;
+        userStream.GetSize = LatencyStreamGetSize;
+        userStream.context = &source;
+
+        std::printf("%d chunks, %lld bytes, %d us latency per callback\n\n",
+                    chunkCount,
+                    static_cast<long long>(source.data.size()),
+                    latencyMicroseconds);
+        std::printf("%-24s %10s %10s\n", "stream", "callbacks", "time (ms)");
+
+        {
+            auto stream = rdf::Stream::FromUserStream(&userStream);
+
+            source.callCount = 0;
+            Timer timer;
+            ReadAllChunks(stream);
+            std::printf("%-24s %10d %10.1f\n",
+                        "uncached",
+                        source.callCount,
+                        timer.GetElapsedSeconds() * 1000);
+        }
+
+        const std::int64_t blockSizes[] = {4096, 64 * 1024};
+        for (const auto blockSize : blockSizes) {
+            auto stream = rdf::Stream::FromUserStream(&userStream);
+
+            rdfCachedStreamCreateInfo info = {};
+            info.stream = static_cast<rdfStream*>(stream);
+            info.blockSize = blockSize;
+            info.cacheSize = 16 * 1024 * 1024;
+            info.readaheadBlocks = 4;
+
+            auto cached = rdf::Stream::CreateCachedStream(info);
+
+            source.callCount = 0;
+            Timer timer;
+            ReadAllChunks(cached);
+
+            // Large enough for any 64-bit block size
+            char name[48];
+            std::snprintf(name, sizeof(name), "cached, %lld KiB blocks",
+                          static_cast<long long>(blockSize / 1024));
+            std::printf("%-24s %10d %10.1f\n",
+                        name,
+                        source.callCount,
+                        timer.GetElapsedSeconds() * 1000);
+        }
+
+        return 0;
+    }
+}  // namespace benchmark
+}  // namespace rdf
@@ -0,0 +1,212 @@
+/* Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved. */
+#include "benchmarks.h"
+
+#include "amdrdf.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Dataset
+{
+    std::string name;
+    std::vector<unsigned char> data;
+};
+
+/**
+Synthetic data resembling what captures typically contain: fixed-size records
+with slowly changing counters, repetitive text, and incompressible payloads.
+*/
+std::vector<Dataset> CreateSyntheticDatasets(const std::size_t size)
+{
+    std::vector<Dataset> datasets;
+
+    {
+        Dataset records;
+        records.name = "records";
+        records.data.resize(size);
+
+        struct Record
+        {
+            std::uint64_t timestamp;
+            std::uint32_t eventId;
+            std::uint32_t queue;
+            std::uint64_t address;
+            std::uint64_t payload;
+        };
+
+        std::uint32_t state = 1;
+        for (std::size_t i = 0; i + sizeof(Record) <= size; i += sizeof(Record)) {
+            state = state * 1664525 + 1013904223;
+
+            Record record = {};
+            record.timestamp = 1000000 + i * 3 + (state >> 28);
+            record.eventId = (state >> 20) % 16;
+            record.queue = (state >> 16) % 4;
+            record.address = 0x7F0000000000ULL + ((state >> 8) % 4096) * 64;
+            record.payload = i / 4096;
+            ::memcpy(records.data.data() + i, &record, sizeof(record));
+        }
+
+        datasets.push_back(std::move(records));
+    }
+
+    {
+        Dataset text;
+        text.name = "text";
+        text.data.reserve(size);
+
+        static const char* words[] = {
+            "vkCmdDraw", "vkCmdDispatch", "pipeline", "barrier", "\"queue\": ", "{", "}", ", ",
+            "\"id\": ", "shader", "0x", "\n", "render pass", "descriptor set"};
+
+        std::uint32_t state = 7;
+        while (text.data.size() < size) {
+            state = state * 1664525 + 1013904223;
+            const char* word = words[(state >> 16) % (sizeof(words) / sizeof(words[0]))];
+            text.data.insert(text.data.end(), word, word + ::strlen(word));
+        }
+        text.data.resize(size);
+
+        datasets.push_back(std::move(text));
+    }
+
+    {
+        Dataset random;
+        random.name = "random";
+        random.data.resize(size);
+
+        std::uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (auto& c : random.data) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            c = static_cast<unsigned char>(state);
+        }
+
+        datasets.push_back(std::move(random));
+    }
+
+    return datasets;
+}
+
+std::vector<Dataset> LoadDatasets(const int argc, char* argv[])
+{
+    std::vector<Dataset> datasets;
+
+    for (int i = 0; i < argc; ++i) {
+        rdf::ChunkFile cf(argv[i]);
+
+        Dataset dataset;
+        dataset.name = argv[i];
+
+        auto it = cf.GetIterator();
+        while (!it.IsAtEnd()) {
+            char id[RDF_IDENTIFIER_SIZE + 1] = {};
+            it.GetChunkIdentifier(id);
+            const auto index = it.GetChunkIndex();
+
+            const auto offset = dataset.data.size();
+            dataset.data.resize(offset + cf.GetChunkDataSize(id, index));
+            if (dataset.data.size() > offset) {
+                cf.ReadChunkDataToBuffer(id, index, dataset.data.data() + offset);
+            }
+
+            it.Advance();
+        }
+
+        datasets.push_back(std::move(dataset));
+    }
+
+    return datasets;
+}
+
+void RunDataset(const Dataset& dataset)
+{
+    struct Codec
+    {
+        const char* name;
+        rdfCompression compression;
+    };
+
+    const Codec codecs[] = {{"none", rdfCompressionNone},
+                            {"zstd", rdfCompressionZstd},
+                            {"lz4", rdfCompressionLz4}};
+
+    const std::int64_t size = static_cast<std::int64_t>(dataset.data.size());
+
+    // Decode often enough to get stable numbers for small inputs
+    const int readIterations =
+        static_cast<int>(std::max<std::int64_t>(1, (512LL << 20) / std::max<std::int64_t>(size, 1)));
+
+    std::vector<unsigned char> output(dataset.data.size());
+
+    for (const auto& codec : codecs) {
+        auto stream = rdf::Stream::CreateMemoryStream();
+
+        rdf::benchmark::Timer writeTimer;
+        {
+            rdf::ChunkFileWriter writer(stream);
+            writer.WriteChunk(
+                "data", 0, nullptr, size, dataset.data.data(), codec.compression);
+            writer.Close();
+        }
+        const double writeSeconds = writeTimer.GetElapsedSeconds();
+
+        rdf::ChunkFile cf(stream);
+
+        rdf::benchmark::Timer readTimer;
+        for (int i = 0; i < readIterations; ++i) {
+            cf.ReadChunkDataToBuffer("data", 0, output.data());
+        }
+        const double readSeconds = readTimer.GetElapsedSeconds() / readIterations;
+
+        if (output != dataset.data) {
+            std::printf("%-12s %-5s data mismatch after decompression!\n",
+                        dataset.name.c_str(),
+                        codec.name);
+            continue;
+        }
+
+        std::printf("%-12s %-5s %12lld %12lld %7.2f %10.1f %10.1f\n",
+                    dataset.name.c_str(),
+                    codec.name,
+                    static_cast<long long>(size),
+                    static_cast<long long>(stream.GetSize()),
+                    static_cast<double>(size) / static_cast<double>(stream.GetSize()),
+                    rdf::benchmark::ToMegabytesPerSecond(size, writeSeconds),
+                    rdf::benchmark::ToMegabytesPerSecond(size, readSeconds));
+    }
+}
+}  // namespace
+
+namespace rdf
+{
+namespace benchmark
+{
+    int RunCompressionBenchmark(int argc, char* argv[])
+    {
+        const auto datasets =
+            argc > 0 ? LoadDatasets(argc, argv) : CreateSyntheticDatasets(64 * 1024 * 1024);
+
+        std::printf("%-12s %-5s %12s %12s %7s %10s %10s\n",
+                    "dataset",
+                    "codec",
+                    "size",
+                    "file size",
+                    "ratio",
+                    "write MB/s",
+                    "read MB/s");
+
+        for (const auto& dataset : datasets) {
+            RunDataset(dataset);
+        }
+
+        return 0;
+    }
+}  // namespace benchmark
+}  // namespace rdf
@@ -0,0 +1,168 @@
+/* Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved. */
+#include "benchmarks.h"
+
+#include "amdrdf.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RDF_BENCHMARK_HAS_MINCORE 1
+#endif
+
+namespace
+{
+constexpr std::int64_t ChunkSize = 16 * 1024 * 1024;
+constexpr std::int64_t AppendSize = 1024 * 1024;
+
+/**
+Fraction of the file which is resident in the page cache, or -1 if this can't
+be determined on the current platform.
+*/
+double GetCachedFraction(const char* filename)
+{
+#if RDF_BENCHMARK_HAS_MINCORE
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct stat statBuffer;
+    ::fstat(fd, &statBuffer);
+    const std::size_t size = statBuffer.st_size;
+
+    double result = -1;
+    void* mapping = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (mapping != MAP_FAILED) {
+        const std::size_t pageSize = ::sysconf(_SC_PAGESIZE);
+#if defined(__APPLE__)
+        std::vector<char> residency((size + pageSize - 1) / pageSize);
+#else
+        std::vector<unsigned char> residency((size + pageSize - 1) / pageSize);
+#endif
+
+        if (::mincore(mapping, size, residency.data()) == 0) {
+            std::size_t residentPages = 0;
+            for (const auto page : residency) {
+                residentPages += page & 1;
+            }
+
+            result = static_cast<double>(residentPages) / static_cast<double>(residency.size());
+        }
+
+        ::munmap(mapping, size);
+    }
+
+    ::close(fd);
+    return result;
+#else
+    (void)filename;
+    return -1;
+#endif
+}
+
+void PrintResult(const char* mode,
+                 const char* operation,
+                 const std::int64_t size,
+                 const double seconds,
+                 const double cachedFraction)
+{
+    if (cachedFraction >= 0) {
+        std::printf("%-9s %-6s %10.1f %9.1f%%\n",
+                    mode,
+                    operation,
+                    rdf::benchmark::ToMegabytesPerSecond(size, seconds),
+                    cachedFraction * 100);
+    } else {
+        std::printf("%-9s %-6s %10.1f %10s\n",
+                    mode,
+                    operation,
+                    rdf::benchmark::ToMegabytesPerSecond(size, seconds),
+                    "n/a");
+    }
+}
+
+void RunMode(const char* filename, const std::int64_t size, const bool directIO)
+{
+    const char* mode = directIO ? "direct" : "buffered";
+
+    std::vector<unsigned char> data(AppendSize);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i * 7);
+    }
+
+    rdfStreamFromFileCreateInfo info = {};
+    info.filename = filename;
+    info.accessMode = rdfStreamAccessReadWrite;
+    info.fileMode = rdfFileModeCreate;
+    info.directIO = directIO;
+
+    const std::int64_t chunkCount = (size + ChunkSize - 1) / ChunkSize;
+
+    rdf::benchmark::Timer writeTimer;
+    {
+        auto stream = rdf::Stream::FromFile(info);
+        rdf::ChunkFileWriter writer(stream);
+
+        for (std::int64_t i = 0; i < chunkCount; ++i) {
+            writer.BeginChunk("data", 0, nullptr);
+            for (std::int64_t offset = 0; offset < ChunkSize; offset += AppendSize) {
+                writer.AppendToChunk(AppendSize, data.data());
+            }
+            writer.EndChunk();
+        }
+
+        writer.Close();
+    }
+    const double writeSeconds = writeTimer.GetElapsedSeconds();
+    PrintResult(mode, "write", chunkCount * ChunkSize, writeSeconds, GetCachedFraction(filename));
+
+    info.accessMode = rdfStreamAccessRead;
+    info.fileMode = rdfFileModeOpen;
+
+    std::vector<unsigned char> output(ChunkSize);
+
+    rdf::benchmark::Timer readTimer;
+    {
+        auto stream = rdf::Stream::FromFile(info);
+        rdf::ChunkFile cf(stream);
+
+        for (std::int64_t i = 0; i < chunkCount; ++i) {
+            cf.ReadChunkDataToBuffer("data", static_cast<int>(i), output.data());
+        }
+    }
+    const double readSeconds = readTimer.GetElapsedSeconds();
+    PrintResult(mode, "read", chunkCount * ChunkSize, readSeconds, GetCachedFraction(filename));
+
+    std::remove(filename);
+}
+}  // namespace
+
+namespace rdf
+{
+namespace benchmark
+{
+    int RunDirectIOBenchmark(int argc, char* argv[])
+    {
+        const std::string filename = argc > 0 ? argv[0] : "rdf-direct-io-benchmark.rdf";
+        const std::int64_t size =
+            (argc > 1 ? std::atoll(argv[1]) : 1024) * static_cast<std::int64_t>(1024 * 1024);
+
+        // The buffered read runs with a warm cache, as the file has just
+        // been written. The cached column shows how much of the file is in
+        // the page cache after each step
+        std::printf("%-9s %-6s %10s %10s\n", "mode", "op", "MB/s", "cached");
+
+        RunMode(filename.c_str(), size, false);
+        RunMode(filename.c_str(), size, true);
+
+        return 0;
+    }
+}  // namespace benchmark
+}  // namespace rdf
@@ -0,0 +1,54 @@
+/* Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved. */
+#include "benchmarks.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+struct Benchmark
+{
+    const char* name;
+    const char* description;
+    int (*run)(int argc, char* argv[]);
+};
+
+const Benchmark benchmarks[] = {
+    {"compression",
+     "Compare chunk compression codecs. Optional arguments: RDF files whose chunks are used as "
+     "input.",
+     rdf::benchmark::RunCompressionBenchmark},
+    {"direct-io",
+     "Compare buffered and direct file I/O. Optional arguments: file name, size in MiB.",
+     rdf::benchmark::RunDirectIOBenchmark},
+    {"cached-stream",
+     "Read a chunk file through a high-latency user stream, with and without caching. Optional "
+     "arguments: latency in microseconds, chunk count.",
+     rdf::benchmark::RunCachedStreamBenchmark},
+};
+
+void PrintUsage(const char* program)
+{
+    std::printf("Usage: %s <benchmark> [arguments]\n\nBenchmarks:\n", program);
+    for (const auto& benchmark : benchmarks) {
+        std::printf("  %-16s %s\n", benchmark.name, benchmark.description);
+    }
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    for (const auto& benchmark : benchmarks) {
+        if (std::strcmp(argv[1], benchmark.name) == 0) {
+            return benchmark.run(argc - 2, argv + 2);
+        }
+    }
+
+    PrintUsage(argv[0]);
+    return 1;
+}
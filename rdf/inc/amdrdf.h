@@ -26,7 +26,7 @@
      (static_cast<std::uint32_t>(minor) << 12) | \
      (static_cast<std::uint32_t>(patch)))
 
-#define RDF_INTERFACE_VERSION RDF_MAKE_VERSION(1, 4, 0)
+#define RDF_INTERFACE_VERSION RDF_MAKE_VERSION(1, 5, 0)
 
 extern "C" {
 struct rdfChunkFile;
@@ -43,7 +43,11 @@ enum rdfResult
 enum rdfCompression
 {
     rdfCompressionNone = 0,
-    rdfCompressionZstd = 1
+    rdfCompressionZstd = 1,
+    /**
+     * @since 1.5
+     */
+    rdfCompressionLz4 = 2
 };
 
 enum rdfStreamAccess
@@ -66,6 +70,22 @@ struct rdfStreamFromFileCreateInfo
     rdfStreamAccess accessMode;
     rdfFileMode fileMode;
     bool is_shareable;
+
+    /**
+     * If set, the file is accessed with direct I/O, bypassing the page cache
+     * (`O_DIRECT` on Linux, `F_NOCACHE` on macOS.) Reads and writes at any
+     * offset and size are still supported through an aligned internal
+     * buffer, but are most efficient when they are large and sequential.
+     * This avoids evicting other data from the page cache when reading or
+     * writing very large files. Other platforms fall back to regular
+     * buffered I/O.
+     *
+     * Data written through the stream is only guaranteed to be in the file
+     * once the stream has been closed.
+     *
+     * @since 1.5
+     */
+    bool directIO;
 };
 
 /**
@@ -170,6 +190,143 @@ struct rdfUserStream
     void* context;
 };
 
+/**
+ * @brief User-provided positional I/O callbacks
+ *
+ * Like `rdfUserStream`, but every read and write carries its own offset, so
+ * there's no file position to maintain and no `Seek` call before every
+ * access. This halves the number of callbacks, which matters if every
+ * callback is expensive, for example because it goes over the network.
+ *
+ * - GetSize must be always non-null
+ * - ReadAt/WriteAt can be null. A stream which has both set to null is
+ *   invalid.
+ * - Close can be null
+ *
+ * The remaining rules from `rdfUserStream` apply.
+ *
+ * @since 1.5
+ */
+struct rdfUserStream2
+{
+    /**
+     * @brief Read count bytes starting at offset into buffer
+     * @return rdfResult
+     *
+     * This function can be `null` if the stream doesn't support reading.
+     *
+     * - `bytesRead` is never null, and the number of bytes actually read
+     *   must be stored there. Reading past the end is not an error, but
+     *   returns fewer bytes
+     * - `buffer` can be null only if `count` is 0
+     */
+    int (*ReadAt)(void* ctx,
+                  const std::int64_t offset,
+                  const std::int64_t count,
+                  void* buffer,
+                  std::int64_t* bytesRead);
+
+    /**
+     * @brief Write count bytes from buffer starting at offset
+     * @return rdfResult
+     *
+     * This function can be `null` if the stream doesn't support writing.
+     *
+     * - `bytesWritten` is never null, and the number of bytes actually
+     *   written must be stored there
+     * - `buffer` can be null only if `count` is 0
+     */
+    int (*WriteAt)(void* ctx,
+                   const std::int64_t offset,
+                   const std::int64_t count,
+                   const void* buffer,
+                   std::int64_t* bytesWritten);
+
+    /**
+     * @brief Get the size
+     * @return rdfResult
+     *
+     * This function must be always provided.
+     */
+    int (*GetSize)(void* ctx, std::int64_t* size);
+
+    /**
+     * @brief Close the stream.
+     * @return rdfResult
+     *
+     * This function can be `null` if the stream handles closing elsewhere.
+     */
+    int (*Close)(void* ctx);
+
+    void* context;
+};
+
+/**
+ * @since 1.5
+ */
+struct rdfMemoryStreamCreateInfo
+{
+    /**
+     * Number of bytes to allocate up front. Streams which don't grow beyond
+     * this are stored in a single allocation. Zero uses the default.
+     */
+    std::int64_t capacityHint;
+};
+
+/**
+ * @since 1.5
+ */
+struct rdfCachedStreamCreateInfo
+{
+    /**
+     * The stream to cache. It must stay open while the cached stream is in
+     * use, and must not be modified through other handles.
+     */
+    rdfStream* stream;
+
+    /**
+     * Size of the cached blocks. Reads from `stream` are aligned to, and
+     * multiples of this size. Must be positive.
+     */
+    std::int64_t blockSize;
+
+    /**
+     * Maximum number of bytes to cache. At least one block is always cached.
+     */
+    std::int64_t cacheSize;
+
+    /**
+     * Number of additional blocks to read when a cache miss directly follows
+     * the previous one. Zero disables readahead.
+     */
+    std::int64_t readaheadBlocks;
+};
+
+/**
+ * @since 1.5
+ */
+struct rdfSharedMemoryStreamCreateInfo
+{
+    /**
+     * Name of the shared memory, for debugging purposes only. Can be `null`.
+     */
+    const char* name;
+
+    /**
+     * Number of bytes to reserve up front. Zero reserves nothing.
+     */
+    std::int64_t capacityHint;
+};
+
+/**
+ * @since 1.5
+ */
+struct rdfMemorySegment
+{
+    const void* data;
+    std::int64_t size;
+};
+
 int RDF_EXPORT rdfStreamFromFile(const rdfStreamFromFileCreateInfo* info, rdfStream** stream);
 
 int RDF_EXPORT rdfStreamOpenFile(const char* filename, rdfStream** stream);
@@ -179,6 +336,79 @@ int RDF_EXPORT rdfStreamFromReadOnlyMemory(const std::int64_t size,
                                            rdfStream** stream);
 int RDF_EXPORT rdfStreamCreateMemoryStream(rdfStream** stream);
 
+/**
+ * @brief Create a memory stream with a capacity hint
+ *
+ * Memory streams grow in pages, so growing a large stream never copies the
+ * data written so far. A capacity hint matching the expected size avoids
+ * allocating pages on the fly altogether.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamCreateMemoryStream2(const rdfMemoryStreamCreateInfo* info,
+                                            rdfStream** stream);
+
+/**
+ * @brief Create a stream backed by anonymous shared memory
+ *
+ * Uses `memfd_create` on Linux, and an unlinked temporary file on other Unix
+ * platforms. Not supported on Windows.
+ *
+ * Write a chunk file into the stream, then pass its file descriptor (see
+ * `rdfStreamGetFileDescriptor`) to another process, for instance over a Unix
+ * domain socket. That process can open it using `rdfStreamMapFileDescriptor`
+ * without copying the data. The descriptor is created with `FD_CLOEXEC`, `dup`
+ * it to pass it to a child process through `exec`.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamCreateSharedMemoryStream(const rdfSharedMemoryStreamCreateInfo* info,
+                                                 rdfStream** stream);
+
+/**
+ * @brief Map a file descriptor into memory as a read-only stream
+ *
+ * The stream covers the size of the file at the time of the call, and supports
+ * `rdfStreamGetMemoryView`. It does not take ownership of `fd`, which can be
+ * closed once this returns. The file must not shrink while the stream is open.
+ * Not supported on Windows.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamMapFileDescriptor(const int fd, rdfStream** stream);
+
+/**
+ * @brief Wrap a stream with an LRU block cache
+ *
+ * Useful for streams where every access has a high latency, like user
+ * streams reading from the network. Reading a chunk file issues many small
+ * reads, which the cache turns into a few large, aligned ones. Writes are
+ * passed through to the inner stream.
+ *
+ * Closing the cached stream does not close the inner stream.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamCreateCachedStream(const rdfCachedStreamCreateInfo* info,
+                                           rdfStream** stream);
+
+/**
+ * @brief Create a view of a range of another stream
+ *
+ * The sub-stream covers `size` bytes of `parent`, starting at `offset`, which
+ * must lie within `parent`. Writes can't grow it. If `parent` supports
+ * `rdfStreamGetMemoryView`, so does the sub-stream.
+ *
+ * `parent` must stay open until the sub-stream has been closed. Closing the
+ * sub-stream does not close `parent`.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamCreateSubStream(rdfStream* parent,
+                                        const std::int64_t offset,
+                                        const std::int64_t size,
+                                        rdfStream** stream);
+
 /**
  * @deprecated Use `rdfStreamFromUserStream` instead
  * 
@@ -190,6 +420,11 @@ int RDF_EXPORT rdfStreamCreateFromUserStream(const rdfUserStream* userStream, rd
  * @since 1.1
  */
 int RDF_EXPORT rdfStreamFromUserStream(const rdfUserStream* userStream, rdfStream** stream);
+
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamFromUserStream2(const rdfUserStream2* userStream, rdfStream** stream);
 int RDF_EXPORT rdfStreamClose(rdfStream** stream);
 
 int RDF_EXPORT rdfStreamRead(rdfStream*,
@@ -204,15 +439,132 @@ int RDF_EXPORT rdfStreamTell(rdfStream* stream, std::int64_t* position);
 int RDF_EXPORT rdfStreamSeek(rdfStream* stream, const std::int64_t offset);
 int RDF_EXPORT rdfStreamGetSize(rdfStream* stream, std::int64_t* size);
 
+/**
+ * @brief Get pointers to the contents of a memory stream
+ *
+ * Works for streams created using `rdfStreamCreateMemoryStream`,
+ * `rdfStreamCreateMemoryStream2` and `rdfStreamFromReadOnlyMemory`. The
+ * contents are returned as segments in stream order. The pointers stay valid
+ * until the stream is modified or closed.
+ *
+ * Call with `segments` set to `null` to query the number of segments. Otherwise,
+ * `segmentCount` must contain the number of elements in `segments`.
+ *
+ * Streams which don't grow past their capacity hint consist of one segment.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamGetMemoryView(rdfStream* stream,
+                                      std::int64_t* segmentCount,
+                                      rdfMemorySegment* segments);
+
+/**
+ * @brief Take ownership of the contents of a memory stream
+ *
+ * Returns the contents of a stream created using `rdfStreamCreateMemoryStream`
+ * or `rdfStreamCreateMemoryStream2` as one contiguous buffer, and leaves the
+ * stream empty. If the contents consist of a single segment, the buffer is
+ * handed over without copying. Empty streams return a `null` buffer.
+ *
+ * The buffer must be freed using `rdfStreamFreeMemoryBuffer`.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamDetachMemoryBuffer(rdfStream* stream,
+                                           void** buffer,
+                                           std::int64_t* size);
+
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamFreeMemoryBuffer(void* buffer);
+
+/**
+ * @brief Get the file descriptor of a shared memory stream
+ *
+ * The descriptor remains owned by the stream, and is closed with it.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfStreamGetFileDescriptor(rdfStream* stream, int* fd);
+
 int RDF_EXPORT rdfChunkFileOpenFile(const char* filename, rdfChunkFile** handle);
 int RDF_EXPORT rdfChunkFileOpenStream(rdfStream* stream, rdfChunkFile** handle);
 int RDF_EXPORT rdfChunkFileClose(rdfChunkFile** handle);
 
+/**
+ * @brief Pick up chunks written since the file was opened
+ *
+ * For files which are being written with `indexPublishInterval` set, possibly
+ * by another process. Reads the header, and if the writer published a new
+ * index since the last call, reads it. An index which is being published
+ * while this runs is skipped, and picked up by the next call, so readers never
+ * see a partial update. `updated` is set to 1 if the index changed, and can be
+ * `null`.
+ *
+ * Iterators created before the index changed must not be used afterwards.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileRefresh(rdfChunkFile* handle, int* updated);
+
+/**
+ * @brief Open several chunk files as one
+ *
+ * The result behaves like a single chunk file containing the chunks of all
+ * `streams`. Chunks with the same identifier are numbered consecutively across
+ * the streams, in the order given. The streams must stay open until `handle`
+ * has been closed.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileOpenMulti(rdfStream** streams,
+                                     const int streamCount,
+                                     rdfChunkFile** handle);
+
+/**
+ * @brief Open a chunk which contains a complete chunk file
+ *
+ * The chunk data is read in place, without copying it out first. Only
+ * uncompressed chunks are supported. `outer` must stay open until `handle`
+ * has been closed.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileOpenChunkAsFile(rdfChunkFile* outer,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           rdfChunkFile** handle);
+
+/**
+ * @brief Remove unused space from a chunk file
+ *
+ * Copies the chunks of `input` to `output`, without the space left behind by
+ * removed chunks, indices replaced by appends, and alignment padding. Chunk
+ * headers and data are copied as stored, so compressed chunks aren't
+ * recompressed, and chunk indices don't change.
+ *
+ * `output` can be the same stream as `input` to compact the file in place. The
+ * file is unusable if this gets interrupted, and must not be open anywhere
+ * else in the meantime.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileCompact(rdfStream* input, rdfStream* output);
+
 int RDF_EXPORT rdfChunkFileGetChunkVersion(rdfChunkFile* handle,
                                            const char* chunkId,
                                            const int chunkIndex,
                                            std::uint32_t* chunkVersion);
 
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileGetChunkCompression(rdfChunkFile* handle,
+                                               const char* chunkId,
+                                               const int chunkIndex,
+                                               rdfCompression* compression);
+
 int RDF_EXPORT rdfChunkFileReadChunkHeader(rdfChunkFile* handle,
                                            const char* chunkId,
                                            const int chunkIndex,
@@ -222,6 +574,36 @@ int RDF_EXPORT rdfChunkFileReadChunkData(rdfChunkFile* handle,
                                          const int chunkIndex,
                                          void* buffer);
 
+/**
+ * @brief Read the headers of all chunks into memory
+ *
+ * Headers are read in file order, and headers stored close to each other are
+ * fetched with a single read, which is much faster than reading them one by
+ * one for files with many chunks. Afterwards, `rdfChunkFileReadChunkHeader`
+ * doesn't access the file anymore, and `rdfChunkFileGetChunkHeader` can be
+ * used to access the headers without copying them.
+ *
+ * The loaded headers are discarded when `rdfChunkFileRefresh` reads a new
+ * index.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileLoadAllHeaders(rdfChunkFile* handle);
+
+/**
+ * @brief Get a pointer to a chunk header in memory
+ *
+ * Requires the headers to be loaded with `rdfChunkFileLoadAllHeaders`. The
+ * pointer is valid until the chunk file is closed or the headers get
+ * discarded. `header` is set to null for chunks with an empty header.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileGetChunkHeader(rdfChunkFile* handle,
+                                          const char* chunkId,
+                                          const int chunkIndex,
+                                          const void** header);
+
 int RDF_EXPORT rdfChunkFileGetChunkHeaderSize(rdfChunkFile* handle,
                                               const char* chunkId,
                                               const int chunkIndex,
@@ -239,6 +621,63 @@ int RDF_EXPORT rdfChunkFileContainsChunk(rdfChunkFile* handle,
                                          const int chunkIndex,
                                          int* result);
 
+/**
+ * @brief Get the key a chunk was written with
+ *
+ * Chunks written without a key, including all chunks in files written by
+ * earlier versions, have the key 0.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileGetChunkKey(rdfChunkFile* handle,
+                                       const char* chunkId,
+                                       const int chunkIndex,
+                                       std::uint64_t* key);
+
+/**
+ * @brief Find all chunks with a key in the range [first, last]
+ *
+ * The chunk indices are returned in order of their keys, and chunks with the
+ * same key in order of their index.
+ *
+ * If `chunkIndices` is null, `count` is set to the number of matching chunks.
+ * Otherwise, `count` must be at least that number, and is set to the number
+ * of indices written to `chunkIndices`.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileFindChunksByKeyRange(rdfChunkFile* handle,
+                                                const char* chunkId,
+                                                const std::uint64_t first,
+                                                const std::uint64_t last,
+                                                std::int64_t* count,
+                                                int* chunkIndices);
+
+/**
+ * @brief Check chunk data against its checksum when reading it
+ *
+ * Chunks written by this version of the library store a checksum of their
+ * uncompressed data. If `verify` is non-zero, `rdfChunkFileReadChunkData`
+ * checks the data it read against the checksum, and fails with
+ * `rdfResultError` if they don't match. Chunks without a checksum, such as
+ * chunks from files written by earlier versions, are not checked. Disabled
+ * by default.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileSetVerifyChecksums(rdfChunkFile* handle, const int verify);
+
+/**
+ * @brief Check the data of all chunks against their checksums
+ *
+ * Reads the data of every chunk which has a checksum, in file order, and sets
+ * `mismatchCount` to the number of chunks whose data doesn't match, or which
+ * can't be read or decompressed.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileVerifyChecksums(rdfChunkFile* handle, std::int64_t* mismatchCount);
+
 struct rdfChunkFileIterator;
 int RDF_EXPORT rdfChunkFileCreateChunkIterator(rdfChunkFile* handle,
                                                rdfChunkFileIterator** iterator);
@@ -256,12 +695,170 @@ struct rdfChunkCreateInfo
     const void* pHeader;
     rdfCompression compression;
     std::uint32_t version;
+
+    /**
+     * A user-defined key, for example a timestamp or a frame number. Chunks
+     * can be looked up by key range using `rdfChunkFileFindChunksByKeyRange`.
+     * Keys don't have to be unique.
+     *
+     * @since 1.5
+     */
+    std::uint64_t key;
 };
 
 struct rdfChunkFileWriterCreateInfo
 {
     rdfStream* stream;
     bool appendToFile;
+
+    /**
+     * If non-zero, a compressed chunk is stored uncompressed when its
+     * compressed size exceeds this fraction of its uncompressed size. For
+     * example, 0.95 requires compression to save at least 5%.
+     *
+     * @since 1.5
+     */
+    float compressionThreshold;
+
+    /**
+     * If non-zero (and `compressionThreshold` is set), chunks larger than this
+     * get a trial compression of their first `compressionSampleSize` bytes.
+     * If the sample fails the threshold, the chunk is stored uncompressed
+     * without compressing the rest.
+     *
+     * @since 1.5
+     */
+    std::int64_t compressionSampleSize;
+
+    /**
+     * If non-zero, the writer collects small writes (chunk headers and
+     * appends to uncompressed chunks) in a buffer of this size and passes
+     * them to the stream in one call. The buffer is flushed when a chunk
+     * ends, when it's full, and when the file is finalized.
+     *
+     * @since 1.5
+     */
+    std::int64_t writeBufferSize;
+
+    /**
+     * If non-zero, chunks are compressed and written to the stream by a
+     * background thread, and writer calls only copy the data. Once more than
+     * this many bytes are waiting to be written, writer calls block until the
+     * background thread has caught up. Errors from the background thread are
+     * reported by the next writer call, `rdfChunkFileWriterFlush` or
+     * `rdfChunkFileWriterDestroy`.
+     *
+     * The data of a compressed chunk is buffered in full until the chunk ends,
+     * so a single compressed chunk can exceed this limit. Writes which exceed
+     * it on their own are done on the calling thread instead, once the
+     * background thread is idle.
+     *
+     * @since 1.5
+     */
+    std::int64_t asyncMemoryLimit;
+
+    /**
+     * If set, chunk data which is identical to the data of a chunk written
+     * earlier by the same writer is not stored again. The index entry of the
+     * new chunk points at the existing data instead, which existing readers
+     * handle transparently. Requires the chunk data to be kept in memory
+     * until the chunk ends, for uncompressed chunks as well. Has no effect if
+     * the stream is not readable, as matches are verified against the data
+     * written before.
+     *
+     * @since 1.5
+     */
+    bool deduplicateChunks;
+
+    /**
+     * If greater than one, the data of every chunk starts at a file offset
+     * which is a multiple of this value, for example 64 for aligned vector
+     * loads from a mapped file or 4096 for page-granular and direct I/O. The
+     * gap to the previous chunk is filled with zeros. Empty chunks are not
+     * aligned.
+     *
+     * @since 1.5
+     */
+    std::int64_t chunkDataAlignment;
+
+    /**
+     * Like `chunkDataAlignment`, but for chunk headers.
+     *
+     * @since 1.5
+     */
+    std::int64_t chunkHeaderAlignment;
+
+    /**
+     * If non-zero, storage for this many bytes is reserved up front, without
+     * changing the size of the file (`fallocate` on Linux, `F_PREALLOCATE` on
+     * macOS, the allocation size on Windows.) This keeps long captures from
+     * fragmenting the file, and makes them fail right away instead of midway
+     * if the disk is too small. Unused space is released when the writer is
+     * destroyed. Streams which can't reserve storage ignore this.
+     *
+     * @since 1.5
+     */
+    std::int64_t expectedFileSize;
+
+    /**
+     * If non-zero, the index is published after every this many chunks, so
+     * readers can see the chunks of a file while it's being written, using
+     * `rdfChunkFileRefresh`, and a file whose writer crashed can still be
+     * opened, losing at most the chunks written since the last publish.
+     *
+     * Each publish only writes the index entries of the chunks added since
+     * the previous one, linked to it. Files in this state use a new format
+     * version, which older versions of this library refuse to open. Once the
+     * writer is destroyed, the complete index is written, and the file can be
+     * read by any version again.
+     *
+     * Appending with a publish interval requires a file which was written
+     * with one.
+     *
+     * @since 1.5
+     */
+    std::int64_t indexPublishInterval;
+
+    /**
+     * If non-zero, the index is also published once this many bytes have been
+     * written since the last publish, see `indexPublishInterval`. Use this for
+     * captures with few, large chunks.
+     *
+     * @since 1.5
+     */
+    std::int64_t indexPublishByteInterval;
+
+    /**
+     * If set, appending to a file only writes the index entries of the new
+     * chunks, linked to the existing index, instead of rewriting the complete
+     * index. This keeps the cost of small appends independent of the size of
+     * the file. Opening such files reads one index segment per append.
+     *
+     * This breaks compatibility with older readers: the file keeps format
+     * version 4 after the writer is destroyed, which versions of this library
+     * before 1.5 refuse to open. Appending once more without this flag
+     * rewrites the complete index and turns the file back into version 3.
+     *
+     * Files written before 1.5, or without this flag or `indexPublishInterval`,
+     * have their index rewritten once, in a form later appends can link to.
+     *
+     * @since 1.5
+     */
+    bool incrementalAppend;
+
+    /**
+     * If set, the writer computes a 64-bit checksum (XXH3) of the uncompressed
+     * data of every chunk while it's being written, and stores it in the index.
+     * Readers can check chunk data against it using
+     * `rdfChunkFileSetVerifyChecksums` and `rdfChunkFileVerifyChecksums`. Older
+     * versions of this library ignore the checksums.
+     *
+     * Appending to a file which has checksums keeps computing them, even if this
+     * isn't set.
+     *
+     * @since 1.5
+     */
+    bool chunkChecksums;
 };
 
 int RDF_EXPORT rdfChunkFileWriterCreate(rdfStream* stream, rdfChunkFileWriter** writer);
@@ -282,6 +879,79 @@ int RDF_EXPORT rdfChunkFileWriterWriteChunk(rdfChunkFileWriter* writer,
                                             const void* data,
                                             int* index);
 
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileWriterFlush(rdfChunkFileWriter* writer);
+
+/**
+ * @brief Remove a chunk from the file
+ *
+ * Drops the chunk from the index, which is rewritten when the writer is
+ * destroyed. The chunk header and data remain in the file as unused space
+ * until the file is compacted with `rdfChunkFileCompact`. Chunks with the same
+ * identifier and a higher index move down by one.
+ *
+ * Usually used when appending to an existing file. No chunk may be open at
+ * the same time, and this can't be combined with `indexPublishInterval` or
+ * `incrementalAppend`.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileWriterRemoveChunk(rdfChunkFileWriter* writer,
+                                             const char* chunkId,
+                                             const int chunkIndex);
+
+/**
+ * @brief Copy a chunk from another file without recompressing it
+ *
+ * Blocks while another thread has a chunk open through
+ * `rdfChunkFileWriterBeginChunk`, and fails if the calling thread has one open.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileWriterCopyChunk(rdfChunkFileWriter* writer,
+                                           rdfChunkFile* source,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           int* index);
+
+/**
+ * A chunk which can be written concurrently with other chunks
+ *
+ * @since 1.5
+ */
+struct rdfChunkWriter;
+
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkFileWriterOpenChunk(rdfChunkFileWriter* writer,
+                                           const rdfChunkCreateInfo* info,
+                                           rdfChunkWriter** chunk);
+
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkWriterAppend(rdfChunkWriter* chunk,
+                                    const std::int64_t size,
+                                    const void* data);
+
+/**
+ * @brief Close a chunk writer and add the chunk to the file
+ *
+ * Blocks while another thread has a chunk open through
+ * `rdfChunkFileWriterBeginChunk`, and fails if the calling thread has one open.
+ *
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkWriterClose(rdfChunkWriter** chunk, int* index);
+
+/**
+ * @since 1.5
+ */
+int RDF_EXPORT rdfChunkWriterDiscard(rdfChunkWriter** chunk);
+
 int RDF_EXPORT rdfResultToString(rdfResult result, const char** output);
 }
 
@@ -319,6 +989,22 @@ private:
     } while (0)
 #endif
 
+/**
+ * @since 1.5
+ */
+struct MemoryBufferDeleter
+{
+    void operator()(void* buffer) const noexcept
+    {
+        rdfStreamFreeMemoryBuffer(buffer);
+    }
+};
+
+/**
+ * @since 1.5
+ */
+using MemoryBuffer = std::unique_ptr<void, MemoryBufferDeleter>;
+
 class Stream final
 {
 public:
@@ -345,6 +1031,16 @@ public:
         return result;
     }
 
+    /**
+     * @since 1.5
+     */
+    static Stream FromFile(const rdfStreamFromFileCreateInfo& info)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamFromFile(&info, &result.stream_));
+        return result;
+    }
+
     static Stream CreateFile(const char* filename)
     {
         Stream result;
@@ -366,6 +1062,56 @@ public:
         return result;
     }
 
+    /**
+     * @since 1.5
+     */
+    static Stream CreateMemoryStream(const rdfMemoryStreamCreateInfo& info)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamCreateMemoryStream2(&info, &result.stream_));
+        return result;
+    }
+
+    /**
+     * @since 1.5
+     */
+    static Stream CreateSharedMemoryStream(const rdfSharedMemoryStreamCreateInfo& info)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamCreateSharedMemoryStream(&info, &result.stream_));
+        return result;
+    }
+
+    /**
+     * @since 1.5
+     */
+    static Stream MapFileDescriptor(const int fd)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamMapFileDescriptor(fd, &result.stream_));
+        return result;
+    }
+
+    /**
+     * @since 1.5
+     */
+    static Stream CreateSubStream(Stream& parent, const std::int64_t offset, const std::int64_t size)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamCreateSubStream(parent.stream_, offset, size, &result.stream_));
+        return result;
+    }
+
+    /**
+     * @since 1.5
+     */
+    static Stream CreateCachedStream(const rdfCachedStreamCreateInfo& info)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamCreateCachedStream(&info, &result.stream_));
+        return result;
+    }
+
     static Stream FromUserStream(const rdfUserStream* userStream)
     {
         Stream result;
@@ -373,6 +1119,16 @@ public:
         return result;
     }
 
+    /**
+     * @since 1.5
+     */
+    static Stream FromUserStream(const rdfUserStream2* userStream)
+    {
+        Stream result;
+        RDF_CHECK_CALL(rdfStreamFromUserStream2(userStream, &result.stream_));
+        return result;
+    }
+
     ~Stream()
     {
         if (stream_) {
@@ -437,6 +1193,42 @@ public:
         return size;
     }
 
+    /**
+     * @since 1.5
+     */
+    std::vector<rdfMemorySegment> GetMemoryView() const
+    {
+        std::int64_t count = 0;
+        RDF_CHECK_CALL(rdfStreamGetMemoryView(stream_, &count, nullptr));
+
+        std::vector<rdfMemorySegment> segments(static_cast<std::size_t>(count));
+        RDF_CHECK_CALL(rdfStreamGetMemoryView(stream_, &count, segments.data()));
+
+        return segments;
+    }
+
+    /**
+     * @since 1.5
+     */
+    MemoryBuffer DetachMemoryBuffer(std::int64_t& size)
+    {
+        void* buffer = nullptr;
+        RDF_CHECK_CALL(rdfStreamDetachMemoryBuffer(stream_, &buffer, &size));
+
+        return MemoryBuffer(buffer);
+    }
+
+    /**
+     * @since 1.5
+     */
+    int GetFileDescriptor() const
+    {
+        int fd = -1;
+        RDF_CHECK_CALL(rdfStreamGetFileDescriptor(stream_, &fd));
+
+        return fd;
+    }
+
     explicit operator rdfStream*() const
     {
         return stream_;
@@ -544,6 +1336,20 @@ public:
         RDF_CHECK_CALL(rdfChunkFileOpenStream(static_cast<rdfStream*>(stream), &chunkFile_));
     }
 
+    /**
+     * @since 1.5
+     */
+    ChunkFile(const std::vector<Stream*>& streams)
+    {
+        std::vector<rdfStream*> handles;
+        for (auto stream : streams) {
+            handles.push_back(static_cast<rdfStream*>(*stream));
+        }
+
+        RDF_CHECK_CALL(rdfChunkFileOpenMulti(
+            handles.data(), static_cast<int>(handles.size()), &chunkFile_));
+    }
+
     ~ChunkFile()
     {
         if (chunkFile_) {
@@ -632,6 +1438,24 @@ public:
         ReadChunkDataToBuffer(chunkId, 0, buffer);
     }
 
+    /**
+     * @since 1.5
+     */
+    void LoadAllHeaders()
+    {
+        RDF_CHECK_CALL(rdfChunkFileLoadAllHeaders(chunkFile_));
+    }
+
+    /**
+     * @since 1.5
+     */
+    const void* GetChunkHeader(const char* chunkId, const int chunkIndex) const
+    {
+        const void* header = nullptr;
+        RDF_CHECK_CALL(rdfChunkFileGetChunkHeader(chunkFile_, chunkId, chunkIndex, &header));
+        return header;
+    }
+
     std::int64_t GetChunkHeaderSize(const char* chunkId) const
     {
         return GetChunkHeaderSize(chunkId, 0);
@@ -668,6 +1492,17 @@ public:
         return version;
     }
 
+    /**
+     * @since 1.5
+     */
+    rdfCompression GetChunkCompression(const char* chunkId, const int chunkIndex) const
+    {
+        rdfCompression compression = rdfCompressionNone;
+        RDF_CHECK_CALL(
+            rdfChunkFileGetChunkCompression(chunkFile_, chunkId, chunkIndex, &compression));
+        return compression;
+    }
+
     std::int64_t GetChunkCount(const char* chunkId) const
     {
         std::int64_t size = 0;
@@ -688,12 +1523,92 @@ public:
         return result == 1;
     }
 
+    /**
+     * @since 1.5
+     */
+    std::uint64_t GetChunkKey(const char* chunkId, const int chunkIndex) const
+    {
+        std::uint64_t key = 0;
+        RDF_CHECK_CALL(rdfChunkFileGetChunkKey(chunkFile_, chunkId, chunkIndex, &key));
+        return key;
+    }
+
+    /**
+     * @since 1.5
+     */
+    std::vector<int> FindChunksByKeyRange(const char* chunkId,
+                                          const std::uint64_t first,
+                                          const std::uint64_t last) const
+    {
+        std::int64_t count = 0;
+        RDF_CHECK_CALL(
+            rdfChunkFileFindChunksByKeyRange(chunkFile_, chunkId, first, last, &count, nullptr));
+
+        std::vector<int> result(static_cast<std::size_t>(count));
+        if (count > 0) {
+            RDF_CHECK_CALL(rdfChunkFileFindChunksByKeyRange(
+                chunkFile_, chunkId, first, last, &count, result.data()));
+        }
+
+        return result;
+    }
+
+    /**
+     * @since 1.5
+     */
+    void SetVerifyChecksums(const bool verify)
+    {
+        RDF_CHECK_CALL(rdfChunkFileSetVerifyChecksums(chunkFile_, verify ? 1 : 0));
+    }
+
+    /**
+     * @since 1.5
+     */
+    std::int64_t VerifyChecksums()
+    {
+        std::int64_t mismatchCount = 0;
+        RDF_CHECK_CALL(rdfChunkFileVerifyChecksums(chunkFile_, &mismatchCount));
+        return mismatchCount;
+    }
+
+    /**
+     * @since 1.5
+     */
+    bool Refresh()
+    {
+        int updated = 0;
+        RDF_CHECK_CALL(rdfChunkFileRefresh(chunkFile_, &updated));
+        return updated == 1;
+    }
+
+    /**
+     * @since 1.5
+     */
+    static void Compact(Stream& input, Stream& output)
+    {
+        RDF_CHECK_CALL(
+            rdfChunkFileCompact(static_cast<rdfStream*>(input), static_cast<rdfStream*>(output)));
+    }
+
+    /**
+     * @since 1.5
+     */
+    ChunkFile OpenChunkAsFile(const char* chunkId, const int chunkIndex) const
+    {
+        ChunkFile result;
+        RDF_CHECK_CALL(
+            rdfChunkFileOpenChunkAsFile(chunkFile_, chunkId, chunkIndex, &result.chunkFile_));
+        return result;
+    }
+
     explicit operator rdfChunkFile*() const
     {
         return chunkFile_;
     }
 
 private:
+    ChunkFile() = default;
+
     rdfChunkFile* chunkFile_ = nullptr;
 };
 
@@ -703,6 +1618,67 @@ enum ChunkFileWriteMode
     Append
 };
 
+class ChunkWriter final
+{
+public:
+    ~ChunkWriter()
+    {
+        if (chunk_) {
+            // No CHECK_CALL -- cannot throw exception from destructor
+            rdfChunkWriterDiscard(&chunk_);
+        }
+    }
+
+    ChunkWriter(const ChunkWriter&) = delete;
+    ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+    ChunkWriter(ChunkWriter&& rhs) noexcept
+    {
+        chunk_ = rhs.chunk_;
+        rhs.chunk_ = nullptr;
+    }
+
+    ChunkWriter& operator=(ChunkWriter&& rhs) noexcept
+    {
+        if (chunk_) {
+            rdfChunkWriterDiscard(&chunk_);
+        }
+
+        chunk_ = rhs.chunk_;
+        rhs.chunk_ = nullptr;
+        return *this;
+    }
+
+    template <typename T>
+    void Append(const T& item)
+    {
+        Append(sizeof(item), static_cast<const void*>(&item));
+    }
+
+    void Append(const std::int64_t chunkDataSize, const void* chunkData)
+    {
+        RDF_CHECK_CALL(rdfChunkWriterAppend(chunk_, chunkDataSize, chunkData));
+    }
+
+    /**
+     * Add the chunk to the file and return its index
+     */
+    int Close()
+    {
+        int index = 0;
+        RDF_CHECK_CALL(rdfChunkWriterClose(&chunk_, &index));
+
+        return index;
+    }
+
+private:
+    friend class ChunkFileWriter;
+
+    ChunkWriter() = default;
+
+    rdfChunkWriter* chunk_ = nullptr;
+};
+
 class ChunkFileWriter final
 {
 public:
@@ -721,6 +1697,14 @@ public:
         RDF_CHECK_CALL(rdfChunkFileWriterCreate2(&info, &writer_));
     }
 
+    /**
+     * @since 1.5
+     */
+    ChunkFileWriter(const rdfChunkFileWriterCreateInfo& info)
+    {
+        RDF_CHECK_CALL(rdfChunkFileWriterCreate2(&info, &writer_));
+    }
+
     ~ChunkFileWriter()
     {
         if (writer_) {
@@ -767,6 +1751,22 @@ public:
                    const void* chunkData,
                    const rdfCompression compression,
                    const std::uint32_t version)
+    {
+        return WriteChunk(
+            chunkId, chunkHeaderSize, chunkHeader, chunkDataSize, chunkData, compression, version, 0);
+    }
+
+    /**
+     * @since 1.5
+     */
+    int WriteChunk(const char* chunkId,
+                   const std::int64_t chunkHeaderSize,
+                   const void* chunkHeader,
+                   const std::int64_t chunkDataSize,
+                   const void* chunkData,
+                   const rdfCompression compression,
+                   const std::uint32_t version,
+                   const std::uint64_t key)
     {
         rdfChunkCreateInfo info = {};
         ::memcpy(info.identifier, chunkId,
@@ -775,6 +1775,7 @@ public:
         info.pHeader = chunkHeader;
         info.compression = compression;
         info.version = version;
+        info.key = key;
 
         int index = 0;
         RDF_CHECK_CALL(
@@ -802,6 +1803,19 @@ public:
                     const void* chunkHeader,
                     const rdfCompression compression,
                     const std::uint32_t version)
+    {
+        BeginChunk(chunkId, chunkHeaderSize, chunkHeader, compression, version, 0);
+    }
+
+    /**
+     * @since 1.5
+     */
+    void BeginChunk(const char* chunkId,
+                    const std::int64_t chunkHeaderSize,
+                    const void* chunkHeader,
+                    const rdfCompression compression,
+                    const std::uint32_t version,
+                    const std::uint64_t key)
     {
         rdfChunkCreateInfo info = {};
         ::memcpy(info.identifier, chunkId,
@@ -810,6 +1824,7 @@ public:
         info.pHeader = chunkHeader;
         info.compression = compression;
         info.version = version;
+        info.key = key;
 
         RDF_CHECK_CALL(rdfChunkFileWriterBeginChunk(writer_, &info));
     }
@@ -833,6 +1848,57 @@ public:
         return index;
     }
 
+    /**
+     * @since 1.5
+     */
+    void Flush()
+    {
+        RDF_CHECK_CALL(rdfChunkFileWriterFlush(writer_));
+    }
+
+    /**
+     * @since 1.5
+     */
+    void RemoveChunk(const char* chunkId, const int chunkIndex)
+    {
+        RDF_CHECK_CALL(rdfChunkFileWriterRemoveChunk(writer_, chunkId, chunkIndex));
+    }
+
+    /**
+     * @since 1.5
+     */
+    int CopyChunk(ChunkFile& source, const char* chunkId, const int chunkIndex)
+    {
+        int index = 0;
+        RDF_CHECK_CALL(rdfChunkFileWriterCopyChunk(
+            writer_, static_cast<rdfChunkFile*>(source), chunkId, chunkIndex, &index));
+        return index;
+    }
+
+    /**
+     * @since 1.5
+     */
+    ChunkWriter OpenChunk(const char* chunkId,
+                          const std::int64_t chunkHeaderSize,
+                          const void* chunkHeader,
+                          const rdfCompression compression = rdfCompressionNone,
+                          const std::uint32_t version = 1,
+                          const std::uint64_t key = 0)
+    {
+        rdfChunkCreateInfo info = {};
+        ::memcpy(info.identifier, chunkId,
+            SafeStringLength(chunkId, RDF_IDENTIFIER_SIZE));
+        info.headerSize = chunkHeaderSize;
+        info.pHeader = chunkHeader;
+        info.compression = compression;
+        info.version = version;
+        info.key = key;
+
+        ChunkWriter result;
+        RDF_CHECK_CALL(rdfChunkFileWriterOpenChunk(writer_, &info, &result.chunk_));
+        return result;
+    }
+
 private:
     rdfChunkFileWriter* writer_ = nullptr;
 
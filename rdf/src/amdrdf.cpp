@@ -1,10 +1,17 @@
 /* Copyright (c) 2021-2024 Advanced Micro Devices, Inc. All rights reserved. */
 #include "amdrdf.h"
 
+#include <lz4/lz4frame.h>
+// For XXH64_state_t and XXH3_state_t
+#define XXH_STATIC_LINKING_ONLY
+#include <xxhash/xxhash.h>
 #include <zstd/zstd.h>
 
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <limits>
 #include <stdexcept>
@@ -20,13 +27,26 @@
 #endif  // #if RDF_PLATFORM_WINDOWS
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
 // We use map so we don't have to provide a hash function for chunkId, which
 // is a bit tricky with C++11 and old compilers
 #include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 #if RDF_PLATFORM_UNIX
+    #include <fcntl.h>
+    #include <sys/mman.h>
     #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 namespace rdf
@@ -83,6 +103,52 @@ namespace internal
         bool CanWrite() const;
         bool CanRead() const;
 
+        /**
+        Reserve storage for size bytes up front, without changing the size
+        of the stream. This is a hint, streams which can't reserve storage
+        ignore it.
+        */
+        void Reserve(const std::int64_t size);
+
+        /**
+        Set the size of the stream, releasing storage reserved beyond it.
+        Streams which can't change their size ignore this.
+        */
+        void Truncate(const std::int64_t size);
+
+        struct MemorySegment
+        {
+            const void* data;
+            std::int64_t size;
+        };
+
+        /**
+        Get pointers to the contents of streams which are stored in memory,
+        in stream order. Returns false for all other streams. The pointers
+        are valid until the stream is modified or closed.
+        */
+        bool GetMemoryView(std::vector<MemorySegment>& segments) const;
+
+        /**
+        Take ownership of the contents as one contiguous buffer, leaving the
+        stream empty. Returns false if the stream doesn't own its memory.
+        The buffer is null if the stream is empty.
+        */
+        bool DetachMemoryBuffer(std::unique_ptr<unsigned char[]>& buffer, std::int64_t& size);
+
+        /**
+        Pass written data on to the OS, and drop any data cached for reading,
+        so other handles to the same file and this one see each other's
+        changes.
+        */
+        void Flush();
+
+        /**
+        Get the file descriptor backing the stream, or -1 if the stream
+        isn't backed by one. The stream keeps ownership of the descriptor.
+        */
+        int GetFileDescriptor() const;
+
         void Close();
 
     private:
@@ -98,6 +164,27 @@ namespace internal
         virtual bool CanWriteImpl() const = 0;
         virtual bool CanReadImpl() const = 0;
 
+        virtual void ReserveImpl(const std::int64_t size) { (void)size; }
+        virtual void TruncateImpl(const std::int64_t size) { (void)size; }
+
+        virtual bool GetMemoryViewImpl(std::vector<MemorySegment>& segments) const
+        {
+            (void)segments;
+            return false;
+        }
+
+        virtual bool DetachMemoryBufferImpl(std::unique_ptr<unsigned char[]>& buffer,
+                                            std::int64_t& size)
+        {
+            (void)buffer;
+            (void)size;
+            return false;
+        }
+
+        virtual void FlushImpl() {}
+
+        virtual int GetFileDescriptorImpl() const { return -1; }
+
         virtual void CloseImpl() = 0;
     };
 
@@ -190,6 +277,84 @@ namespace internal
         rdfUserStream stream_;
     };
 
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    User stream with positional callbacks, which map directly onto IStream.
+    */
+    class UserStream2 final : public IStream
+    {
+    public:
+        UserStream2(rdfUserStream2 stream) : stream_(stream)
+        {
+            if (stream_.ReadAt == nullptr && stream_.WriteAt == nullptr) {
+                throw std::runtime_error("Stream must support at least reading or writing");
+            }
+
+            if (stream_.GetSize == nullptr) {
+                throw std::runtime_error("Stream must provide a GetSize callback");
+            }
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            assert(stream_.ReadAt);
+
+            std::int64_t bytesRead = 0;
+            CheckCall(stream_.ReadAt(stream_.context, offset, count, buffer, &bytesRead));
+            assert(bytesRead <= count);
+            return bytesRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            assert(stream_.WriteAt);
+
+            std::int64_t bytesWritten = 0;
+            CheckCall(stream_.WriteAt(stream_.context, offset, count, buffer, &bytesWritten));
+            assert(bytesWritten <= count);
+            return bytesWritten;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            std::int64_t size = 0;
+            CheckCall(stream_.GetSize(stream_.context, &size));
+            assert(size >= 0);
+            return size;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return stream_.WriteAt != nullptr;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return stream_.ReadAt != nullptr;
+        }
+
+        void CloseImpl() override
+        {
+            if (stream_.Close) {
+                stream_.Close(stream_.context);
+            }
+        }
+
+        void CheckCall(int result) const
+        {
+            if (result != rdfResultOk) {
+                throw std::runtime_error("I/O error");
+            }
+        }
+
+        rdfUserStream2 stream_;
+    };
+
     ///////////////////////////////////////////////////////////////////////////
     /**
 	Helper class to make the handling of chunk IDs a bit easier
@@ -212,6 +377,12 @@ namespace internal
             ::memcpy(id_, id, size);
         }
 
+        // Not null-terminated if the identifier uses all characters
+        const IdType& Get() const
+        {
+            return id_;
+        }
+
         ChunkId(const ChunkId& rhs)
         {
             ::memcpy(id_, rhs.id_, sizeof(IdType));
@@ -261,17 +432,216 @@ namespace internal
                                       rdfStreamAccess access,
                                       rdfFileMode fileMode);
 
+    std::unique_ptr<IStream> OpenDirectFile(const char* filename,
+                                            rdfStreamAccess access,
+                                            rdfFileMode fileMode);
+
     std::unique_ptr<IStream> CreateFile(const char* filename);
 
     std::unique_ptr<IStream> CreateReadOnlyMemoryStream(const std::int64_t bufferSize,
                                                         const void* buffer);
 
-    std::unique_ptr<IStream> CreateMemoryStream();
+    std::unique_ptr<IStream> CreateMemoryStream(const std::int64_t capacityHint = 0);
+
+    std::unique_ptr<IStream> CreateSharedMemoryStream(const char* name,
+                                                      const std::int64_t capacityHint);
+
+    std::unique_ptr<IStream> MapFileDescriptor(const int fd);
+
+    std::unique_ptr<IStream> CreateCachedStream(IStream* inner,
+                                                const std::int64_t blockSize,
+                                                const std::int64_t cacheSize,
+                                                const std::int64_t readaheadBlocks);
+
+    std::unique_ptr<IStream> CreateSubStream(IStream* parent,
+                                             const std::int64_t offset,
+                                             const std::int64_t size);
 
     enum class Compression : std::uint8_t
     {
         None = 0,
-        Zstd
+        Zstd,
+        Lz4
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    LZ4 chunk data is stored as a single LZ4 frame, so it can be handled by
+    any tool understanding the LZ4 frame format. We always write independent
+    blocks of up to 4 MiB, without checksums, but with the content size set.
+
+    See https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+    */
+    namespace lz4frame
+    {
+        LZ4F_preferences_t GetPreferences(const std::int64_t size)
+        {
+            LZ4F_preferences_t preferences = {};
+            preferences.frameInfo.blockSizeID = LZ4F_max4MB;
+            preferences.frameInfo.blockMode = LZ4F_blockIndependent;
+            preferences.frameInfo.contentSize = static_cast<unsigned long long>(size);
+            return preferences;
+        }
+
+        std::int64_t CompressBound(const std::int64_t size)
+        {
+            const auto preferences = GetPreferences(size);
+            return LZ4F_compressFrameBound(static_cast<std::size_t>(size), &preferences);
+        }
+
+        /**
+        Compress size bytes from input into output, which must be at least
+        CompressBound(size) bytes large.
+
+        Returns the number of bytes written to output.
+        */
+        std::int64_t Compress(const void* input, const std::int64_t size, void* output)
+        {
+            const auto preferences = GetPreferences(size);
+            const auto result = LZ4F_compressFrame(output,
+                                                   LZ4F_compressFrameBound(size, &preferences),
+                                                   input,
+                                                   static_cast<std::size_t>(size),
+                                                   &preferences);
+
+            if (LZ4F_isError(result)) {
+                throw std::runtime_error(std::string("LZ4 compression failed: ") +
+                                         LZ4F_getErrorName(result));
+            }
+
+            return static_cast<std::int64_t>(result);
+        }
+
+        /**
+        Decompress a frame of inputSize bytes into output, which must be
+        exactly outputSize bytes large.
+
+        The frame header checksum is always verified, and so are block and
+        content checksums if the frame has them. Throws if the frame is
+        malformed, fails a checksum, or doesn't match the output size.
+        */
+        void Decompress(const void* input,
+                        const std::int64_t inputSize,
+                        void* output,
+                        const std::int64_t outputSize)
+        {
+            LZ4F_dctx* context = nullptr;
+            if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION))) {
+                throw std::runtime_error("Could not create LZ4 decompression context");
+            }
+
+            std::unique_ptr<LZ4F_dctx, LZ4F_errorCode_t (*)(LZ4F_dctx*)> contextGuard(
+                context, &LZ4F_freeDecompressionContext);
+
+            const unsigned char* ip = static_cast<const unsigned char*>(input);
+            const unsigned char* const iend = ip + inputSize;
+            unsigned char* op = static_cast<unsigned char*>(output);
+            unsigned char* const oend = op + outputSize;
+
+            // Non-zero until the end of the frame has been decoded
+            std::size_t result = 1;
+            while (result != 0) {
+                if (ip == iend) {
+                    throw std::runtime_error("Truncated LZ4 frame");
+                }
+
+                std::size_t inputCount = iend - ip;
+                std::size_t outputCount = oend - op;
+                result = LZ4F_decompress(context, op, &outputCount, ip, &inputCount, nullptr);
+
+                if (LZ4F_isError(result)) {
+                    throw std::runtime_error(std::string("Corrupted LZ4 frame: ") +
+                                             LZ4F_getErrorName(result));
+                }
+
+                // No progress means the output is full, but the frame isn't
+                if (inputCount == 0 && outputCount == 0 && result != 0) {
+                    throw std::runtime_error("LZ4 frame exceeds the uncompressed size");
+                }
+
+                ip += inputCount;
+                op += outputCount;
+            }
+
+            if (op != oend) {
+                throw std::runtime_error("LZ4 frame size does not match the uncompressed size");
+            }
+        }
+    }  // namespace lz4frame
+
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    Streaming XXH64, used to find identical chunk payloads, and for the
+    checksums of indices.
+    */
+    class StreamingXXH64
+    {
+    public:
+        StreamingXXH64()
+        {
+            XXH64_reset(&state_, 0);
+        }
+
+        void Update(const void* data, const std::int64_t size)
+        {
+            XXH64_update(&state_, data, static_cast<std::size_t>(size));
+        }
+
+        std::uint64_t Digest() const
+        {
+            return XXH64_digest(&state_);
+        }
+
+        static std::uint64_t Hash(const void* data, const std::int64_t size)
+        {
+            return XXH64(data, static_cast<std::size_t>(size), 0);
+        }
+
+    private:
+        XXH64_state_t state_;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    Streaming XXH3 (64-bit), used for the checksums of chunk data.
+
+    The state requires a larger alignment than operator new guarantees in
+    C++11, so it's allocated by xxHash.
+    */
+    class StreamingXXH3
+    {
+    public:
+        StreamingXXH3() : state_(XXH3_createState(), &XXH3_freeState)
+        {
+            if (!state_) {
+                throw std::bad_alloc();
+            }
+
+            Reset();
+        }
+
+        void Reset()
+        {
+            XXH3_64bits_reset(state_.get());
+        }
+
+        void Update(const void* data, const std::int64_t size)
+        {
+            XXH3_64bits_update(state_.get(), data, static_cast<std::size_t>(size));
+        }
+
+        std::uint64_t Digest() const
+        {
+            return XXH3_64bits_digest(state_.get());
+        }
+
+        static std::uint64_t Hash(const void* data, const std::int64_t size)
+        {
+            return XXH3_64bits(data, static_cast<std::size_t>(size));
+        }
+
+    private:
+        std::unique_ptr<XXH3_state_t, XXH_errorcode (*)(XXH3_state_t*)> state_;
     };
 
     ///////////////////////////////////////////////////////////////////////////
@@ -317,12 +687,18 @@ namespace internal
         static const char LegacyIdentifier[];
 
         static constexpr int Version = 0x3;
+        // Files whose index is split into segments, each linking to the one
+        // written before it. Writers use this while a file is being written,
+        // and switch back to Version once they write the complete index.
+        // Older readers reject these files instead of missing chunks
+        static constexpr int SegmentedVersion = 0x4;
 
         struct Header final
         {
             char identifier[8];  // "RTA_DATA" or "AMD_RDF "
             std::uint32_t version;
-            std::uint32_t reserved;
+            // Combination of HeaderFlags, always zero before 1.5
+            std::uint32_t flags;
 
             std::int64_t indexOffset;
             std::int64_t indexSize;
@@ -330,76 +706,548 @@ namespace internal
 
         static_assert(sizeof(Header) == 32ULL, "Invalid header entry size.");
 
-        ChunkFile(std::unique_ptr<IStream>&& stream)
-            : streamPointer_(std::move(stream)), stream_(streamPointer_.get())
+        enum HeaderFlags : std::uint32_t
         {
-            Construct();
-        }
+            // The index is followed by an IndexTrailer. Set for files whose
+            // index gets published while they're being written
+            IndexTrailerFlag = 1,
+            // The index is preceded by a 64-bit key per entry, in the same
+            // order. Applies to every segment of a segmented index
+            ChunkKeysFlag = 2,
+            // The keys (or the index, if there are no keys) are preceded by
+            // a 64-bit checksum per entry, in the same order. Applies to
+            // every segment of a segmented index
+            ChunkChecksumsFlag = 4
+        };
 
-        ChunkFile(IStream* stream) : stream_(stream)
+        /**
+        Written after the index, so readers can tell whether the header they
+        read points at a complete index, or was read while being updated.
+        Older readers ignore it.
+
+        In files with the SegmentedVersion, the index may only contain the
+        chunks written since the previous index segment, which is linked
+        from here.
+
+        The index is preceded by the number of chunks per identifier across
+        all segments, so writers can append to the file without reading all
+        segments. Readers don't need them. If the file has chunk checksums
+        and keys, those come between the chunk counts and the index, in this
+        order.
+        */
+        struct IndexTrailer final
         {
-            Construct();
-        }
+            char identifier[8];  // "RDFINDEX"
+            std::int64_t indexOffset;
+            std::int64_t indexSize;
+            // Zero if this is the first segment
+            std::int64_t previousIndexOffset;
+            std::int64_t previousIndexSize;
+            // Size of the ChunkCount array right before the index
+            std::int64_t chunkCountsSize;
+            // XXH64 of the fields above, the chunk counts, the keys, the
+            // checksums and the index
+            std::uint64_t hash;
+        };
 
-    private:
-        void Construct()
+        static_assert(sizeof(IndexTrailer) == 56ULL, "Invalid index trailer size.");
+
+        struct ChunkCount final
         {
-            // Read the header from the file start
-            if (stream_->Read(0, sizeof(header_), &header_) != sizeof(header_)) {
-                throw std::runtime_error("Error while reading file -- could not read header");
-            }
+            char chunkIdentifier[RDF_IDENTIFIER_SIZE];
+            std::int64_t count;
+        };
 
-            if (::memcmp(header_.identifier, Identifier, 8) != 0 &&
-                ::memcmp(header_.identifier, LegacyIdentifier, 8) != 0)
-            {
-                throw std::runtime_error("Invalid file header");
-            }
+        static_assert(sizeof(ChunkCount) == 24ULL, "Invalid chunk count size.");
 
-            if (header_.version != Version) {
-                throw std::runtime_error("Unsupported file version");
+        static std::vector<ChunkCount> CreateChunkCounts(const std::map<ChunkId, int>& counts)
+        {
+            std::vector<ChunkCount> chunkCounts;
+            chunkCounts.reserve(counts.size());
+
+            for (const auto& count : counts) {
+                ChunkCount chunkCount;
+                ::memcpy(chunkCount.chunkIdentifier,
+                         count.first.Get(),
+                         sizeof(chunkCount.chunkIdentifier));
+                chunkCount.count = count.second;
+                chunkCounts.push_back(chunkCount);
             }
 
-            index_.resize(header_.indexSize / sizeof(IndexEntry));
-            stream_->Read(header_.indexOffset,
-                          index_.size() * sizeof(IndexEntry),
-                          index_.data());
+            return chunkCounts;
+        }
+
+        static const char IndexTrailerIdentifier[];
 
-            BuildChunkIndex();
+        static IndexTrailer CreateIndexTrailer(const std::int64_t indexOffset,
+                                               const std::int64_t indexSize,
+                                               const std::int64_t previousIndexOffset,
+                                               const std::int64_t previousIndexSize,
+                                               const IndexEntry* index,
+                                               const std::uint64_t* keys,
+                                               const std::uint64_t* checksums,
+                                               const std::vector<ChunkCount>& chunkCounts)
+        {
+            IndexTrailer trailer;
+            ::memcpy(trailer.identifier, IndexTrailerIdentifier, sizeof(trailer.identifier));
+            trailer.indexOffset = indexOffset;
+            trailer.indexSize = indexSize;
+            trailer.previousIndexOffset = previousIndexOffset;
+            trailer.previousIndexSize = previousIndexSize;
+            trailer.chunkCountsSize = chunkCounts.size() * sizeof(ChunkCount);
+
+            StreamingXXH64 hash;
+            hash.Update(&trailer, offsetof(IndexTrailer, hash));
+            hash.Update(chunkCounts.data(), trailer.chunkCountsSize);
+            if (keys) {
+                hash.Update(keys, GetExtensionSize(indexSize));
+            }
+            if (checksums) {
+                hash.Update(checksums, GetExtensionSize(indexSize));
+            }
+            hash.Update(index, indexSize);
+            trailer.hash = hash.Digest();
+
+            return trailer;
         }
 
-    public:
-        bool ContainsChunk(const char* chunkId, const int chunkIndex) const
+        /**
+        Size of an index extension, which stores one 64-bit value per entry,
+        for an index of the given size.
+        */
+        static std::int64_t GetExtensionSize(const std::int64_t indexSize)
         {
-            assert(chunkId);
-            assert(chunkIndex >= 0);
+            return indexSize / std::int64_t(sizeof(IndexEntry)) * std::int64_t(sizeof(std::uint64_t));
+        }
 
-            ChunkId id(chunkId);
+        /**
+        Read a single index segment, the keys and checksums indicated by
+        flags, its chunk counts and its trailer. Returns false if the segment
+        doesn't match its trailer.
+        */
+        static bool ReadIndexSegment(IStream* stream,
+                                     const std::int64_t indexOffset,
+                                     const std::int64_t indexSize,
+                                     const std::uint32_t flags,
+                                     std::vector<IndexEntry>& segment,
+                                     std::vector<std::uint64_t>& keys,
+                                     std::vector<std::uint64_t>& checksums,
+                                     std::vector<ChunkCount>& chunkCounts,
+                                     IndexTrailer& trailer)
+        {
+            const std::int64_t keysSize =
+                (flags & ChunkKeysFlag) ? GetExtensionSize(indexSize) : 0;
+            const std::int64_t checksumsSize =
+                (flags & ChunkChecksumsFlag) ? GetExtensionSize(indexSize) : 0;
+            const std::int64_t keysOffset = indexOffset - keysSize;
+            const std::int64_t checksumsOffset = keysOffset - checksumsSize;
+
+            // A header which is being updated can point anywhere
+            if (checksumsOffset < std::int64_t(sizeof(Header)) || indexSize < 0 ||
+                indexSize % sizeof(IndexEntry) != 0 ||
+                indexOffset > stream->GetSize() - indexSize - std::int64_t(sizeof(IndexTrailer))) {
+                return false;
+            }
 
-            auto it = chunkTypeRange_.find(id);
-            if (it == chunkTypeRange_.end()) {
+            if (stream->Read(indexOffset + indexSize, sizeof(trailer), &trailer) !=
+                    sizeof(trailer) ||
+                trailer.chunkCountsSize < 0 || trailer.chunkCountsSize % sizeof(ChunkCount) != 0 ||
+                trailer.chunkCountsSize > checksumsOffset - std::int64_t(sizeof(Header))) {
                 return false;
             }
 
-            if (chunkIndex >= (it->second.last - it->second.first)) {
+            segment.resize(indexSize / sizeof(IndexEntry));
+            keys.resize(keysSize / sizeof(std::uint64_t));
+            checksums.resize(checksumsSize / sizeof(std::uint64_t));
+            chunkCounts.resize(trailer.chunkCountsSize / sizeof(ChunkCount));
+            if (stream->Read(indexOffset, indexSize, segment.data()) != indexSize ||
+                stream->Read(keysOffset, keysSize, keys.data()) != keysSize ||
+                stream->Read(checksumsOffset, checksumsSize, checksums.data()) != checksumsSize ||
+                stream->Read(checksumsOffset - trailer.chunkCountsSize,
+                             trailer.chunkCountsSize,
+                             chunkCounts.data()) != trailer.chunkCountsSize) {
                 return false;
             }
 
-            return true;
+            const auto expected =
+                CreateIndexTrailer(indexOffset,
+                                   indexSize,
+                                   trailer.previousIndexOffset,
+                                   trailer.previousIndexSize,
+                                   segment.data(),
+                                   (flags & ChunkKeysFlag) ? keys.data() : nullptr,
+                                   (flags & ChunkChecksumsFlag) ? checksums.data() : nullptr,
+                                   chunkCounts);
+
+            return ::memcmp(&trailer, &expected, sizeof(trailer)) == 0;
         }
 
-        const IndexEntry& GetChunkInfo(const char* chunkId, const int chunkIndex) const
+        /**
+        Read the index segment at the given location and all segments
+        before it, and append their entries, keys and checksums to index,
+        keys and checksums, oldest first. Missing keys and checksums are set
+        to zero. Returns false if any segment doesn't match its trailer.
+
+        Segments are only ever written after the one they link to, so the
+        chain can't loop.
+        */
+        static bool ReadIndexSegments(IStream* stream,
+                                      std::int64_t indexOffset,
+                                      std::int64_t indexSize,
+                                      const std::uint32_t flags,
+                                      std::vector<IndexEntry>& index,
+                                      std::vector<std::uint64_t>& keys,
+                                      std::vector<std::uint64_t>& checksums)
         {
-            assert(chunkId);
-            assert(chunkIndex >= 0);
+            struct Segment
+            {
+                std::vector<IndexEntry> entries;
+                std::vector<std::uint64_t> keys;
+                std::vector<std::uint64_t> checksums;
+            };
+
+            // Newest first
+            std::vector<Segment> segments;
+            std::vector<ChunkCount> chunkCounts;
+
+            for (;;) {
+                Segment segment;
+                IndexTrailer trailer;
+                if (!ReadIndexSegment(stream,
+                                      indexOffset,
+                                      indexSize,
+                                      flags,
+                                      segment.entries,
+                                      segment.keys,
+                                      segment.checksums,
+                                      chunkCounts,
+                                      trailer)) {
+                    return false;
+                }
 
-            ChunkId id(chunkId);
+                segments.push_back(std::move(segment));
 
-            auto it = chunkTypeRange_.find(id);
-            if (it == chunkTypeRange_.end()) {
-                throw std::runtime_error("Chunk not found");
+                if (trailer.previousIndexOffset == 0) {
+                    break;
+                } else if (trailer.previousIndexOffset >= indexOffset) {
+                    return false;
+                }
+
+                indexOffset = trailer.previousIndexOffset;
+                indexSize = trailer.previousIndexSize;
             }
 
-            if (chunkIndex >= (it->second.last - it->second.first)) {
+            for (std::size_t i = segments.size(); i-- > 0;) {
+                const auto& segment = segments[i];
+                index.insert(index.end(), segment.entries.begin(), segment.entries.end());
+                keys.insert(keys.end(), segment.keys.begin(), segment.keys.end());
+                checksums.insert(
+                    checksums.end(), segment.checksums.begin(), segment.checksums.end());
+
+                keys.resize(index.size(), 0);
+                checksums.resize(index.size(), 0);
+            }
+
+            return true;
+        }
+
+        /**
+        Read the complete index, the chunk keys and the chunk checksums of a
+        file, in file order. Files without keys or checksums get zero for
+        every chunk. Returns false if the index is inconsistent, e.g. because
+        it's being updated.
+        */
+        static bool ReadFileIndex(IStream* stream,
+                                  const Header& header,
+                                  std::vector<IndexEntry>& index,
+                                  std::vector<std::uint64_t>& keys,
+                                  std::vector<std::uint64_t>& checksums)
+        {
+            if (header.flags & IndexTrailerFlag) {
+                return ReadIndexSegments(stream,
+                                         header.indexOffset,
+                                         header.indexSize,
+                                         header.flags,
+                                         index,
+                                         keys,
+                                         checksums);
+            } else if (header.version == SegmentedVersion) {
+                throw std::runtime_error("Invalid file header");
+            }
+
+            const auto first = index.size();
+            index.resize(first + header.indexSize / sizeof(IndexEntry));
+            stream->Read(header.indexOffset,
+                         (index.size() - first) * sizeof(IndexEntry),
+                         index.data() + first);
+
+            const auto extensionSize = GetExtensionSize(header.indexSize);
+            std::int64_t extensionOffset = header.indexOffset;
+
+            keys.resize(index.size(), 0);
+            if (header.flags & ChunkKeysFlag) {
+                extensionOffset -= extensionSize;
+                stream->Read(extensionOffset, extensionSize, keys.data() + first);
+            }
+
+            checksums.resize(index.size(), 0);
+            if (header.flags & ChunkChecksumsFlag) {
+                extensionOffset -= extensionSize;
+                stream->Read(extensionOffset, extensionSize, checksums.data() + first);
+            }
+
+            return true;
+        }
+
+        ChunkFile(std::unique_ptr<IStream>&& stream)
+            : streamPointer_(std::move(stream)), streams_(1, streamPointer_.get())
+        {
+            Construct();
+        }
+
+        ChunkFile(IStream* stream) : streams_(1, stream)
+        {
+            Construct();
+        }
+
+        /**
+        Present several files as one. Chunks with the same identifier are
+        numbered consecutively across the files, in the order given.
+        */
+        ChunkFile(const std::vector<IStream*>& streams) : streams_(streams)
+        {
+            Construct();
+        }
+
+        /**
+        Re-read the index if any of the files changed since it was read last.
+        Returns true if the index was updated, which invalidates iterators.
+
+        An index which is being published right now is skipped, so this
+        never exposes a partial update. It shows up on the next refresh.
+        */
+        bool Refresh()
+        {
+            bool changed = false;
+
+            for (std::size_t i = 0; i < streams_.size(); ++i) {
+                // Drop anything the stream may have cached from the last read
+                streams_[i]->Flush();
+
+                Header header;
+                if (streams_[i]->Read(0, sizeof(header), &header) != sizeof(header)) {
+                    throw std::runtime_error("Error while reading file -- could not read header");
+                }
+
+                if (header.indexOffset != headers_[i].indexOffset ||
+                    header.indexSize != headers_[i].indexSize) {
+                    changed = true;
+                }
+            }
+
+            return changed && ReadIndices();
+        }
+
+    private:
+        // A writer may be publishing a new index while we're opening the
+        // file, in which case we retry this often
+        static constexpr int MaxIndexReadAttempts = 100;
+
+        void Construct()
+        {
+            for (int attempt = 0; !ReadIndices(); ++attempt) {
+                if (attempt == MaxIndexReadAttempts) {
+                    throw std::runtime_error("Could not read a consistent index");
+                }
+
+                std::this_thread::yield();
+            }
+        }
+
+        /**
+        Read the indices of all files, and replace the current index with
+        them. Returns false and leaves everything untouched if an index
+        is being updated.
+        */
+        bool ReadIndices()
+        {
+            std::vector<Header> headers(streams_.size());
+            std::vector<IndexEntry> index;
+            std::vector<std::uint64_t> keys;
+            std::vector<std::uint64_t> checksums;
+            std::vector<IStream*> entryStreams;
+
+            for (std::size_t i = 0; i < streams_.size(); ++i) {
+                if (!ReadIndex(streams_[i], headers[i], index, keys, checksums)) {
+                    return false;
+                }
+
+                entryStreams.resize(index.size(), streams_[i]);
+            }
+
+            headers_.swap(headers);
+            index_.swap(index);
+            keys_.swap(keys);
+            checksums_.swap(checksums);
+            entryStreams_.swap(entryStreams);
+
+            // The loaded headers belong to the previous index
+            headerArena_.clear();
+            headerArenaOffsets_.clear();
+
+            BuildChunkIndex();
+
+            return true;
+        }
+
+        /**
+        Append the index, the chunk keys and the chunk checksums of a file
+        to index, keys and checksums. Returns false if the file has an index
+        trailer which doesn't match the header, or an index segment which
+        doesn't match its trailer.
+        */
+        bool ReadIndex(IStream* stream,
+                       Header& header,
+                       std::vector<IndexEntry>& index,
+                       std::vector<std::uint64_t>& keys,
+                       std::vector<std::uint64_t>& checksums) const
+        {
+            // Read the header from the file start
+            if (stream->Read(0, sizeof(header), &header) != sizeof(header)) {
+                throw std::runtime_error("Error while reading file -- could not read header");
+            }
+
+            if (::memcmp(header.identifier, Identifier, 8) != 0 &&
+                ::memcmp(header.identifier, LegacyIdentifier, 8) != 0)
+            {
+                throw std::runtime_error("Invalid file header");
+            }
+
+            if (header.version != Version && header.version != SegmentedVersion) {
+                throw std::runtime_error("Unsupported file version");
+            }
+
+            return ReadFileIndex(stream, header, index, keys, checksums);
+        }
+
+        /**
+        Get the stream of the file an entry of index_ comes from.
+        */
+        IStream* GetEntryStream(const IndexEntry& entry) const
+        {
+            return entryStreams_[&entry - index_.data()];
+        }
+
+        /**
+        Read and decompress the data of a chunk.
+        */
+        void ReadChunkData(const IndexEntry& entry, void* buffer)
+        {
+            assert(entry.chunkDataOffset >= 0);
+            assert(entry.chunkDataSize >= 0);
+
+            IStream* stream = GetEntryStream(entry);
+
+            if (entry.compression == Compression::Zstd) {
+                // The scratch buffer is reused across calls, which saves
+                // allocating and faulting in fresh memory for every read
+                compressedData_.resize(entry.chunkDataSize);
+
+                if (stream->Read(entry.chunkDataOffset,
+                                 entry.chunkDataSize,
+                                 compressedData_.data()) != entry.chunkDataSize) {
+                    throw std::runtime_error("Error while reading chunk data");
+                }
+
+                assert(entry.uncompressedChunkSize >= 0);
+                const auto size = ZSTD_decompress(buffer,
+                                                  entry.uncompressedChunkSize,
+                                                  compressedData_.data(),
+                                                  entry.chunkDataSize);
+
+                if (ZSTD_isError(size)) {
+                    throw std::runtime_error(std::string("Error while decompressing chunk data: ") +
+                                             ZSTD_getErrorName(size));
+                }
+
+                if (static_cast<std::int64_t>(size) != entry.uncompressedChunkSize) {
+                    throw std::runtime_error(
+                        "Decompressed chunk data size does not match the uncompressed size");
+                }
+            } else if (entry.compression == Compression::Lz4) {
+                compressedData_.resize(entry.chunkDataSize);
+
+                if (stream->Read(entry.chunkDataOffset,
+                                 entry.chunkDataSize,
+                                 compressedData_.data()) != entry.chunkDataSize) {
+                    throw std::runtime_error("Error while reading chunk data");
+                }
+
+                assert(entry.uncompressedChunkSize >= 0);
+                lz4frame::Decompress(compressedData_.data(),
+                                     entry.chunkDataSize,
+                                     buffer,
+                                     entry.uncompressedChunkSize);
+            } else if (entry.compression == Compression::None) {
+                if (stream->Read(entry.chunkDataOffset, entry.chunkDataSize, buffer) !=
+                    entry.chunkDataSize) {
+                    throw std::runtime_error("Error while reading chunk data");
+                }
+            } else {
+                throw std::runtime_error("Unsupported compression algorithm");
+            }
+        }
+
+        /**
+        Check the uncompressed data of a chunk against its checksum. Chunks
+        without a checksum always pass.
+        */
+        bool VerifyChecksum(const IndexEntry& entry, const void* data) const
+        {
+            const auto checksum = checksums_[&entry - index_.data()];
+            if (checksum == 0) {
+                return true;
+            }
+
+            const auto size = entry.compression != Compression::None
+                                  ? entry.uncompressedChunkSize
+                                  : entry.chunkDataSize;
+            return StreamingXXH3::Hash(data, size) == checksum;
+        }
+
+    public:
+        bool ContainsChunk(const char* chunkId, const int chunkIndex) const
+        {
+            assert(chunkId);
+            assert(chunkIndex >= 0);
+
+            ChunkId id(chunkId);
+
+            auto it = chunkTypeRange_.find(id);
+            if (it == chunkTypeRange_.end()) {
+                return false;
+            }
+
+            if (chunkIndex >= (it->second.last - it->second.first)) {
+                return false;
+            }
+
+            return true;
+        }
+
+        const IndexEntry& GetChunkInfo(const char* chunkId, const int chunkIndex) const
+        {
+            assert(chunkId);
+            assert(chunkIndex >= 0);
+
+            ChunkId id(chunkId);
+
+            auto it = chunkTypeRange_.find(id);
+            if (it == chunkTypeRange_.end()) {
+                throw std::runtime_error("Chunk not found");
+            }
+
+            if (chunkIndex >= (it->second.last - it->second.first)) {
                 throw std::runtime_error("Chunk index out of range");
             }
 
@@ -427,36 +1275,178 @@ namespace internal
             assert(entry.chunkHeaderOffset >= 0);
             assert(entry.chunkHeaderSize >= 0);
             if (entry.chunkHeaderSize > 0) {
-                // TODO Check error?
-                stream_->Read(entry.chunkHeaderOffset, entry.chunkHeaderSize, buffer);
+                if (!headerArenaOffsets_.empty()) {
+                    ::memcpy(buffer,
+                             headerArena_.data() + headerArenaOffsets_[&entry - index_.data()],
+                             entry.chunkHeaderSize);
+                } else {
+                    // TODO Check error?
+                    GetEntryStream(entry)->Read(
+                        entry.chunkHeaderOffset, entry.chunkHeaderSize, buffer);
+                }
+            }
+        }
+
+        /**
+        Read the headers of all chunks into memory, so ReadChunkHeader and
+        GetChunkHeader don't have to access the file anymore.
+
+        Headers are read in file order, and headers which are close to each
+        other are fetched with a single read, including whatever is stored
+        between them. For files with many small chunks, this replaces
+        thousands of small reads with a few large ones.
+        */
+        void LoadAllHeaders()
+        {
+            // Reading through a gap is cheaper than issuing another read
+            // unless the gap is large
+            const std::int64_t MaxReadGap = 4096;
+            const std::int64_t MaxReadSize = 1 << 20;
+
+            std::vector<std::size_t> order;
+            std::int64_t arenaSize = 0;
+            for (std::size_t i = 0; i < index_.size(); ++i) {
+                if (index_[i].chunkHeaderSize > 0) {
+                    order.push_back(i);
+                    arenaSize += index_[i].chunkHeaderSize;
+                }
+            }
+
+            std::sort(order.begin(), order.end(), [this](const std::size_t a, const std::size_t b) {
+                if (entryStreams_[a] != entryStreams_[b]) {
+                    return std::less<IStream*>()(entryStreams_[a], entryStreams_[b]);
+                }
+
+                return index_[a].chunkHeaderOffset < index_[b].chunkHeaderOffset;
+            });
+
+            std::vector<unsigned char> arena(static_cast<std::size_t>(arenaSize));
+            std::vector<std::int64_t> arenaOffsets(index_.size(), 0);
+            std::vector<unsigned char> readBuffer;
+            std::int64_t arenaOffset = 0;
+
+            for (std::size_t first = 0; first < order.size();) {
+                IStream* stream = entryStreams_[order[first]];
+                const auto readOffset = index_[order[first]].chunkHeaderOffset;
+                auto readEnd = readOffset + index_[order[first]].chunkHeaderSize;
+
+                // Extend the read over all following headers within reach
+                std::size_t last = first + 1;
+                for (; last < order.size(); ++last) {
+                    const auto& entry = index_[order[last]];
+                    const auto end = std::max(readEnd, entry.chunkHeaderOffset + entry.chunkHeaderSize);
+
+                    if (entryStreams_[order[last]] != stream ||
+                        entry.chunkHeaderOffset - readEnd > MaxReadGap ||
+                        end - readOffset > MaxReadSize) {
+                        break;
+                    }
+
+                    readEnd = end;
+                }
+
+                readBuffer.resize(static_cast<std::size_t>(readEnd - readOffset));
+                if (stream->Read(readOffset, readEnd - readOffset, readBuffer.data()) !=
+                    readEnd - readOffset) {
+                    throw std::runtime_error("Error while reading chunk headers");
+                }
+
+                for (std::size_t i = first; i < last; ++i) {
+                    const auto& entry = index_[order[i]];
+                    ::memcpy(arena.data() + arenaOffset,
+                             readBuffer.data() + (entry.chunkHeaderOffset - readOffset),
+                             entry.chunkHeaderSize);
+                    arenaOffsets[order[i]] = arenaOffset;
+                    arenaOffset += entry.chunkHeaderSize;
+                }
+
+                first = last;
+            }
+
+            headerArena_.swap(arena);
+            headerArenaOffsets_.swap(arenaOffsets);
+        }
+
+        /**
+        Get a pointer to a chunk header loaded by LoadAllHeaders. The pointer
+        stays valid until the index is re-read.
+        */
+        const void* GetChunkHeader(const char* chunkId, const int chunkIndex) const
+        {
+            if (headerArenaOffsets_.empty() && !index_.empty()) {
+                throw std::runtime_error("Chunk headers have not been loaded");
+            }
+
+            const auto& entry = GetChunkInfo(chunkId, chunkIndex);
+            if (entry.chunkHeaderSize == 0) {
+                return nullptr;
             }
+
+            return headerArena_.data() + headerArenaOffsets_[&entry - index_.data()];
         }
 
         void ReadChunkData(const char* chunkId, const int chunkIndex, void* buffer)
         {
             const auto& entry = GetChunkInfo(chunkId, chunkIndex);
+            ReadChunkData(entry, buffer);
 
-            assert(entry.chunkDataOffset >= 0);
-            assert(entry.chunkDataSize >= 0);
+            if (verifyChecksums_ && !VerifyChecksum(entry, buffer)) {
+                throw std::runtime_error("Chunk data does not match its checksum");
+            }
+        }
 
-            if (entry.compression == Compression::Zstd) {
-                std::vector<unsigned char> compressedData;
-                compressedData.resize(entry.chunkDataSize);
+        /**
+        If enabled, ReadChunkData checks the data of every chunk which has a
+        checksum against it, and fails if they don't match.
+        */
+        void SetVerifyChecksums(const bool verify)
+        {
+            verifyChecksums_ = verify;
+        }
 
-                // TODO Check error?
-                stream_->Read(entry.chunkDataOffset,
-                              entry.chunkDataSize,
-                              compressedData.data());
-                assert(entry.uncompressedChunkSize >= 0);
-                ZSTD_decompress(buffer,
-                                entry.uncompressedChunkSize,
-                                compressedData.data(),
-                                compressedData.size());
-            } else if (entry.compression == Compression::None) {
-                stream_->Read(entry.chunkDataOffset, entry.chunkDataSize, buffer);
-            } else {
-                throw std::runtime_error("Unsupported compression algorithm");
+        /**
+        Read the data of all chunks which have a checksum, in file order,
+        and check it against the checksum. Chunks which can't be read or
+        decompressed count as mismatches. Returns the number of mismatches.
+        */
+        std::int64_t VerifyChecksums()
+        {
+            std::vector<std::size_t> order;
+            for (std::size_t i = 0; i < index_.size(); ++i) {
+                if (checksums_[i] != 0) {
+                    order.push_back(i);
+                }
             }
+
+            std::sort(order.begin(), order.end(), [this](const std::size_t a, const std::size_t b) {
+                if (entryStreams_[a] != entryStreams_[b]) {
+                    return std::less<IStream*>()(entryStreams_[a], entryStreams_[b]);
+                }
+
+                return index_[a].chunkDataOffset < index_[b].chunkDataOffset;
+            });
+
+            std::int64_t mismatches = 0;
+            std::vector<unsigned char> buffer;
+
+            for (const auto i : order) {
+                const auto& entry = index_[i];
+                buffer.resize(static_cast<std::size_t>(entry.compression != Compression::None
+                                                           ? entry.uncompressedChunkSize
+                                                           : entry.chunkDataSize));
+
+                try {
+                    ReadChunkData(entry, buffer.data());
+
+                    if (!VerifyChecksum(entry, buffer.data())) {
+                        ++mismatches;
+                    }
+                } catch (const std::runtime_error&) {
+                    ++mismatches;
+                }
+            }
+
+            return mismatches;
         }
 
         std::uint32_t GetChunkVersion(const char* chunkId, const int index) const
@@ -479,20 +1469,115 @@ namespace internal
             return GetChunkInfo(chunkId, index).chunkHeaderSize;
         }
 
+        std::uint64_t GetChunkKey(const char* chunkId, const int index) const
+        {
+            return keys_[&GetChunkInfo(chunkId, index) - index_.data()];
+        }
+
+        std::uint64_t GetChunkChecksum(const char* chunkId, const int index) const
+        {
+            return checksums_[&GetChunkInfo(chunkId, index) - index_.data()];
+        }
+
+        /**
+        Get the indices of all chunks with the given identifier and a key in
+        [first, last], in order of their keys. Chunks with the same key are
+        ordered by index.
+        */
+        std::vector<int> FindChunksByKeyRange(const char* chunkId,
+                                              const std::uint64_t first,
+                                              const std::uint64_t last) const
+        {
+            std::vector<int> result;
+
+            const auto it = chunkTypeRange_.find(ChunkId(chunkId));
+            if (it == chunkTypeRange_.end() || first > last) {
+                return result;
+            }
+
+            const auto start = it->second.first;
+            const auto begin = keyOrder_.begin() + it->second.first;
+            const auto end = keyOrder_.begin() + it->second.last;
+
+            const auto lower =
+                std::lower_bound(begin, end, first, [this, start](const int i, const std::uint64_t key) {
+                    return keys_[start + i] < key;
+                });
+            const auto upper =
+                std::upper_bound(lower, end, last, [this, start](const std::uint64_t key, const int i) {
+                    return key < keys_[start + i];
+                });
+
+            result.assign(lower, upper);
+            return result;
+        }
+
+        /**
+        Open the data of an uncompressed chunk as a chunk file on its own,
+        reading it in place. This chunk file must outlive the result.
+        */
+        std::unique_ptr<ChunkFile> OpenChunkAsFile(const char* chunkId, const int chunkIndex) const
+        {
+            const auto& entry = GetChunkInfo(chunkId, chunkIndex);
+            if (entry.compression != Compression::None) {
+                throw std::runtime_error("Only uncompressed chunks can be opened as a file");
+            }
+
+            return rdf_make_unique<ChunkFile>(
+                CreateSubStream(GetEntryStream(entry), entry.chunkDataOffset, entry.chunkDataSize));
+        }
+
+        /**
+        Read bytes as stored in the file containing entry, i.e. without
+        decompression.
+        */
+        void ReadRaw(const IndexEntry& entry,
+                     const std::int64_t offset,
+                     const std::int64_t size,
+                     void* buffer) const
+        {
+            if (GetEntryStream(entry)->Read(offset, size, buffer) != size) {
+                throw std::runtime_error("Error while reading file");
+            }
+        }
+
     private:
         void BuildChunkIndex()
         {
             // We stable-sort this by index name. This allows us to index
-            // consecutive entries with the same name quickly
-            std::stable_sort(index_.begin(),
-                             index_.end(),
-                             [](const ChunkFile::IndexEntry& first,
-                                const ChunkFile::IndexEntry& second) -> bool {
-                                 return ::memcmp(first.chunkIdentifier,
-                                                 second.chunkIdentifier,
-                                                 sizeof(first.chunkIdentifier)) < 0;
+            // consecutive entries with the same name quickly. The streams
+            // of the entries have to move along, so sort a permutation
+            std::vector<std::size_t> order(index_.size());
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+
+            std::stable_sort(order.begin(),
+                             order.end(),
+                             [this](const std::size_t first, const std::size_t second) -> bool {
+                                 return ::memcmp(index_[first].chunkIdentifier,
+                                                 index_[second].chunkIdentifier,
+                                                 sizeof(index_[first].chunkIdentifier)) < 0;
                              });
 
+            chunkTypeRange_.clear();
+
+            std::vector<IndexEntry> sortedIndex(index_.size());
+            std::vector<std::uint64_t> sortedKeys(index_.size());
+            std::vector<std::uint64_t> sortedChecksums(index_.size());
+            std::vector<IStream*> sortedStreams(index_.size());
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                sortedIndex[i] = index_[order[i]];
+                sortedKeys[i] = keys_[order[i]];
+                sortedChecksums[i] = checksums_[order[i]];
+                sortedStreams[i] = entryStreams_[order[i]];
+            }
+
+            index_.swap(sortedIndex);
+            keys_.swap(sortedKeys);
+            checksums_.swap(sortedChecksums);
+            entryStreams_.swap(sortedStreams);
+
             ChunkId currentChunkId;
             std::size_t start = 0;
             for (std::size_t current = 0; current < index_.size(); ++current) {
@@ -512,13 +1597,38 @@ namespace internal
             if (start < index_.size()) {
                 chunkTypeRange_[currentChunkId] = Range(start, index_.size());
             }
-        }
 
-        Header header_;
-        std::vector<IndexEntry> index_;
+            // Within the range of each chunk type, sort the chunk indices by
+            // key, for range queries
+            keyOrder_.resize(index_.size());
+            for (const auto& range : chunkTypeRange_) {
+                const auto first = range.second.first;
+                const auto last = range.second.last;
 
-        struct Range
-        {
+                for (std::size_t i = first; i < last; ++i) {
+                    keyOrder_[i] = static_cast<int>(i - first);
+                }
+
+                std::stable_sort(keyOrder_.begin() + first,
+                                 keyOrder_.begin() + last,
+                                 [this, first](const int a, const int b) -> bool {
+                                     return keys_[first + a] < keys_[first + b];
+                                 });
+            }
+        }
+
+        std::vector<IndexEntry> index_;
+        // The key of each entry of index_
+        std::vector<std::uint64_t> keys_;
+        // The checksum of each entry of index_, zero if it has none
+        std::vector<std::uint64_t> checksums_;
+        bool verifyChecksums_ = false;
+        // For each chunk type, the chunk indices in order of their keys,
+        // stored at the same range as the chunk type in index_
+        std::vector<int> keyOrder_;
+
+        struct Range
+        {
             Range() = default;
             Range(const std::size_t first, const std::size_t last) : first(first), last(last) {}
 
@@ -530,9 +1640,22 @@ namespace internal
         // The tuple contains a range [first, last)
         std::map<ChunkId, Range> chunkTypeRange_;
 
+        // Scratch space for reading compressed chunk data
+        std::vector<unsigned char> compressedData_;
+
+        // All chunk headers, if they've been loaded, and for each entry of
+        // index_, the offset of its header in headerArena_. Empty if the
+        // headers are read from the file on demand
+        std::vector<unsigned char> headerArena_;
+        std::vector<std::int64_t> headerArenaOffsets_;
+
         // If we own the stream, this will be non-null
         std::unique_ptr<IStream> streamPointer_;
-        IStream* stream_ = nullptr;
+        std::vector<IStream*> streams_;
+        // The header of each stream, as of the last time it was read
+        std::vector<Header> headers_;
+        // The stream each entry of index_ was read from
+        std::vector<IStream*> entryStreams_;
 
         class ChunkFileIterator final : public IChunkFileIterator
         {
@@ -587,126 +1710,517 @@ namespace internal
 
     const char ChunkFile::LegacyIdentifier[] = {'R', 'T', 'A', '_', 'D', 'A', 'T', 'A'};
     const char ChunkFile::Identifier[] = {'A', 'M', 'D', '_', 'R', 'D', 'F', ' '};
+    const char ChunkFile::IndexTrailerIdentifier[] = {'R', 'D', 'F', 'I', 'N', 'D', 'E', 'X'};
+
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    Copy all chunks referenced by the index of input to output, leaving out
+    unused space such as removed chunks, old indices and alignment padding.
+    Chunk headers and data are copied as stored, in the order in which they
+    appear in the file, so nothing gets decompressed.
+
+    input and output can be the same stream, in which case the file is
+    compacted in place. Data only ever moves towards the start of the file,
+    so this is safe, but the file is unusable if compaction gets interrupted.
+    */
+    void CompactChunkFile(IStream* input, IStream* output)
+    {
+        if (!output->CanWrite()) {
+            throw std::runtime_error("Stream must allow for write access");
+        }
+
+        ChunkFile::Header header;
+        if (input->Read(0, sizeof(header), &header) != sizeof(header)) {
+            throw std::runtime_error("Error while reading file -- could not read header");
+        }
+
+        if (::memcmp(header.identifier, ChunkFile::Identifier, 8) != 0 &&
+            ::memcmp(header.identifier, ChunkFile::LegacyIdentifier, 8) != 0) {
+            throw std::runtime_error("Invalid file header");
+        }
+
+        if (header.version != ChunkFile::Version &&
+            header.version != ChunkFile::SegmentedVersion) {
+            throw std::runtime_error("Unsupported file version");
+        }
+
+        // The entries in file order, which defines the chunk indices
+        std::vector<ChunkFile::IndexEntry> entries;
+        std::vector<std::uint64_t> keys;
+        std::vector<std::uint64_t> checksums;
+        if (!ChunkFile::ReadFileIndex(input, header, entries, keys, checksums)) {
+            throw std::runtime_error("Invalid file index");
+        }
+
+        // Everything the index refers to. Deduplicated chunks share their
+        // data, so overlapping ranges are merged
+        struct Range
+        {
+            std::int64_t offset;
+            std::int64_t size;
+            std::int64_t newOffset;
+        };
+
+        std::vector<Range> ranges;
+        for (const auto& entry : entries) {
+            if (entry.chunkHeaderSize > 0) {
+                ranges.push_back({entry.chunkHeaderOffset, entry.chunkHeaderSize, 0});
+            }
+
+            if (entry.chunkDataSize > 0) {
+                ranges.push_back({entry.chunkDataOffset, entry.chunkDataSize, 0});
+            }
+        }
+
+        std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) -> bool {
+            return a.offset < b.offset;
+        });
+
+        std::vector<Range> mergedRanges;
+        for (const auto& range : ranges) {
+            if (!mergedRanges.empty() &&
+                range.offset <= mergedRanges.back().offset + mergedRanges.back().size) {
+                auto& last = mergedRanges.back();
+                last.size = std::max(last.size, range.offset + range.size - last.offset);
+            } else {
+                mergedRanges.push_back(range);
+            }
+        }
+
+        // Copying in place relies on nothing being stored before the data
+        if (!mergedRanges.empty() && mergedRanges.front().offset < std::int64_t(sizeof(header))) {
+            throw std::runtime_error("Invalid file index");
+        }
+
+        std::vector<unsigned char> buffer;
+        std::int64_t writeOffset = sizeof(header);
+
+        for (auto& range : mergedRanges) {
+            range.newOffset = writeOffset;
+
+            buffer.resize(static_cast<std::size_t>(std::min<std::int64_t>(range.size, 4 << 20)));
+            for (std::int64_t copied = 0; copied < range.size;) {
+                const auto n = std::min<std::int64_t>(range.size - copied, buffer.size());
+                if (input->Read(range.offset + copied, n, buffer.data()) != n) {
+                    throw std::runtime_error("Error while reading chunk data");
+                }
+
+                output->Write(range.newOffset + copied, n, buffer.data());
+                copied += n;
+            }
+
+            writeOffset += range.size;
+        }
+
+        const auto relocate = [&mergedRanges](std::int64_t& offset) -> void {
+            auto it = std::upper_bound(
+                mergedRanges.begin(),
+                mergedRanges.end(),
+                offset,
+                [](const std::int64_t value, const Range& range) -> bool {
+                    return value < range.offset;
+                });
+
+            assert(it != mergedRanges.begin());
+            --it;
+            offset = it->newOffset + (offset - it->offset);
+        };
+
+        std::map<ChunkId, int> chunkCounts;
+        for (auto& entry : entries) {
+            // Empty headers and data don't have a range to move with
+            if (entry.chunkHeaderSize > 0) {
+                relocate(entry.chunkHeaderOffset);
+            } else {
+                entry.chunkHeaderOffset = writeOffset;
+            }
+
+            if (entry.chunkDataSize > 0) {
+                relocate(entry.chunkDataOffset);
+            } else {
+                entry.chunkDataOffset = writeOffset;
+            }
+
+            chunkCounts[ChunkId(entry.chunkIdentifier)] += 1;
+        }
+
+        // Write a complete index, keeping the trailer for files which have
+        // one, so they can still be appended to incrementally
+        const std::int64_t indexSize = entries.size() * sizeof(ChunkFile::IndexEntry);
+        const bool hasKeys = (header.flags & ChunkFile::ChunkKeysFlag) != 0;
+        const bool hasChecksums = (header.flags & ChunkFile::ChunkChecksumsFlag) != 0;
+
+        if (header.flags & ChunkFile::IndexTrailerFlag) {
+            const auto counts = ChunkFile::CreateChunkCounts(chunkCounts);
+            const std::int64_t countsSize = counts.size() * sizeof(ChunkFile::ChunkCount);
+            output->Write(writeOffset, countsSize, counts.data());
+            writeOffset += countsSize;
+        }
+
+        if (hasChecksums) {
+            const auto checksumsSize = ChunkFile::GetExtensionSize(indexSize);
+            output->Write(writeOffset, checksumsSize, checksums.data());
+            writeOffset += checksumsSize;
+        }
+
+        if (hasKeys) {
+            const auto keysSize = ChunkFile::GetExtensionSize(indexSize);
+            output->Write(writeOffset, keysSize, keys.data());
+            writeOffset += keysSize;
+        }
+
+        if (header.flags & ChunkFile::IndexTrailerFlag) {
+            const auto trailer = ChunkFile::CreateIndexTrailer(
+                writeOffset,
+                indexSize,
+                0,
+                0,
+                entries.data(),
+                hasKeys ? keys.data() : nullptr,
+                hasChecksums ? checksums.data() : nullptr,
+                ChunkFile::CreateChunkCounts(chunkCounts));
+            output->Write(writeOffset + indexSize, sizeof(trailer), &trailer);
+        }
+
+        output->Write(writeOffset, indexSize, entries.data());
+
+        ::memcpy(header.identifier, ChunkFile::Identifier, sizeof(header.identifier));
+        header.version = ChunkFile::Version;
+        header.indexOffset = writeOffset;
+        header.indexSize = indexSize;
+
+        const auto fileSize = writeOffset + indexSize +
+                              ((header.flags & ChunkFile::IndexTrailerFlag)
+                                   ? std::int64_t(sizeof(ChunkFile::IndexTrailer))
+                                   : 0);
+
+        output->Flush();
+        output->Write(0, sizeof(header), &header);
+        output->Truncate(fileSize);
+        output->Flush();
+    }
 
     ///////////////////////////////////////////////////////////////////////////
     class ChunkFileWriter final
     {
     public:
-        ChunkFileWriter(std::unique_ptr<IStream>&& stream,
-            bool append)
-            : streamPointer_(std::move(stream)), stream_(streamPointer_.get())
+        struct Options
+        {
+            bool append = false;
+
+            // If non-zero, compressed chunks are stored uncompressed if the
+            // compressed size exceeds this fraction of the uncompressed size
+            float compressionThreshold = 0;
+
+            // If non-zero, and the compression threshold is set, chunks larger
+            // than this get a trial compression of their first bytes first.
+            // If that sample fails the threshold, we skip compressing the
+            // rest of the chunk and store it uncompressed right away
+            std::int64_t compressionSampleSize = 0;
+
+            // If non-zero, writes are collected in a buffer of this size
+            // and passed to the stream in one go. The buffer is flushed at
+            // the end of every chunk, so the stream is up-to-date whenever
+            // no chunk is open
+            std::int64_t writeBufferSize = 0;
+
+            // If non-zero, chunks are written asynchronously by a background
+            // thread, and this is the maximum number of bytes which may be
+            // queued before the producer has to wait
+            std::int64_t asyncMemoryLimit = 0;
+
+            // If set, chunk data which is byte-identical to the data of a
+            // chunk written earlier is not written again. The index entry
+            // points at the existing copy instead
+            bool deduplicateChunks = false;
+
+            // If greater than one, chunk data and chunk headers respectively
+            // start at multiples of this many bytes from the start of the
+            // file. Gaps are filled with zeros
+            std::int64_t dataAlignment = 0;
+            std::int64_t headerAlignment = 0;
+
+            // If non-zero, storage for this many bytes is reserved when the
+            // writer is created, and released again beyond the end of the
+            // file once it's finalized. This avoids fragmentation and fails
+            // early if the disk is too small
+            std::int64_t expectedFileSize = 0;
+
+            // If non-zero, the index is published after this many chunks,
+            // or once this many bytes have been written since the last
+            // publish, so readers can follow the file while it's being
+            // written, and a crash loses at most one interval
+            std::int64_t indexPublishInterval = 0;
+            std::int64_t indexPublishByteInterval = 0;
+
+            // If set, appending only writes an index segment for the new
+            // chunks which links to the existing index, instead of
+            // rewriting the complete index
+            bool incrementalAppend = false;
+
+            // If set, a checksum of the uncompressed data of every chunk is
+            // stored in the index
+            bool chunkChecksums = false;
+        };
+
+        ChunkFileWriter(std::unique_ptr<IStream>&& stream, const Options& options)
+            : streamPointer_(std::move(stream)), stream_(streamPointer_.get()), options_(options)
+        {
+            Construct();
+        }
+
+        ChunkFileWriter(IStream* stream, const Options& options)
+            : stream_(stream), options_(options)
         {
-            Construct(append);
+            Construct();
         }
 
-        ChunkFileWriter(IStream* stream, bool append) : stream_(stream)
+        ~ChunkFileWriter()
         {
-            Construct(append);
+            // Anything still queued at this point is discarded, as Finalize
+            // hasn't been called
+            StopWorker();
         }
 
+        ChunkFileWriter(const ChunkFileWriter&) = delete;
+        ChunkFileWriter& operator=(const ChunkFileWriter&) = delete;
+
         void BeginChunk(const char* chunkIdentifier,
                         const std::int64_t chunkHeaderSize,
                         const void* chunkHeader,
                         const Compression compression,
-                        const std::uint32_t version)
+                        const std::uint32_t version,
+                        const std::uint64_t key)
         {
-            assert(currentChunk_ == nullptr);
-
             if (chunkHeaderSize < 0) {
                 throw std::runtime_error("Chunk header size must be positive or null");
             }
 
-            ChunkFile::IndexEntry entry;
-            ::memset(&entry, 0, sizeof(entry));
-
-            // Without trailing \0, which is fine because it's memset to 0
-            ::memcpy(entry.chunkIdentifier, chunkIdentifier,
-                SafeStringLength(chunkIdentifier, RDF_IDENTIFIER_SIZE));
-
-            entry.compression = compression;
-            entry.version = version;
-
-            chunks_.push_back(entry);
-            currentChunk_ = &chunks_.back();
+            ThrowIfChunkOpenOnThisThread();
 
-            currentChunk_->chunkHeaderOffset = dataWriteOffset_;
-            assert(currentChunk_->chunkHeaderOffset >= 0);
-            if (chunkHeaderSize > 0) {
-                // TODO Check error?
-                stream_->Write(dataWriteOffset_, chunkHeaderSize, chunkHeader);
-                currentChunk_->chunkHeaderSize = chunkHeaderSize;
+            const auto entry = CreateIndexEntry(chunkIdentifier, compression, version);
 
-                // If this fails, we had an overflow in the chunk header size
-                assert(currentChunk_->chunkHeaderSize >= 0);
+            if (IsAsync()) {
+                BeginQueuedChunk(entry, key, chunkHeaderSize, chunkHeader);
+            } else {
+                BeginChunkImpl(entry, key, chunkHeaderSize, chunkHeader);
             }
-            dataWriteOffset_ += chunkHeaderSize;
 
-            currentChunk_->chunkDataOffset = dataWriteOffset_;
-            assert(currentChunk_->chunkDataOffset >= 0);
+            chunkOwner_ = std::this_thread::get_id();
         }
 
         void AppendToChunk(const std::int64_t chunkDataSize, const void* chunkData)
         {
-            assert(currentChunk_);
-
             if (chunkDataSize < 0) {
                 throw std::runtime_error("Chunk data size must be positive or null");
             }
 
-            if (currentChunk_->compression != Compression::None) {
-                chunkDataBuffer_.insert(
-                    chunkDataBuffer_.end(),
-                    static_cast<const unsigned char*>(chunkData),
-                    static_cast<const unsigned char*>(chunkData) + chunkDataSize);
+            if (IsAsync()) {
+                AppendToQueuedChunk(chunkDataSize, chunkData);
             } else {
-                if (stream_->Write(dataWriteOffset_, chunkDataSize, chunkData) != chunkDataSize) {
-                    throw std::runtime_error("Error while writing to file.");
-                }
-
-                dataWriteOffset_ += chunkDataSize;
+                AppendToChunkImpl(chunkDataSize, chunkData);
             }
         }
 
         int EndChunk()
         {
-            if (currentChunk_->compression != Compression::None) {
-                std::vector<unsigned char> buffer;
-                buffer.resize(ZSTD_compressBound(chunkDataBuffer_.size()));
+            const int index = IsAsync() ? EndQueuedChunk() : EndChunkImpl();
+            chunkOwner_ = std::thread::id();
+            return index;
+        }
 
-                const auto compressedSize = ZSTD_compress(buffer.data(),
-                                                          buffer.size(),
-                                                          chunkDataBuffer_.data(),
-                                                          chunkDataBuffer_.size(),
-                                                          ZSTD_CLEVEL_DEFAULT);
+        /**
+        Create a new chunk, given all of its (already compressed) data.
 
-                currentChunk_->chunkDataSize = compressedSize;
-                assert(currentChunk_->chunkDataSize >= 0);
-                currentChunk_->uncompressedChunkSize = chunkDataBuffer_.size();
-                assert(currentChunk_->uncompressedChunkSize >= 0);
+        This is used to commit chunks staged by ChunkWriter. Multiple threads
+        can commit concurrently. If a chunk is currently open through
+        BeginChunk, this waits until it has ended. As that would never
+        happen if the chunk was opened on the calling thread, this throws
+        instead.
+        */
+        int CommitChunk(const ChunkFile::IndexEntry& entry,
+                        const std::uint64_t key,
+                        const std::uint64_t checksum,
+                        std::vector<unsigned char>&& chunkHeader,
+                        std::vector<unsigned char>&& chunkData)
+        {
+            ThrowIfChunkOpenOnThisThread();
 
-                stream_->Write(dataWriteOffset_, compressedSize, buffer.data());
-                dataWriteOffset_ += compressedSize;
+            if (IsAsync()) {
+                return CommitQueuedChunk(
+                    entry, key, checksum, std::move(chunkHeader), std::move(chunkData));
             } else {
-                assert(currentChunk_->chunkDataOffset >= 0);
-                currentChunk_->chunkDataSize = dataWriteOffset_ - currentChunk_->chunkDataOffset;
-                assert(currentChunk_->chunkDataSize >= 0);
+                return CommitChunkImpl(entry,
+                                       key,
+                                       checksum,
+                                       chunkHeader.size(),
+                                       chunkHeader.data(),
+                                       chunkData.size(),
+                                       chunkData.data());
             }
+        }
 
-            ChunkId id(currentChunk_->chunkIdentifier);
+        /**
+        Copy a chunk from another file as-is.
 
-            int index = 0;
-            if (chunkCountPerType_.find(id) != chunkCountPerType_.end()) {
-                auto entry = chunkCountPerType_.find(id);
-                index = entry->second;
-                ++entry->second;
+        The stored header and data bytes are copied without decompressing or
+        recompressing them, and the compression, version, uncompressed size,
+        key and checksum are carried over. Waits for chunks opened by other
+        threads like CommitChunk.
+        */
+        int CopyChunk(const ChunkFile& source, const char* chunkId, const int chunkIndex)
+        {
+            ThrowIfChunkOpenOnThisThread();
+
+            const auto& sourceEntry = source.GetChunkInfo(chunkId, chunkIndex);
+            const auto key = source.GetChunkKey(chunkId, chunkIndex);
+            const auto checksum = source.GetChunkChecksum(chunkId, chunkIndex);
+
+            ChunkFile::IndexEntry entry{};
+            ::memcpy(entry.chunkIdentifier,
+                     sourceEntry.chunkIdentifier,
+                     sizeof(entry.chunkIdentifier));
+            entry.compression = sourceEntry.compression;
+            entry.version = sourceEntry.version;
+            entry.uncompressedChunkSize = sourceEntry.uncompressedChunkSize;
+
+            if (IsAsync()) {
+                std::vector<unsigned char> chunkHeader(sourceEntry.chunkHeaderSize);
+                std::vector<unsigned char> chunkData(sourceEntry.chunkDataSize);
+                source.ReadRaw(sourceEntry,
+                               sourceEntry.chunkHeaderOffset,
+                               chunkHeader.size(),
+                               chunkHeader.data());
+                source.ReadRaw(
+                    sourceEntry, sourceEntry.chunkDataOffset, chunkData.size(), chunkData.data());
+
+                return CommitQueuedChunk(
+                    entry, key, checksum, std::move(chunkHeader), std::move(chunkData));
             } else {
-                chunkCountPerType_[id] = 1;
+                return CopyChunkImpl(entry, key, checksum, source, sourceEntry);
             }
+        }
 
-            currentChunk_ = nullptr;
-            chunkDataBuffer_.clear();
+        /**
+        Make sure all data passed to the writer so far has been written to
+        the stream.
 
-            return index;
+        In asynchronous mode, this waits for the background thread to catch
+        up, and reports any error which occurred while writing.
+        */
+        void Flush()
+        {
+            if (IsAsync()) {
+                FlushQueue();
+            } else {
+                FlushImpl();
+            }
+        }
+
+        /**
+        Remove a chunk from the index. Its header and data remain in the
+        file as unused space, until the file gets compacted. Chunks with the
+        same identifier and a higher index move down by one.
+
+        The index must be rewritten completely on finalize, so this can't
+        be used while publishing the index or appending incrementally.
+        */
+        void RemoveChunk(const char* chunkIdentifier, const int chunkIndex)
+        {
+            if (IsAsync()) {
+                FlushQueue();
+
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                if (queuedChunkOpen_) {
+                    throw std::runtime_error("Chunks can't be removed while a chunk is open");
+                }
+            }
+
+            RemoveChunkImpl(ChunkId(chunkIdentifier), chunkIndex);
+
+            // The background thread is idle, so the counts are in sync
+            if (IsAsync()) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::lock_guard<std::mutex> queueLock(queueMutex_);
+                queuedChunkCountPerType_ = chunkCountPerType_;
+            }
+        }
+
+        /**
+        Checksums are computed if requested, and to keep the checksums of
+        files which have them complete.
+        */
+        bool IsComputingChecksums() const
+        {
+            return options_.chunkChecksums || (header_.flags & ChunkFile::ChunkChecksumsFlag);
+        }
+
+        /**
+        Compress size bytes of chunk data into output.
+
+        Returns the compressed size, or -1 if the data should be stored
+        uncompressed as compression doesn't meet the compression threshold.
+        This function is thread-safe, as long as output isn't shared.
+        */
+        std::int64_t CompressChunkData(const Compression compression,
+                                       const void* data,
+                                       const std::int64_t size,
+                                       std::vector<unsigned char>& output) const
+        {
+            if (SampleIsIncompressible(compression, data, size, output)) {
+                return -1;
+            }
+
+            const std::int64_t compressedSize = Compress(compression, data, size, output);
+
+            if (!PassesCompressionThreshold(compressedSize, size)) {
+                return -1;
+            }
+
+            return compressedSize;
+        }
+
+        bool HasOpenChunkWriters()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return openChunkWriters_ > 0;
+        }
+
+        void NotifyChunkWriterOpened()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++openChunkWriters_;
+        }
+
+        void NotifyChunkWriterClosed()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            assert(openChunkWriters_ > 0);
+            --openChunkWriters_;
+        }
+
+        /**
+        Create an index entry for a new chunk, without offsets and sizes.
+        */
+        static ChunkFile::IndexEntry CreateIndexEntry(const char* chunkIdentifier,
+                                                      const Compression compression,
+                                                      const std::uint32_t version)
+        {
+            if (compression != Compression::None && compression != Compression::Zstd &&
+                compression != Compression::Lz4) {
+                throw std::runtime_error("Unsupported compression algorithm");
+            }
+
+            ChunkFile::IndexEntry entry{};
+
+            // Without trailing \0, which is fine because it's zero-initialized
+            ::memcpy(entry.chunkIdentifier, chunkIdentifier,
+                SafeStringLength(chunkIdentifier, RDF_IDENTIFIER_SIZE));
+
+            entry.compression = compression;
+            entry.version = version;
+
+            return entry;
         }
 
         int WriteChunk(const char* chunkIdentifier,
@@ -715,9 +2229,10 @@ namespace internal
                        const std::int64_t chunkDataSize,
                        const void* chunkData,
                        const Compression compression,
-                       const std::uint32_t version)
+                       const std::uint32_t version,
+                       const std::uint64_t key)
         {
-            BeginChunk(chunkIdentifier, chunkHeaderSize, chunkHeader, compression, version);
+            BeginChunk(chunkIdentifier, chunkHeaderSize, chunkHeader, compression, version, key);
             AppendToChunk(chunkDataSize, chunkData);
             return EndChunk();
         }
@@ -730,554 +2245,3815 @@ namespace internal
         */
         void Finalize()
         {
+            if (IsAsync()) {
+                FlushQueue();
+                StopWorker();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
             assert(stream_);
-            stream_->Write(dataWriteOffset_, chunks_.size() * sizeof(ChunkFile::IndexEntry), chunks_.data());
-            
-            header_.indexOffset = dataWriteOffset_;
-            header_.indexSize = chunks_.size() * sizeof(ChunkFile::IndexEntry);
+
+            if (openChunkWriters_ > 0) {
+                throw std::runtime_error("All chunk writers must be closed before finalizing");
+            }
+
+            if (incrementalIndex_) {
+                WriteIndexSegment();
+            } else {
+                WriteIndex();
+            }
+
+            // Release whatever we reserved but didn't use
+            if (options_.expectedFileSize > 0) {
+                stream_->Truncate(dataWriteOffset_);
+            }
 
             // TODO Check error?
-            stream_->Write(0, sizeof(header_), &header_);
+            WriteHeader();
 
             stream_ = nullptr;
         }
 
     private:
-        void Construct(bool append)
+        void ThrowIfChunkOpenOnThisThread() const
         {
-            if (!stream_->CanWrite()) {
-                throw std::runtime_error("Stream must allow for write access");
-            }
-
-            if (append && !stream_->CanRead()) {
-                throw std::runtime_error("Appending requires a stream with read access");
+            if (chunkOwner_ == std::this_thread::get_id()) {
+                throw std::runtime_error("A chunk is currently open on this thread");
             }
+        }
 
-            ::memset(&header_, 0, sizeof(header_));
-
-            if (append) {
-                // Try to read the current header, check if it's a supported
-                // version, then read in the index
-                stream_->Read(0, sizeof(header_), &header_);
+        void BeginChunkImpl(const ChunkFile::IndexEntry& entry,
+                            const std::uint64_t key,
+                            const std::int64_t chunkHeaderSize,
+                            const void* chunkHeader)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
 
-                if (::memcmp(header_.identifier,
-                             ChunkFile::Identifier,
-                             sizeof(ChunkFile::Identifier)) != 0) {
-                    throw std::runtime_error("Unsupported file type");
-                }
+            assert(currentChunk_ == nullptr);
 
-                if (header_.version != ChunkFile::Version) {
-                    throw std::runtime_error("Unsupported file version");
-                }
+            chunks_.push_back(entry);
+            chunkKeys_.push_back(key);
+            chunkChecksums_.push_back(0);
+            currentChunk_ = &chunks_.back();
+            currentChunkChecksum_.Reset();
 
-                chunks_.resize(header_.indexSize / sizeof(ChunkFile::IndexEntry));
-                stream_->Read(header_.indexOffset, header_.indexSize, chunks_.data());
+            if (chunkHeaderSize > 0) {
+                PadToAlignment(options_.headerAlignment);
+            }
 
-                // Initialize the counts so the returned index is correct
-                for (const auto& chunk : chunks_) {
-                    ChunkId id (chunk.chunkIdentifier);
-                    chunkCountPerType_[id] += 1;
-                }
+            currentChunk_->chunkHeaderOffset = dataWriteOffset_;
+            assert(currentChunk_->chunkHeaderOffset >= 0);
+            if (chunkHeaderSize > 0) {
+                WriteData(chunkHeaderSize, chunkHeader);
+                currentChunk_->chunkHeaderSize = chunkHeaderSize;
 
-                dataWriteOffset_ = header_.indexOffset;
-            } else {
-                header_.version = ChunkFile::Version;
-                ::memcpy(header_.identifier, ChunkFile::Identifier, sizeof(ChunkFile::Identifier));
+                // If this fails, we had an overflow in the chunk header size
+                assert(currentChunk_->chunkHeaderSize >= 0);
+            }
 
-                stream_->Write(0, sizeof(header_), &header_);
-                dataWriteOffset_ = sizeof(header_);
+            // Data which gets buffered until the chunk ends is aligned once
+            // it's written
+            if (currentChunk_->compression == Compression::None && !options_.deduplicateChunks) {
+                PadToAlignment(options_.dataAlignment);
             }
+
+            currentChunk_->chunkDataOffset = dataWriteOffset_;
+            assert(currentChunk_->chunkDataOffset >= 0);
         }
 
-        std::vector<ChunkFile::IndexEntry> chunks_;
-        std::vector<unsigned char> chunkDataBuffer_;
+        void AppendToChunkImpl(const std::int64_t chunkDataSize, const void* chunkData)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
 
-        std::map<ChunkId, int> chunkCountPerType_;
+            assert(currentChunk_);
 
-        ChunkFile::IndexEntry* currentChunk_ = nullptr;
-        ChunkFile::Header header_;
-        std::unique_ptr<IStream> streamPointer_;
-        IStream* stream_ = nullptr;
+            if (IsComputingChecksums()) {
+                currentChunkChecksum_.Update(chunkData, chunkDataSize);
+            }
 
-        std::int64_t dataWriteOffset_ = 0;
-    };
+            // Deduplication needs the complete data before writing anything
+            if (currentChunk_->compression != Compression::None || options_.deduplicateChunks) {
+                chunkDataBuffer_.insert(
+                    chunkDataBuffer_.end(),
+                    static_cast<const unsigned char*>(chunkData),
+                    static_cast<const unsigned char*>(chunkData) + chunkDataSize);
+            } else {
+                WriteData(chunkDataSize, chunkData);
+            }
+        }
 
-    //////////////////////////////////////////////////////////////////////
-    IStream::~IStream() {}
+        int EndChunkImpl()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
 
-    //////////////////////////////////////////////////////////////////////
-    std::int64_t IStream::Read(const std::int64_t offset,
-        const std::int64_t size, void* buffer)
-    {
-        if (size > 0 && buffer == nullptr) {
-            throw std::runtime_error("Buffer cannot be null");
-        }
+            if (currentChunk_->compression != Compression::None) {
+                const std::int64_t uncompressedSize = chunkDataBuffer_.size();
+                const std::int64_t compressedSize = CompressChunkData(currentChunk_->compression,
+                                                                      chunkDataBuffer_.data(),
+                                                                      uncompressedSize,
+                                                                      compressedDataBuffer_);
+
+                if (compressedSize >= 0) {
+                    currentChunk_->uncompressedChunkSize = uncompressedSize;
+                    assert(currentChunk_->uncompressedChunkSize >= 0);
+
+                    WriteChunkData(*currentChunk_, compressedSize, compressedDataBuffer_.data());
+                } else {
+                    // Compression doesn't pay off for this chunk, so store it
+                    // as-is and spare readers from decompressing it
+                    currentChunk_->compression = Compression::None;
+                    currentChunk_->uncompressedChunkSize = 0;
+
+                    WriteChunkData(*currentChunk_, uncompressedSize, chunkDataBuffer_.data());
+                }
+            } else if (options_.deduplicateChunks) {
+                WriteChunkData(*currentChunk_, chunkDataBuffer_.size(), chunkDataBuffer_.data());
+            } else {
+                assert(currentChunk_->chunkDataOffset >= 0);
+                currentChunk_->chunkDataSize = dataWriteOffset_ - currentChunk_->chunkDataOffset;
+                assert(currentChunk_->chunkDataSize >= 0);
+            }
 
-        if (size < 0) {
-            throw std::runtime_error("Size must be >= 0");
-        }
+            if (IsComputingChecksums()) {
+                chunkChecksums_[currentChunk_ - chunks_.data()] = currentChunkChecksum_.Digest();
+            }
 
-        if (offset < 0) {
-            throw std::runtime_error("Offset must be >= 0");
-        }
+            const int index =
+                AssignChunkIndex(chunkCountPerType_, ChunkId(currentChunk_->chunkIdentifier));
 
-        assert(CheckIsInSystemSizeRange(size));
+            currentChunk_ = nullptr;
+            chunkDataBuffer_.clear();
 
-        return ReadImpl(offset, size, buffer);
-    }
+            FlushWriteBuffer();
+            OnChunkEnded();
 
-    //////////////////////////////////////////////////////////////////////
-    std::int64_t IStream::Write(const std::int64_t offset,
-        const std::int64_t size, const void* buffer)
-    {
-        if (size > 0 && buffer == nullptr) {
-            throw std::runtime_error("Buffer cannot be null");
-        }
+            // Chunk writers may be waiting for this chunk to finish
+            lock.unlock();
+            chunkEnded_.notify_all();
 
-        if (size < 0) {
-            throw std::runtime_error("Size must be >= 0");
+            return index;
         }
 
-        if (offset < 0) {
-            throw std::runtime_error("Offset must be >= 0");
-        }
+        int CommitChunkImpl(const ChunkFile::IndexEntry& entry,
+                        const std::uint64_t key,
+                        const std::uint64_t checksum,
+                        const std::int64_t chunkHeaderSize,
+                        const void* chunkHeader,
+                        const std::int64_t chunkDataSize,
+                        const void* chunkData)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            chunkEnded_.wait(lock, [this]() -> bool { return currentChunk_ == nullptr; });
 
-        assert(CheckIsInSystemSizeRange(size));
+            if (stream_ == nullptr) {
+                throw std::runtime_error("Chunk file writer has been finalized already");
+            }
 
-        return WriteImpl(offset, size, buffer);
-    }
+            chunks_.push_back(entry);
+            chunkKeys_.push_back(key);
+            chunkChecksums_.push_back(checksum);
+            auto& chunk = chunks_.back();
 
-    //////////////////////////////////////////////////////////////////////
-    void IStream::Close()
-    {
-        CloseImpl();
-    }
-    
-    //////////////////////////////////////////////////////////////////////
-    bool IStream::CanRead() const
-    {
-        return CanReadImpl();
-    }
+            if (chunkHeaderSize > 0) {
+                PadToAlignment(options_.headerAlignment);
+            }
 
-    //////////////////////////////////////////////////////////////////////
-    bool IStream::CanWrite() const
-    {
-        return CanWriteImpl();
-    }
+            chunk.chunkHeaderOffset = dataWriteOffset_;
+            chunk.chunkHeaderSize = chunkHeaderSize;
+            WriteData(chunkHeaderSize, chunkHeader);
 
-    //////////////////////////////////////////////////////////////////////
-    std::int64_t IStream::GetSize() const
-    {
-        return GetSizeImpl();
-    }
+            WriteChunkData(chunk, chunkDataSize, chunkData);
 
-    //////////////////////////////////////////////////////////////////////
-    class Filestream final : public IStream
-    {
-    public:
-        Filestream(std::FILE* fd, rdfStreamAccess accessMode) : fd_(fd), accessMode_(accessMode) {}
+            FlushWriteBuffer();
 
-    private:
-        std::int64_t ReadImpl(const std::int64_t offset,
-            const std::int64_t count, void* buffer) override
-        {
-            Seek(offset);
-            return std::fread(buffer, 1, count, fd_);
-        }
+            const int index = AssignChunkIndex(chunkCountPerType_, ChunkId(chunk.chunkIdentifier));
+            OnChunkEnded();
 
-        std::int64_t WriteImpl(const std::int64_t offset,
-            const std::int64_t count, const void* buffer) override
-        {
-            Seek(offset);
-            return std::fwrite(buffer, 1, count, fd_);
+            return index;
         }
 
-        void Seek(const std::int64_t offset)
+        int CopyChunkImpl(const ChunkFile::IndexEntry& entry,
+                          const std::uint64_t key,
+                          const std::uint64_t checksum,
+                          const ChunkFile& source,
+                          const ChunkFile::IndexEntry& sourceEntry)
         {
-#if RDF_PLATFORM_WINDOWS
-            _fseeki64(fd_, offset, SEEK_SET);
-#elif RDF_PLATFORM_UNIX
-            // Linux fseek is a long, so 64-bit
-            fseek(fd_, offset, SEEK_SET);
-#else
-#error "Unsupported platform"
-#endif
+            std::unique_lock<std::mutex> lock(mutex_);
+            chunkEnded_.wait(lock, [this]() -> bool { return currentChunk_ == nullptr; });
+
+            if (stream_ == nullptr) {
+                throw std::runtime_error("Chunk file writer has been finalized already");
+            }
+
+            chunks_.push_back(entry);
+            chunkKeys_.push_back(key);
+            chunkChecksums_.push_back(checksum);
+
+            // Copy through a fixed-size buffer, so large chunks don't have to
+            // be held in memory completely
+            const auto copy = [this, &source, &sourceEntry](std::int64_t offset,
+                                                            std::int64_t size) -> void {
+                const std::int64_t blockSize = 4 << 20;
+                copyBuffer_.resize(std::min(size, blockSize));
+
+                while (size > 0) {
+                    const auto count = std::min(size, blockSize);
+                    source.ReadRaw(sourceEntry, offset, count, copyBuffer_.data());
+                    WriteData(count, copyBuffer_.data());
+
+                    offset += count;
+                    size -= count;
+                }
+            };
+
+            if (sourceEntry.chunkHeaderSize > 0) {
+                PadToAlignment(options_.headerAlignment);
+            }
+
+            chunks_.back().chunkHeaderOffset = dataWriteOffset_;
+            chunks_.back().chunkHeaderSize = sourceEntry.chunkHeaderSize;
+            copy(sourceEntry.chunkHeaderOffset, sourceEntry.chunkHeaderSize);
+
+            chunks_.back().chunkDataSize = sourceEntry.chunkDataSize;
+
+            if (options_.deduplicateChunks && sourceEntry.chunkDataSize > 0) {
+                // Hash the source data first, so a duplicate doesn't have to
+                // be written at all
+                const auto readSource = [&source, &sourceEntry](const std::int64_t offset,
+                                                                const std::int64_t size,
+                                                                void* buffer) -> void {
+                    source.ReadRaw(sourceEntry, sourceEntry.chunkDataOffset + offset, size, buffer);
+                };
+
+                StreamingXXH64 hash;
+                const std::int64_t blockSize = 4 << 20;
+                copyBuffer_.resize(std::min(sourceEntry.chunkDataSize, blockSize));
+                for (std::int64_t offset = 0; offset < sourceEntry.chunkDataSize;
+                     offset += blockSize) {
+                    const auto count = std::min(sourceEntry.chunkDataSize - offset, blockSize);
+                    readSource(offset, count, copyBuffer_.data());
+                    hash.Update(copyBuffer_.data(), count);
+                }
+
+                if (!ReuseStoredData(chunks_.back(), hash.Digest(), readSource)) {
+                    PadToAlignment(options_.dataAlignment);
+                    chunks_.back().chunkDataOffset = dataWriteOffset_;
+                    copy(sourceEntry.chunkDataOffset, sourceEntry.chunkDataSize);
+                    AddStoredData(chunks_.back(), hash.Digest());
+                }
+            } else {
+                if (sourceEntry.chunkDataSize > 0) {
+                    PadToAlignment(options_.dataAlignment);
+                }
+
+                chunks_.back().chunkDataOffset = dataWriteOffset_;
+                copy(sourceEntry.chunkDataOffset, sourceEntry.chunkDataSize);
+            }
+
+            FlushWriteBuffer();
+
+            const int index = AssignChunkIndex(chunkCountPerType_, ChunkId(entry.chunkIdentifier));
+            OnChunkEnded();
+
+            return index;
         }
 
-        bool CanWriteImpl() const override
+        void RemoveChunkImpl(const ChunkId& id, const int chunkIndex)
         {
-            return accessMode_ == rdfStreamAccessReadWrite;
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (stream_ == nullptr) {
+                throw std::runtime_error("Chunk file writer has been finalized already");
+            }
+
+            if (currentChunk_ || openChunkWriters_ > 0) {
+                throw std::runtime_error("Chunks can't be removed while a chunk is open");
+            }
+
+            if (IsPublishingIndex() || incrementalIndex_) {
+                throw std::runtime_error("Removing chunks requires rewriting the complete index");
+            }
+
+            int index = 0;
+            for (auto it = chunks_.begin(); it != chunks_.end(); ++it) {
+                if (ChunkId(it->chunkIdentifier) == id && index++ == chunkIndex) {
+                    chunkKeys_.erase(chunkKeys_.begin() + (it - chunks_.begin()));
+                    chunkChecksums_.erase(chunkChecksums_.begin() + (it - chunks_.begin()));
+                    chunks_.erase(it);
+
+                    if (--chunkCountPerType_[id] == 0) {
+                        chunkCountPerType_.erase(id);
+                    }
+
+                    return;
+                }
+            }
+
+            throw std::runtime_error("Chunk not found");
         }
 
-        bool CanReadImpl() const override
+        void FlushImpl()
         {
-            return true;
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (stream_ == nullptr) {
+                throw std::runtime_error("Chunk file writer has been finalized already");
+            }
+
+            FlushWriteBuffer();
         }
 
-        std::int64_t GetSizeImpl() const override
+        /**
+        Write the index of all chunks at the write offset, followed by the
+        index trailer if the file has one. The chunk keys are stored in
+        front of the index if any chunk has one, or if the file has a
+        trailer, so later segments can add keys. The chunk checksums, if
+        enabled, are stored in front of the keys.
+        */
+        void WriteIndex()
         {
-#if RDF_PLATFORM_WINDOWS
-            struct _stat64 statBuffer;
-            _fstat64(_fileno(fd_), &statBuffer);
-            return statBuffer.st_size;
-#elif RDF_PLATFORM_UNIX
-            struct stat statBuffer;
-            fstat(fileno(fd_), &statBuffer);
-            return statBuffer.st_size;
-#else
-#error "Unsupported platform"
-#endif
-        }
+            header_.version = ChunkFile::Version;
+            header_.indexSize = chunks_.size() * sizeof(ChunkFile::IndexEntry);
 
-        void CloseImpl() override
-        { 
-            std::fclose(fd_);
-            fd_ = nullptr;
-        }
+            if (IsComputingChecksums()) {
+                header_.flags |= ChunkFile::ChunkChecksumsFlag;
+            }
 
-        std::FILE* fd_;
-        rdfStreamAccess accessMode_;
-    };
+            if ((header_.flags & ChunkFile::IndexTrailerFlag) ||
+                std::any_of(chunkKeys_.begin(), chunkKeys_.end(), [](const std::uint64_t key) {
+                    return key != 0;
+                })) {
+                header_.flags |= ChunkFile::ChunkKeysFlag;
+            }
 
-    //////////////////////////////////////////////////////////////////////
-    /**
-    TODO Not supported on 32-bit platforms as it cannot handle buffers
-         >= 2^32 bit there
-    */
-    class ReadOnlyMemoryStream final : public IStream
-    {
-    public:
-        ReadOnlyMemoryStream(const std::int64_t size, const void* buffer)
-            : size_(size), buffer_(buffer)
-        {
-            assert(size >= 0);
+            std::vector<ChunkFile::ChunkCount> chunkCounts;
+            if (header_.flags & ChunkFile::IndexTrailerFlag) {
+                chunkCounts = WriteChunkCounts();
+            }
+
+            if (header_.flags & ChunkFile::ChunkChecksumsFlag) {
+                WriteData(ChunkFile::GetExtensionSize(header_.indexSize), chunkChecksums_.data());
+            }
+
+            if (header_.flags & ChunkFile::ChunkKeysFlag) {
+                WriteData(ChunkFile::GetExtensionSize(header_.indexSize), chunkKeys_.data());
+            }
+
+            header_.indexOffset = dataWriteOffset_;
+            WriteData(header_.indexSize, chunks_.data());
+
+            if (header_.flags & ChunkFile::IndexTrailerFlag) {
+                const auto trailer =
+                    ChunkFile::CreateIndexTrailer(header_.indexOffset,
+                                                  header_.indexSize,
+                                                  0,
+                                                  0,
+                                                  chunks_.data(),
+                                                  (header_.flags & ChunkFile::ChunkKeysFlag)
+                                                      ? chunkKeys_.data()
+                                                      : nullptr,
+                                                  (header_.flags & ChunkFile::ChunkChecksumsFlag)
+                                                      ? chunkChecksums_.data()
+                                                      : nullptr,
+                                                  chunkCounts);
+                WriteData(sizeof(trailer), &trailer);
+            }
+
+            FlushWriteBuffer();
         }
 
-    private:
-        std::int64_t ReadImpl(const std::int64_t offset,
-            const std::int64_t count, void* buffer) override
+        /**
+        Write the index entries of all chunks added since the last segment,
+        followed by a trailer linking to that segment. This keeps the cost
+        of publishing proportional to the number of new chunks.
+        */
+        void WriteIndexSegment()
         {
-            if (offset > size_) {
-                throw std::runtime_error("Read offset is out of bounds");
+            const auto* entries = chunks_.data() + publishedChunkCount_;
+            const std::int64_t size =
+                (chunks_.size() - publishedChunkCount_) * sizeof(ChunkFile::IndexEntry);
+
+            const auto chunkCounts = WriteChunkCounts();
+
+            // All segments of a file either have checksums and keys or not
+            const std::uint64_t* checksums = nullptr;
+            if (header_.flags & ChunkFile::ChunkChecksumsFlag) {
+                checksums = chunkChecksums_.data() + publishedChunkCount_;
+                WriteData(ChunkFile::GetExtensionSize(size), checksums);
             }
 
-            auto bytesToRead = std::max(std::int64_t(0),
-                std::min(size_ - offset, count));
-            ::memcpy(buffer,
-                static_cast<const unsigned char*>(buffer_) + offset,
-                bytesToRead);
+            const std::uint64_t* keys = nullptr;
+            if (header_.flags & ChunkFile::ChunkKeysFlag) {
+                keys = chunkKeys_.data() + publishedChunkCount_;
+                WriteData(ChunkFile::GetExtensionSize(size), keys);
+            }
 
-            return bytesToRead;
+            const auto trailer = ChunkFile::CreateIndexTrailer(dataWriteOffset_,
+                                                               size,
+                                                               header_.indexOffset,
+                                                               header_.indexSize,
+                                                               entries,
+                                                               keys,
+                                                               checksums,
+                                                               chunkCounts);
+
+            // The first segment is a complete index on its own
+            if (header_.indexOffset != 0) {
+                header_.version = ChunkFile::SegmentedVersion;
+            }
+
+            header_.indexOffset = dataWriteOffset_;
+            header_.indexSize = size;
+
+            WriteData(size, entries);
+            WriteData(sizeof(trailer), &trailer);
+            FlushWriteBuffer();
+
+            publishedChunkCount_ = chunks_.size();
+            publishedDataOffset_ = dataWriteOffset_;
         }
 
-        std::int64_t WriteImpl(const std::int64_t offset,
-            const std::int64_t count, const void* buffer) override
+        /**
+        Write the number of chunks per identifier, which precedes the index
+        in files with an index trailer.
+        */
+        std::vector<ChunkFile::ChunkCount> WriteChunkCounts()
         {
-            (void)offset;
-            (void)count;
-            (void)buffer;
-            assert(false);
-            return 0;
+            const auto chunkCounts = ChunkFile::CreateChunkCounts(chunkCountPerType_);
+            WriteData(chunkCounts.size() * sizeof(ChunkFile::ChunkCount), chunkCounts.data());
+
+            return chunkCounts;
         }
 
-        std::int64_t GetSizeImpl() const override
+        /**
+        Point the header at the index written last. Readers of the file must
+        see the complete index before they see the header, so the stream is
+        flushed before and after.
+        */
+        void WriteHeader()
         {
-            return size_;
+            stream_->Flush();
+            stream_->Write(0, sizeof(header_), &header_);
+            stream_->Flush();
         }
 
-        bool CanWriteImpl() const override
+        /**
+        Called whenever a chunk has been written completely.
+        */
+        void OnChunkEnded()
         {
-            return false;
+            ++chunksSincePublish_;
+
+            const bool publish =
+                (options_.indexPublishInterval > 0 &&
+                 chunksSincePublish_ >= options_.indexPublishInterval) ||
+                (options_.indexPublishByteInterval > 0 &&
+                 dataWriteOffset_ - publishedDataOffset_ >= options_.indexPublishByteInterval);
+
+            if (publish) {
+                // No chunk is open at this point, so the segments cover all
+                // chunks written so far, and the next chunk starts after
+                // them. Readers may still be using the previous segment,
+                // which is why it isn't overwritten
+                WriteIndexSegment();
+                WriteHeader();
+                chunksSincePublish_ = 0;
+            }
         }
 
-        bool CanReadImpl() const override
+        bool IsPublishingIndex() const
         {
-            return true;
+            return options_.indexPublishInterval > 0 || options_.indexPublishByteInterval > 0;
         }
 
-        void CloseImpl() override
+        /**
+        Location of chunk data written earlier, for deduplication.
+        */
+        struct StoredData
         {
-            buffer_ = nullptr;
-            size_ = 0;
-            readPointer_ = 0;
-        }
+            std::int64_t offset;
+            std::int64_t size;
+            Compression compression;
+            std::int64_t uncompressedSize;
+        };
 
-        std::int64_t size_;
-        std::size_t readPointer_ = 0;
-        const void* buffer_;
-    };
+        /**
+        Store the data of a chunk and set its data offset and size.
 
-    //////////////////////////////////////////////////////////////////////
-    /**
-    Limited to 4 GiB on 32-bit platforms.
-    */
-    class MemoryStream final : public IStream
-    {
-    private:
-        std::int64_t ReadImpl(const std::int64_t offset,
-            const std::int64_t count, void* buffer) override
+        With deduplication enabled, data matching an earlier chunk isn't
+        written again, and the chunk points at the earlier copy instead.
+        */
+        void WriteChunkData(ChunkFile::IndexEntry& chunk,
+                            const std::int64_t size,
+                            const void* data)
         {
-            auto bytesToRead = std::max(std::int64_t(0), std::min(
-                static_cast<std::int64_t>(data_.size()) - offset, count));
+            chunk.chunkDataSize = size;
+            assert(chunk.chunkDataSize >= 0);
 
-            ::memcpy(buffer, data_.data() + offset, bytesToRead);
-            return bytesToRead;
+            if (!options_.deduplicateChunks || size == 0) {
+                if (size > 0) {
+                    PadToAlignment(options_.dataAlignment);
+                }
+
+                chunk.chunkDataOffset = dataWriteOffset_;
+                WriteData(size, data);
+                return;
+            }
+
+            const auto hash = StreamingXXH64::Hash(data, size);
+            const auto readData =
+                [data](const std::int64_t offset, const std::int64_t count, void* buffer) -> void {
+                ::memcpy(buffer, static_cast<const unsigned char*>(data) + offset, count);
+            };
+
+            if (!ReuseStoredData(chunk, hash, readData)) {
+                PadToAlignment(options_.dataAlignment);
+                chunk.chunkDataOffset = dataWriteOffset_;
+                WriteData(size, data);
+                AddStoredData(chunk, hash);
+            }
         }
 
-        std::int64_t WriteImpl(const std::int64_t offset,
-            const std::int64_t count, const void* buffer) override
+        /**
+        Look for data written earlier which matches the data of chunk. If
+        found, point chunk at it and return true.
+
+        readData(offset, size, buffer) must provide the chunk data, which is
+        compared byte by byte against each candidate with a matching hash,
+        size and compression.
+        */
+        template <typename ReadFunction>
+        bool ReuseStoredData(ChunkFile::IndexEntry& chunk,
+                             const std::uint64_t hash,
+                             const ReadFunction& readData)
         {
-            const auto end = offset + count;
+            const auto candidates = storedData_.equal_range(hash);
 
-            if (end > static_cast<int64_t>(data_.size())) {
-                data_.resize(end);
+            for (auto it = candidates.first; it != candidates.second; ++it) {
+                const auto& stored = it->second;
+
+                if (stored.size != chunk.chunkDataSize || stored.compression != chunk.compression ||
+                    stored.uncompressedSize != chunk.uncompressedChunkSize) {
+                    continue;
+                }
+
+                if (!StoredDataEquals(stored, readData)) {
+                    continue;
+                }
+
+                chunk.chunkDataOffset = stored.offset;
+                return true;
             }
 
-            ::memcpy(data_.data() + offset, buffer, count);
-            return count;
+            return false;
         }
 
-        std::int64_t GetSizeImpl() const override
+        template <typename ReadFunction>
+        bool StoredDataEquals(const StoredData& stored, const ReadFunction& readData)
         {
-            return data_.size();
+            // The stored data may still be sitting in the write buffer
+            FlushWriteBuffer();
+
+            const std::int64_t blockSize = 1 << 20;
+            copyBuffer_.resize(std::min(stored.size, blockSize));
+            compareBuffer_.resize(copyBuffer_.size());
+
+            for (std::int64_t offset = 0; offset < stored.size; offset += blockSize) {
+                const auto count = std::min(stored.size - offset, blockSize);
+
+                if (stream_->Read(stored.offset + offset, count, copyBuffer_.data()) != count) {
+                    throw std::runtime_error("Error while reading back chunk data");
+                }
+
+                readData(offset, count, compareBuffer_.data());
+
+                if (::memcmp(copyBuffer_.data(), compareBuffer_.data(), count) != 0) {
+                    return false;
+                }
+            }
+
+            return true;
         }
 
-        bool CanWriteImpl() const override
+        void AddStoredData(const ChunkFile::IndexEntry& chunk, const std::uint64_t hash)
         {
-            return true;
+            StoredData stored;
+            stored.offset = chunk.chunkDataOffset;
+            stored.size = chunk.chunkDataSize;
+            stored.compression = chunk.compression;
+            stored.uncompressedSize = chunk.uncompressedChunkSize;
+
+            storedData_.emplace(hash, stored);
         }
 
-        bool CanReadImpl() const override
+        /**
+        Write size bytes at the current write offset and advance it.
+
+        Small writes get collected in the write buffer if enabled. Writes
+        which don't fit into the buffer go straight to the stream after
+        flushing what is pending, so the stream sees all data in order.
+        */
+        void WriteData(const std::int64_t size, const void* data)
         {
-            return true;
+            if (size == 0) {
+                return;
+            }
+
+            const std::int64_t pendingSize = writeBuffer_.size();
+
+            if (pendingSize + size <= options_.writeBufferSize) {
+                writeBuffer_.insert(writeBuffer_.end(),
+                                    static_cast<const unsigned char*>(data),
+                                    static_cast<const unsigned char*>(data) + size);
+            } else {
+                FlushWriteBuffer();
+
+                if (size < options_.writeBufferSize) {
+                    writeBuffer_.assign(static_cast<const unsigned char*>(data),
+                                        static_cast<const unsigned char*>(data) + size);
+                } else if (stream_->Write(dataWriteOffset_, size, data) != size) {
+                    throw std::runtime_error("Error while writing to file.");
+                }
+            }
+
+            dataWriteOffset_ += size;
         }
 
-        void CloseImpl() override
-        { 
-            data_.clear();
+        /**
+        Write zeros until the write offset is a multiple of alignment.
+        */
+        void PadToAlignment(const std::int64_t alignment)
+        {
+            if (alignment <= 1) {
+                return;
+            }
+
+            static const unsigned char zeros[4096] = {};
+
+            std::int64_t padding = (alignment - dataWriteOffset_ % alignment) % alignment;
+            while (padding > 0) {
+                const auto count = std::min<std::int64_t>(padding, sizeof(zeros));
+                WriteData(count, zeros);
+                padding -= count;
+            }
         }
 
-        std::vector<unsigned char> data_;
-    };
+        /**
+        Pass all buffered data to the stream.
+        */
+        void FlushWriteBuffer()
+        {
+            if (writeBuffer_.empty()) {
+                return;
+            }
 
-    //////////////////////////////////////////////////////////////////////
-    std::unique_ptr<IStream> CreateReadOnlyMemoryStream(const std::int64_t size, const void* buffer)
-    {
-        return rdf_make_unique<ReadOnlyMemoryStream>(size, buffer);
-    }
+            const std::int64_t size = writeBuffer_.size();
+            const std::int64_t offset = dataWriteOffset_ - size;
 
-    //////////////////////////////////////////////////////////////////////
-    std::unique_ptr<IStream> CreateMemoryStream()
-    {
-        return rdf_make_unique<MemoryStream>();
-    }
+            if (stream_->Write(offset, size, writeBuffer_.data()) != size) {
+                throw std::runtime_error("Error while writing to file.");
+            }
 
-    //////////////////////////////////////////////////////////////////////
-    std::unique_ptr<IStream> OpenSharedFile(const char* filename,
-                                            rdfStreamAccess accessMode,
-                                            rdfFileMode fileMode)
-    {
-#if RDF_PLATFORM_WINDOWS
-        const char* mode = nullptr;
+            writeBuffer_.clear();
+        }
 
-        // For a shareable file on Windows, the file needs to be opened with the CreateFile() function.
-        unsigned long desired_access = 0;
-        unsigned long share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE;
-        unsigned long creation_disposition = 0;
-        unsigned long flags_and_attributes = FILE_ATTRIBUTE_NORMAL;
+        /**
+        Compress size bytes from data into output.
 
-        if (accessMode == rdfStreamAccess::rdfStreamAccessRead) {
-            desired_access |= GENERIC_READ;
-            if (fileMode == rdfFileModeOpen) {
-                creation_disposition = OPEN_EXISTING;
-                mode = "rb";
-            } else if (fileMode == rdfFileModeCreate) {
-                throw std::runtime_error("Cannot create file in read-only mode");
+        The output buffer will be resized as needed, returns the compressed
+        size.
+        */
+        static std::int64_t Compress(const Compression compression,
+                                     const void* data,
+                                     const std::int64_t size,
+                                     std::vector<unsigned char>& output)
+        {
+            if (compression == Compression::Lz4) {
+                output.resize(lz4frame::CompressBound(size));
+                return lz4frame::Compress(data, size, output.data());
+            } else {
+                assert(compression == Compression::Zstd);
+                output.resize(ZSTD_compressBound(size));
+                return ZSTD_compress(output.data(), output.size(), data, size, ZSTD_CLEVEL_DEFAULT);
             }
-        } else if (accessMode == rdfStreamAccess::rdfStreamAccessReadWrite) {
-            desired_access |= GENERIC_READ | GENERIC_WRITE;
-            if (fileMode == rdfFileModeOpen) {
-                creation_disposition = OPEN_EXISTING;
-                mode = "r+b";
-            } else if (fileMode == rdfFileModeCreate) {
-                creation_disposition = OPEN_EXISTING;
-                mode = "w+b";
+        }
+
+        bool PassesCompressionThreshold(const std::int64_t compressedSize,
+                                        const std::int64_t uncompressedSize) const
+        {
+            if (options_.compressionThreshold <= 0) {
+                return true;
             }
-        } else {
-            assert(false);
+
+            return static_cast<double>(compressedSize) <=
+                   static_cast<double>(uncompressedSize) * options_.compressionThreshold;
         }
 
-        HANDLE object_handle = ::CreateFile(filename,
-                                            desired_access,
-                                            share_mode,
-                                            NULL,
-                                            creation_disposition,
-                                            flags_and_attributes,
-                                            NULL);
+        /**
+        Check if a trial compression of the start of the data fails the
+        compression threshold. Returns false if sampling is disabled, or if
+        the data is small enough to be compressed fully right away.
+        */
+        bool SampleIsIncompressible(const Compression compression,
+                                    const void* data,
+                                    const std::int64_t size,
+                                    std::vector<unsigned char>& output) const
+        {
+            if (options_.compressionThreshold <= 0 || options_.compressionSampleSize <= 0) {
+                return false;
+            }
 
-        // Convert the object handle to a file descriptor.
-        int file_handle = _open_osfhandle((intptr_t)object_handle, _O_BINARY);
-        auto fd = _fdopen(file_handle, mode);
-        if (fd == nullptr) {
-            CloseHandle(object_handle);
-            throw std::runtime_error("Error opening file");
+            if (size <= options_.compressionSampleSize) {
+                return false;
+            }
+
+            const auto sampleCompressedSize =
+                Compress(compression, data, options_.compressionSampleSize, output);
+
+            return !PassesCompressionThreshold(sampleCompressedSize,
+                                               options_.compressionSampleSize);
+        }
+
+        /**
+        Return the next index for a chunk with this identifier.
+        */
+        static int AssignChunkIndex(std::map<ChunkId, int>& chunkCountPerType, const ChunkId& id)
+        {
+            auto it = chunkCountPerType.find(id);
+            if (it == chunkCountPerType.end()) {
+                chunkCountPerType[id] = 1;
+                return 0;
+            }
+
+            return it->second++;
+        }
+
+        /////////////////////////////////////////////////////////////////////
+        // Asynchronous mode
+        //
+        // All calls get turned into commands which are queued for a
+        // background thread, which then runs the synchronous *Impl functions
+        // in order. The front end tracks chunk indices on its own, which
+        // works because the background thread executes commands in the same
+        // order. The synchronous path doesn't use any of this.
+
+        struct QueuedCommand
+        {
+            enum class Type
+            {
+                BeginChunk,
+                AppendToChunk,
+                EndChunk,
+                CommitChunk,
+                Flush
+            };
+
+            Type type;
+            ChunkFile::IndexEntry entry;
+            std::uint64_t key = 0;
+            std::uint64_t checksum = 0;
+            std::vector<unsigned char> header;
+            std::vector<unsigned char> data;
+        };
+
+        bool IsAsync() const
+        {
+            return options_.asyncMemoryLimit > 0;
+        }
+
+        static std::int64_t GetQueuedSize(const QueuedCommand& command)
+        {
+            return command.header.size() + command.data.size();
+        }
+
+        void ThrowWorkerError()
+        {
+            if (workerError_) {
+                std::rethrow_exception(workerError_);
+            }
+        }
+
+        /**
+        Check if size more bytes fit into the memory limit. The data
+        collected for the open chunk counts towards the limit as well. Once
+        the queue is empty, there's nothing left to wait for, so the data of
+        the open chunk alone may exceed the limit.
+        */
+        bool HasQueueRoomFor(const std::int64_t size) const
+        {
+            const std::int64_t collectedSize = queuedChunkData_.size();
+            return queuedBytes_ == 0 ||
+                   queuedBytes_ + collectedSize + size <= options_.asyncMemoryLimit;
+        }
+
+        /**
+        Queue a command, waiting until there's enough room in the queue.
+
+        A command which exceeds the memory limit on its own is not queued.
+        Instead, it's executed on the calling thread once the background
+        thread is idle. Chunk commits additionally wait until no chunk is
+        open, so they don't end up in the middle of another chunk.
+        */
+        void Enqueue(std::unique_lock<std::mutex>& lock, QueuedCommand&& command)
+        {
+            const std::int64_t size = GetQueuedSize(command);
+            const bool isCommit = command.type == QueuedCommand::Type::CommitChunk;
+            const bool isOversized = size > options_.asyncMemoryLimit;
+
+            queueChanged_.wait(lock, [&]() -> bool {
+                if (workerError_) {
+                    return true;
+                }
+
+                if (isCommit && queuedChunkOpen_) {
+                    return false;
+                }
+
+                if (isOversized) {
+                    return queue_.empty() && !workerBusy_;
+                }
+
+                return HasQueueRoomFor(size);
+            });
+
+            ThrowWorkerError();
+
+            if (isOversized) {
+                // Nobody else can run a command while we hold the lock, and
+                // an error leaves the file broken, as it would on the
+                // background thread
+                try {
+                    ExecuteCommand(command);
+                } catch (...) {
+                    workerError_ = std::current_exception();
+                    throw;
+                }
+
+                return;
+            }
+
+            queuedBytes_ += size;
+            queue_.push_back(std::move(command));
+            queueChanged_.notify_all();
+        }
+
+        void BeginQueuedChunk(const ChunkFile::IndexEntry& entry,
+                              const std::uint64_t key,
+                              const std::int64_t chunkHeaderSize,
+                              const void* chunkHeader)
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            assert(!queuedChunkOpen_);
+
+            QueuedCommand command;
+            command.type = QueuedCommand::Type::BeginChunk;
+            command.entry = entry;
+            command.key = key;
+            command.header.assign(static_cast<const unsigned char*>(chunkHeader),
+                                  static_cast<const unsigned char*>(chunkHeader) + chunkHeaderSize);
+            Enqueue(lock, std::move(command));
+
+            queuedChunk_ = entry;
+            queuedChunkOpen_ = true;
+        }
+
+        void AppendToQueuedChunk(const std::int64_t chunkDataSize, const void* chunkData)
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            assert(queuedChunkOpen_);
+
+            // Uncompressed data can be written before the chunk ends, so pass
+            // it on in pieces instead of holding the whole chunk in memory.
+            // Compressed data has to stay here until the chunk ends
+            const bool isCompressed = queuedChunk_.compression != Compression::None;
+            const std::int64_t pieceSize =
+                std::max<std::int64_t>(options_.asyncMemoryLimit / 4, 1);
+
+            const unsigned char* data = static_cast<const unsigned char*>(chunkData);
+            std::int64_t remaining = chunkDataSize;
+
+            do {
+                const std::int64_t size =
+                    isCompressed
+                        ? remaining
+                        : std::min<std::int64_t>(remaining,
+                                                 pieceSize - queuedChunkData_.size());
+
+                queueChanged_.wait(
+                    lock, [&]() -> bool { return workerError_ || HasQueueRoomFor(size); });
+
+                ThrowWorkerError();
+
+                queuedChunkData_.insert(queuedChunkData_.end(), data, data + size);
+                data += size;
+                remaining -= size;
+
+                if (!isCompressed &&
+                    static_cast<std::int64_t>(queuedChunkData_.size()) >= pieceSize) {
+                    SubmitQueuedChunkData(lock);
+                }
+            } while (remaining > 0);
+        }
+
+        void SubmitQueuedChunkData(std::unique_lock<std::mutex>& lock)
+        {
+            if (queuedChunkData_.empty()) {
+                return;
+            }
+
+            QueuedCommand command;
+            command.type = QueuedCommand::Type::AppendToChunk;
+            command.data.swap(queuedChunkData_);
+
+            // Continue with the buffer the background thread handed back,
+            // so we alternate between two buffers instead of allocating
+            queuedChunkData_.swap(spareChunkData_);
+
+            Enqueue(lock, std::move(command));
+        }
+
+        int EndQueuedChunk()
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            assert(queuedChunkOpen_);
+
+            SubmitQueuedChunkData(lock);
+
+            QueuedCommand command;
+            command.type = QueuedCommand::Type::EndChunk;
+            Enqueue(lock, std::move(command));
+
+            queuedChunkOpen_ = false;
+            // Chunk commits may be waiting for this chunk to end
+            queueChanged_.notify_all();
+
+            return AssignChunkIndex(queuedChunkCountPerType_, ChunkId(queuedChunk_.chunkIdentifier));
+        }
+
+        int CommitQueuedChunk(const ChunkFile::IndexEntry& entry,
+                              const std::uint64_t key,
+                              const std::uint64_t checksum,
+                              std::vector<unsigned char>&& chunkHeader,
+                              std::vector<unsigned char>&& chunkData)
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+
+            QueuedCommand command;
+            command.type = QueuedCommand::Type::CommitChunk;
+            command.entry = entry;
+            command.key = key;
+            command.checksum = checksum;
+            command.header = std::move(chunkHeader);
+            command.data = std::move(chunkData);
+            Enqueue(lock, std::move(command));
+
+            return AssignChunkIndex(queuedChunkCountPerType_, ChunkId(entry.chunkIdentifier));
+        }
+
+        void FlushQueue()
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+
+            if (queuedChunkOpen_ && queuedChunk_.compression == Compression::None) {
+                SubmitQueuedChunkData(lock);
+            }
+
+            QueuedCommand command;
+            command.type = QueuedCommand::Type::Flush;
+            Enqueue(lock, std::move(command));
+
+            queueChanged_.wait(lock, [this]() -> bool {
+                return workerError_ || (queue_.empty() && !workerBusy_);
+            });
+
+            ThrowWorkerError();
+        }
+
+        void ExecuteCommand(QueuedCommand& command)
+        {
+            switch (command.type) {
+            case QueuedCommand::Type::BeginChunk:
+                BeginChunkImpl(
+                    command.entry, command.key, command.header.size(), command.header.data());
+                break;
+
+            case QueuedCommand::Type::AppendToChunk:
+                AppendToChunkImpl(command.data.size(), command.data.data());
+                break;
+
+            case QueuedCommand::Type::EndChunk:
+                EndChunkImpl();
+                break;
+
+            case QueuedCommand::Type::CommitChunk:
+                CommitChunkImpl(command.entry,
+                                command.key,
+                                command.checksum,
+                                command.header.size(),
+                                command.header.data(),
+                                command.data.size(),
+                                command.data.data());
+                break;
+
+            case QueuedCommand::Type::Flush:
+                FlushImpl();
+                break;
+            }
+        }
+
+        void RunWorker()
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+
+            for (;;) {
+                queueChanged_.wait(lock,
+                                   [this]() -> bool { return stopWorker_ || !queue_.empty(); });
+
+                if (stopWorker_) {
+                    return;
+                }
+
+                QueuedCommand command = std::move(queue_.front());
+                queue_.pop_front();
+
+                // Once something failed, the file is broken anyway, so we
+                // only drain the queue to unblock the producers
+                const bool execute = !workerError_;
+                workerBusy_ = true;
+
+                lock.unlock();
+
+                std::exception_ptr error;
+                if (execute) {
+                    try {
+                        ExecuteCommand(command);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+
+                lock.lock();
+
+                if (error) {
+                    workerError_ = error;
+                }
+
+                queuedBytes_ -= GetQueuedSize(command);
+
+                if (command.type == QueuedCommand::Type::AppendToChunk &&
+                    spareChunkData_.capacity() == 0) {
+                    command.data.clear();
+                    spareChunkData_.swap(command.data);
+                }
+
+                workerBusy_ = false;
+                queueChanged_.notify_all();
+            }
+        }
+
+        void StopWorker()
+        {
+            if (!worker_.joinable()) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                stopWorker_ = true;
+            }
+
+            queueChanged_.notify_all();
+            worker_.join();
         }
 
-        // Disable inheritance of the file handle.
-        SetHandleInformation(object_handle, HANDLE_FLAG_INHERIT, 0);
-        return rdf_make_unique<Filestream>(fd, accessMode);
-#else
-        return OpenFile(filename, accessMode, fileMode);
-#endif  // #if RDF_PLATFORM_WINDOWS
+        void Construct()
+        {
+            const bool append = options_.append;
+
+            if (!stream_->CanWrite()) {
+                throw std::runtime_error("Stream must allow for write access");
+            }
+
+            if (append && !stream_->CanRead()) {
+                throw std::runtime_error("Appending requires a stream with read access");
+            }
+
+            if (options_.writeBufferSize < 0) {
+                throw std::runtime_error("Write buffer size must be positive or null");
+            }
+
+            // Without reading the stored data back, a matching hash is no
+            // proof of matching data
+            if (!stream_->CanRead()) {
+                options_.deduplicateChunks = false;
+            }
+
+            if (options_.asyncMemoryLimit < 0) {
+                throw std::runtime_error("Asynchronous memory limit must be positive or null");
+            }
+
+            if (options_.dataAlignment < 0 || options_.headerAlignment < 0) {
+                throw std::runtime_error("Alignment must be positive or null");
+            }
+
+            if (options_.expectedFileSize < 0) {
+                throw std::runtime_error("Expected file size must be positive or null");
+            }
+
+            if (options_.indexPublishInterval < 0 || options_.indexPublishByteInterval < 0) {
+                throw std::runtime_error("Index publish interval must be positive or null");
+            }
+
+            if (options_.expectedFileSize > 0) {
+                stream_->Reserve(options_.expectedFileSize);
+            }
+
+            writeBuffer_.reserve(options_.writeBufferSize);
+
+            ::memset(&header_, 0, sizeof(header_));
+
+            if (append) {
+                // Try to read the current header, check if it's a supported
+                // version, then read in the index
+                stream_->Read(0, sizeof(header_), &header_);
+
+                if (::memcmp(header_.identifier,
+                             ChunkFile::Identifier,
+                             sizeof(ChunkFile::Identifier)) != 0) {
+                    throw std::runtime_error("Unsupported file type");
+                }
+
+                if (header_.version != ChunkFile::Version &&
+                    header_.version != ChunkFile::SegmentedVersion) {
+                    throw std::runtime_error("Unsupported file version");
+                }
+
+                // Files with a trailer but without keys or checksums get
+                // their index rewritten once, so the new segments can store
+                // them
+                const std::uint32_t incrementalFlags =
+                    ChunkFile::IndexTrailerFlag | ChunkFile::ChunkKeysFlag |
+                    (options_.chunkChecksums
+                         ? static_cast<std::uint32_t>(ChunkFile::ChunkChecksumsFlag)
+                         : static_cast<std::uint32_t>(0));
+
+                if ((header_.flags & incrementalFlags) == incrementalFlags &&
+                    options_.incrementalAppend) {
+                    // The last segment has the chunk counts of all of them,
+                    // and the existing index remains where it is
+                    std::vector<ChunkFile::IndexEntry> segment;
+                    std::vector<std::uint64_t> keys, checksums;
+                    std::vector<ChunkFile::ChunkCount> chunkCounts;
+                    ChunkFile::IndexTrailer trailer;
+                    if (!ChunkFile::ReadIndexSegment(stream_,
+                                                     header_.indexOffset,
+                                                     header_.indexSize,
+                                                     header_.flags,
+                                                     segment,
+                                                     keys,
+                                                     checksums,
+                                                     chunkCounts,
+                                                     trailer)) {
+                        throw std::runtime_error("Invalid file index");
+                    }
+
+                    for (const auto& chunkCount : chunkCounts) {
+                        chunkCountPerType_[ChunkId(chunkCount.chunkIdentifier)] =
+                            static_cast<int>(chunkCount.count);
+                    }
+
+                    incrementalIndex_ = true;
+                } else if (!ChunkFile::ReadFileIndex(
+                               stream_, header_, chunks_, chunkKeys_, chunkChecksums_)) {
+                    throw std::runtime_error("Invalid file index");
+                }
+
+                // Initialize the counts so the returned index is correct
+                for (const auto& chunk : chunks_) {
+                    ChunkId id (chunk.chunkIdentifier);
+                    chunkCountPerType_[id] += 1;
+                }
+
+                dataWriteOffset_ = header_.indexOffset;
+
+                if (IsPublishingIndex() && !(header_.flags & ChunkFile::IndexTrailerFlag)) {
+                    // Readers of files without a trailer can't tell whether
+                    // the header is being updated
+                    throw std::runtime_error(
+                        "Publishing the index requires a file which was created with it");
+                }
+
+                if (IsPublishingIndex() || incrementalIndex_) {
+                    // Keep the current index, as readers or the segments
+                    // written next may refer to it
+                    dataWriteOffset_ += header_.indexSize + sizeof(ChunkFile::IndexTrailer);
+                    publishedChunkCount_ = chunks_.size();
+                    publishedDataOffset_ = dataWriteOffset_;
+                } else {
+                    // The index gets rewritten after the new chunks, so the
+                    // chunk counts, checksums and keys in front of the old
+                    // one get overwritten as well
+                    const std::int64_t extensionSize =
+                        ChunkFile::GetExtensionSize(header_.indexSize);
+                    std::int64_t indexStart = header_.indexOffset;
+
+                    if (header_.flags & ChunkFile::ChunkKeysFlag) {
+                        indexStart -= extensionSize;
+                    }
+
+                    if (header_.flags & ChunkFile::ChunkChecksumsFlag) {
+                        indexStart -= extensionSize;
+                    }
+
+                    if (header_.flags & ChunkFile::IndexTrailerFlag) {
+                        ChunkFile::IndexTrailer trailer;
+                        if (stream_->Read(header_.indexOffset + header_.indexSize,
+                                          sizeof(trailer),
+                                          &trailer) != sizeof(trailer) ||
+                            trailer.chunkCountsSize < 0 ||
+                            trailer.chunkCountsSize > indexStart - std::int64_t(sizeof(header_))) {
+                            throw std::runtime_error("Invalid file index");
+                        }
+
+                        indexStart -= trailer.chunkCountsSize;
+                    }
+
+                    dataWriteOffset_ = indexStart;
+
+                    if (options_.incrementalAppend) {
+                        // The complete index gets written once more, in a
+                        // form which later appends can link to
+                        header_.flags |= ChunkFile::IndexTrailerFlag;
+                    }
+                }
+            } else {
+                header_.version = ChunkFile::Version;
+                ::memcpy(header_.identifier, ChunkFile::Identifier, sizeof(ChunkFile::Identifier));
+
+                if (IsPublishingIndex()) {
+                    header_.flags = ChunkFile::IndexTrailerFlag | ChunkFile::ChunkKeysFlag;
+
+                    if (options_.chunkChecksums) {
+                        header_.flags |= ChunkFile::ChunkChecksumsFlag;
+                    }
+                }
+
+                stream_->Write(0, sizeof(header_), &header_);
+                dataWriteOffset_ = sizeof(header_);
+
+                // Publish the empty index right away, so the file can be
+                // opened before the first chunk is done
+                if (IsPublishingIndex()) {
+                    WriteIndexSegment();
+                    WriteHeader();
+                }
+            }
+
+            if (IsAsync()) {
+                queuedChunk_ = {};
+                queuedChunkCountPerType_ = chunkCountPerType_;
+                worker_ = std::thread(&ChunkFileWriter::RunWorker, this);
+            }
+        }
+
+        std::vector<ChunkFile::IndexEntry> chunks_;
+        // The key and the checksum of each chunk in chunks_
+        std::vector<std::uint64_t> chunkKeys_;
+        std::vector<std::uint64_t> chunkChecksums_;
+        // Checksum of the data appended to the open chunk so far
+        StreamingXXH3 currentChunkChecksum_;
+        std::vector<unsigned char> chunkDataBuffer_;
+        // Scratch space for compression, kept around to avoid allocating
+        // it for every chunk
+        std::vector<unsigned char> compressedDataBuffer_;
+        // Pending writes, which end at dataWriteOffset_
+        std::vector<unsigned char> writeBuffer_;
+        // Scratch space for copying chunks from other files
+        std::vector<unsigned char> copyBuffer_;
+        // Scratch space for comparing chunk data against earlier copies
+        std::vector<unsigned char> compareBuffer_;
+
+        // Chunk data written by this writer, by hash, for deduplication
+        std::multimap<std::uint64_t, StoredData> storedData_;
+
+        std::map<ChunkId, int> chunkCountPerType_;
+
+        ChunkFile::IndexEntry* currentChunk_ = nullptr;
+        ChunkFile::Header header_;
+        std::unique_ptr<IStream> streamPointer_;
+        IStream* stream_ = nullptr;
+
+        Options options_;
+
+        std::int64_t dataWriteOffset_ = 0;
+        // Chunks ended since the index was published last
+        std::int64_t chunksSincePublish_ = 0;
+        // Number of chunks covered by the published index segments, and the
+        // write offset after the last segment
+        std::size_t publishedChunkCount_ = 0;
+        std::int64_t publishedDataOffset_ = 0;
+        // Set if chunks_ only contains the chunks added by this writer, as
+        // the others are indexed by segments in the file already
+        bool incrementalIndex_ = false;
+
+        // Guards all state above against concurrent chunk commits
+        std::mutex mutex_;
+        std::condition_variable chunkEnded_;
+        int openChunkWriters_ = 0;
+        // Thread which opened the current chunk through BeginChunk. Only
+        // that thread sets or clears it, so it can check for its own chunk
+        // without taking a lock
+        std::atomic<std::thread::id> chunkOwner_{std::thread::id()};
+
+        // Asynchronous mode state, guarded by queueMutex_
+        std::mutex queueMutex_;
+        std::condition_variable queueChanged_;
+        std::deque<QueuedCommand> queue_;
+        std::int64_t queuedBytes_ = 0;
+        std::map<ChunkId, int> queuedChunkCountPerType_;
+        ChunkFile::IndexEntry queuedChunk_;
+        bool queuedChunkOpen_ = false;
+        std::vector<unsigned char> queuedChunkData_;
+        std::vector<unsigned char> spareChunkData_;
+        std::exception_ptr workerError_;
+        bool workerBusy_ = false;
+        bool stopWorker_ = false;
+        std::thread worker_;
+    };
+
+    ///////////////////////////////////////////////////////////////////////////
+    /**
+    A chunk which is written independently of other chunks.
+
+    All data is staged in memory, and compressed on the calling thread when
+    the chunk gets closed. Only then it's committed to the chunk file writer,
+    so any number of chunk writers can be filled concurrently.
+    */
+    class ChunkWriter final
+    {
+    public:
+        ChunkWriter(ChunkFileWriter* writer,
+                    const char* chunkIdentifier,
+                    const std::int64_t chunkHeaderSize,
+                    const void* chunkHeader,
+                    const Compression compression,
+                    const std::uint32_t version,
+                    const std::uint64_t key)
+            : writer_(writer),
+              entry_(ChunkFileWriter::CreateIndexEntry(chunkIdentifier, compression, version)),
+              key_(key)
+        {
+            if (chunkHeaderSize < 0) {
+                throw std::runtime_error("Chunk header size must be positive or null");
+            }
+
+            if (chunkHeaderSize > 0 && chunkHeader == nullptr) {
+                throw std::runtime_error("Chunk header cannot be null");
+            }
+
+            header_.assign(static_cast<const unsigned char*>(chunkHeader),
+                           static_cast<const unsigned char*>(chunkHeader) + chunkHeaderSize);
+
+            writer_->NotifyChunkWriterOpened();
+        }
+
+        ~ChunkWriter()
+        {
+            if (writer_) {
+                writer_->NotifyChunkWriterClosed();
+            }
+        }
+
+        ChunkWriter(const ChunkWriter&) = delete;
+        ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+        void Append(const std::int64_t chunkDataSize, const void* chunkData)
+        {
+            if (chunkDataSize < 0) {
+                throw std::runtime_error("Chunk data size must be positive or null");
+            }
+
+            if (chunkDataSize > 0 && chunkData == nullptr) {
+                throw std::runtime_error("Chunk data cannot be null");
+            }
+
+            data_.insert(data_.end(),
+                         static_cast<const unsigned char*>(chunkData),
+                         static_cast<const unsigned char*>(chunkData) + chunkDataSize);
+        }
+
+        /**
+        Compress and commit the chunk. Returns the chunk index.
+
+        The chunk writer cannot be used afterwards, even if this fails.
+        */
+        int Close()
+        {
+            if (writer_ == nullptr) {
+                throw std::runtime_error("Chunk writer has been closed already");
+            }
+
+            ChunkFileWriter* writer = writer_;
+            writer_ = nullptr;
+
+            try {
+                const int index = Commit(writer);
+                writer->NotifyChunkWriterClosed();
+                return index;
+            } catch (...) {
+                writer->NotifyChunkWriterClosed();
+                throw;
+            }
+        }
+
+    private:
+        int Commit(ChunkFileWriter* writer)
+        {
+            const auto checksum = writer->IsComputingChecksums()
+                                      ? StreamingXXH3::Hash(data_.data(), data_.size())
+                                      : 0;
+
+            if (entry_.compression != Compression::None) {
+                std::vector<unsigned char> compressedData;
+                const auto compressedSize = writer->CompressChunkData(
+                    entry_.compression, data_.data(), data_.size(), compressedData);
+
+                if (compressedSize >= 0) {
+                    entry_.uncompressedChunkSize = data_.size();
+                    compressedData.resize(compressedSize);
+                    compressedData.swap(data_);
+                } else {
+                    entry_.compression = Compression::None;
+                }
+            }
+
+            return writer->CommitChunk(
+                entry_, key_, checksum, std::move(header_), std::move(data_));
+        }
+
+        ChunkFileWriter* writer_ = nullptr;
+        ChunkFile::IndexEntry entry_;
+        std::uint64_t key_;
+        std::vector<unsigned char> header_;
+        std::vector<unsigned char> data_;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    IStream::~IStream() {}
+
+    //////////////////////////////////////////////////////////////////////
+    std::int64_t IStream::Read(const std::int64_t offset,
+        const std::int64_t size, void* buffer)
+    {
+        if (size > 0 && buffer == nullptr) {
+            throw std::runtime_error("Buffer cannot be null");
+        }
+
+        if (size < 0) {
+            throw std::runtime_error("Size must be >= 0");
+        }
+
+        if (offset < 0) {
+            throw std::runtime_error("Offset must be >= 0");
+        }
+
+        assert(CheckIsInSystemSizeRange(size));
+
+        return ReadImpl(offset, size, buffer);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::int64_t IStream::Write(const std::int64_t offset,
+        const std::int64_t size, const void* buffer)
+    {
+        if (size > 0 && buffer == nullptr) {
+            throw std::runtime_error("Buffer cannot be null");
+        }
+
+        if (size < 0) {
+            throw std::runtime_error("Size must be >= 0");
+        }
+
+        if (offset < 0) {
+            throw std::runtime_error("Offset must be >= 0");
+        }
+
+        assert(CheckIsInSystemSizeRange(size));
+
+        return WriteImpl(offset, size, buffer);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    void IStream::Reserve(const std::int64_t size)
+    {
+        if (size < 0) {
+            throw std::runtime_error("Size must be >= 0");
+        }
+
+        ReserveImpl(size);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    void IStream::Truncate(const std::int64_t size)
+    {
+        if (size < 0) {
+            throw std::runtime_error("Size must be >= 0");
+        }
+
+        TruncateImpl(size);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    bool IStream::GetMemoryView(std::vector<MemorySegment>& segments) const
+    {
+        segments.clear();
+        return GetMemoryViewImpl(segments);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    bool IStream::DetachMemoryBuffer(std::unique_ptr<unsigned char[]>& buffer,
+                                     std::int64_t& size)
+    {
+        buffer.reset();
+        size = 0;
+
+        return DetachMemoryBufferImpl(buffer, size);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    void IStream::Flush()
+    {
+        FlushImpl();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    int IStream::GetFileDescriptor() const
+    {
+        return GetFileDescriptorImpl();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    void IStream::Close()
+    {
+        CloseImpl();
+    }
+
+#if RDF_PLATFORM_UNIX
+    //////////////////////////////////////////////////////////////////////
+    /**
+    Allocate disk space for the first size bytes of a file, without changing
+    its size. File systems which don't support this are silently skipped,
+    but running out of space is an error.
+    */
+    void ReserveFileSpace(const int fd, const std::int64_t size)
+    {
+#if defined(__linux__)
+        if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) != 0 && errno != EOPNOTSUPP &&
+            errno != ENOSYS) {
+            throw std::runtime_error("Could not reserve file space");
+        }
+#elif defined(__APPLE__)
+        fstore_t store = {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, size, 0};
+        if (::fcntl(fd, F_PREALLOCATE, &store) == -1) {
+            // Contiguous space isn't available, take what we can get
+            store.fst_flags = F_ALLOCATEALL;
+            if (::fcntl(fd, F_PREALLOCATE, &store) == -1 && errno != ENOTSUP) {
+                throw std::runtime_error("Could not reserve file space");
+            }
+        }
+#else
+        // posix_fallocate changes the file size, so don't reserve anything
+        (void)fd;
+        (void)size;
+#endif
+    }
+#endif  // #if RDF_PLATFORM_UNIX
+    
+    //////////////////////////////////////////////////////////////////////
+    bool IStream::CanRead() const
+    {
+        return CanReadImpl();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    bool IStream::CanWrite() const
+    {
+        return CanWriteImpl();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::int64_t IStream::GetSize() const
+    {
+        return GetSizeImpl();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    class Filestream final : public IStream
+    {
+    public:
+        Filestream(std::FILE* fd, rdfStreamAccess accessMode) : fd_(fd), accessMode_(accessMode) {}
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+            const std::int64_t count, void* buffer) override
+        {
+            Seek(offset);
+            return std::fread(buffer, 1, count, fd_);
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+            const std::int64_t count, const void* buffer) override
+        {
+            Seek(offset);
+            return std::fwrite(buffer, 1, count, fd_);
+        }
+
+        void Seek(const std::int64_t offset)
+        {
+#if RDF_PLATFORM_WINDOWS
+            _fseeki64(fd_, offset, SEEK_SET);
+#elif RDF_PLATFORM_UNIX
+            // Linux fseek is a long, so 64-bit
+            fseek(fd_, offset, SEEK_SET);
+#else
+#error "Unsupported platform"
+#endif
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return accessMode_ == rdfStreamAccessReadWrite;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        void ReserveImpl(const std::int64_t size) override
+        {
+            if (!CanWriteImpl() || size <= GetSizeImpl()) {
+                return;
+            }
+
+            std::fflush(fd_);
+
+#if RDF_PLATFORM_WINDOWS
+            // Space allocated beyond the end of the file is released when
+            // the file is closed
+            FILE_ALLOCATION_INFO info = {};
+            info.AllocationSize.QuadPart = size;
+            if (!SetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(fd_))),
+                                            FileAllocationInfo,
+                                            &info,
+                                            sizeof(info))) {
+                throw std::runtime_error("Could not reserve file space");
+            }
+#elif RDF_PLATFORM_UNIX
+            ReserveFileSpace(fileno(fd_), size);
+#else
+#error "Unsupported platform"
+#endif
+        }
+
+        void TruncateImpl(const std::int64_t size) override
+        {
+            if (!CanWriteImpl()) {
+                return;
+            }
+
+            std::fflush(fd_);
+
+#if RDF_PLATFORM_WINDOWS
+            if (_chsize_s(_fileno(fd_), size) != 0) {
+                throw std::runtime_error("Could not truncate file");
+            }
+#elif RDF_PLATFORM_UNIX
+            if (::ftruncate(fileno(fd_), size) != 0) {
+                throw std::runtime_error("Could not truncate file");
+            }
+#else
+#error "Unsupported platform"
+#endif
+        }
+
+        void FlushImpl() override
+        {
+            // For streams opened for reading, this discards the read buffer
+            std::fflush(fd_);
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+#if RDF_PLATFORM_WINDOWS
+            struct _stat64 statBuffer;
+            _fstat64(_fileno(fd_), &statBuffer);
+            return statBuffer.st_size;
+#elif RDF_PLATFORM_UNIX
+            struct stat statBuffer;
+            fstat(fileno(fd_), &statBuffer);
+            return statBuffer.st_size;
+#else
+#error "Unsupported platform"
+#endif
+        }
+
+        void CloseImpl() override
+        { 
+            std::fclose(fd_);
+            fd_ = nullptr;
+        }
+
+        std::FILE* fd_;
+        rdfStreamAccess accessMode_;
+    };
+
+#if RDF_PLATFORM_UNIX
+    //////////////////////////////////////////////////////////////////////
+    /**
+    File stream which bypasses the page cache (O_DIRECT on Linux, F_NOCACHE
+    on macOS.)
+
+    Direct I/O requires aligned offsets, sizes and memory, so all accesses
+    go through an aligned window of the file. Sequential reads and writes
+    fill the window and hit the file in large, aligned blocks; writes to
+    partial blocks read the block first. As the file can only grow in whole
+    blocks, the logical size is tracked separately and the file gets
+    truncated to it when the stream is closed.
+    */
+    class DirectFilestream final : public IStream
+    {
+    public:
+        static constexpr std::int64_t BlockSize = 4096;
+        static constexpr std::int64_t WindowSize = 4 * 1024 * 1024;
+
+        DirectFilestream(const int fd, const rdfStreamAccess accessMode)
+            : fd_(fd), accessMode_(accessMode)
+        {
+            void* window = nullptr;
+            if (::posix_memalign(&window, BlockSize, WindowSize) != 0) {
+                ::close(fd_);
+                throw std::bad_alloc();
+            }
+            window_ = static_cast<unsigned char*>(window);
+
+            struct stat statBuffer;
+            fstat(fd_, &statBuffer);
+            size_ = statBuffer.st_size;
+            fileSize_ = size_;
+        }
+
+        ~DirectFilestream()
+        {
+            if (fd_ != -1) {
+                try {
+                    CloseImpl();
+                } catch (...) {
+                    // Can't report errors from a destructor
+                }
+            }
+
+            std::free(window_);
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            std::int64_t bytesRead = 0;
+
+            while (bytesRead < count && offset + bytesRead < size_) {
+                const auto position = offset + bytesRead;
+                if (!IsInWindow(position)) {
+                    LoadWindow(position);
+
+                    // The file has been truncated behind our back
+                    if (!IsInWindow(position)) {
+                        break;
+                    }
+                }
+
+                const auto windowPosition = position - windowOffset_;
+                const auto n = std::min(count - bytesRead, windowSize_ - windowPosition);
+                ::memcpy(static_cast<unsigned char*>(buffer) + bytesRead,
+                         window_ + windowPosition,
+                         n);
+                bytesRead += n;
+            }
+
+            return bytesRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            std::int64_t bytesWritten = 0;
+
+            while (bytesWritten < count) {
+                const auto position = offset + bytesWritten;
+
+                // Writes may extend the window up to its capacity, as long
+                // as they're contiguous with its content
+                if (position < windowOffset_ || position > windowOffset_ + windowSize_ ||
+                    position >= windowOffset_ + WindowSize) {
+                    LoadWindow(position);
+
+                    // Writing past the end of the file leaves a gap of zeros
+                    windowSize_ = std::max(windowSize_, position - windowOffset_);
+                }
+
+                const auto windowPosition = position - windowOffset_;
+                const auto n = std::min(count - bytesWritten, WindowSize - windowPosition);
+                ::memcpy(window_ + windowPosition,
+                         static_cast<const unsigned char*>(buffer) + bytesWritten,
+                         n);
+
+                windowSize_ = std::max(windowSize_, windowPosition + n);
+                windowDirty_ = true;
+                size_ = std::max(size_, position + n);
+                bytesWritten += n;
+            }
+
+            return bytesWritten;
+        }
+
+        bool IsInWindow(const std::int64_t position) const
+        {
+            return position >= windowOffset_ && position < windowOffset_ + windowSize_;
+        }
+
+        /**
+        Write back the current window and load the window containing the
+        given position. Data past the end of the file reads as zeros.
+        */
+        void LoadWindow(const std::int64_t position)
+        {
+            FlushWindow();
+
+            windowOffset_ = position - position % BlockSize;
+            windowSize_ = 0;
+
+            std::int64_t bytesRead = 0;
+            while (windowOffset_ + bytesRead < fileSize_ && bytesRead < WindowSize) {
+                const auto result = ::pread(
+                    fd_, window_ + bytesRead, WindowSize - bytesRead, windowOffset_ + bytesRead);
+                if (result < 0) {
+                    throw std::runtime_error("Error while reading from file.");
+                } else if (result == 0) {
+                    break;
+                }
+
+                bytesRead += result;
+            }
+
+            windowSize_ = std::max<std::int64_t>(0, std::min(bytesRead, size_ - windowOffset_));
+            ::memset(window_ + windowSize_, 0, WindowSize - windowSize_);
+        }
+
+        /**
+        Write the window to the file if it has been modified. The last block
+        is written completely, with zeros past the end of the data.
+        */
+        void FlushWindow()
+        {
+            if (!windowDirty_) {
+                return;
+            }
+
+            const auto writeSize = (windowSize_ + BlockSize - 1) / BlockSize * BlockSize;
+            ::memset(window_ + windowSize_, 0, writeSize - windowSize_);
+
+            std::int64_t bytesWritten = 0;
+            while (bytesWritten < writeSize) {
+                const auto result = ::pwrite(fd_,
+                                             window_ + bytesWritten,
+                                             writeSize - bytesWritten,
+                                             windowOffset_ + bytesWritten);
+                if (result <= 0) {
+                    throw std::runtime_error("Error while writing to file.");
+                }
+
+                bytesWritten += result;
+            }
+
+            fileSize_ = std::max(fileSize_, windowOffset_ + writeSize);
+            windowDirty_ = false;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return accessMode_ == rdfStreamAccessReadWrite;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        void ReserveImpl(const std::int64_t size) override
+        {
+            if (CanWriteImpl() && size > fileSize_) {
+                ReserveFileSpace(fd_, size);
+            }
+        }
+
+        void FlushImpl() override
+        {
+            FlushWindow();
+
+            // Readers pick up growth through other handles, and reload the
+            // window on the next access. Writers own the file content, and
+            // the window must stay valid for writes contiguous with it
+            if (CanWriteImpl()) {
+                return;
+            }
+
+            struct stat statBuffer;
+            if (::fstat(fd_, &statBuffer) == 0 && statBuffer.st_size > fileSize_) {
+                fileSize_ = statBuffer.st_size;
+                size_ = fileSize_;
+            }
+
+            windowSize_ = 0;
+        }
+
+        void TruncateImpl(const std::int64_t size) override
+        {
+            if (!CanWriteImpl()) {
+                return;
+            }
+
+            FlushWindow();
+
+            if (::ftruncate(fd_, size) != 0) {
+                throw std::runtime_error("Could not truncate file");
+            }
+
+            size_ = size;
+            fileSize_ = size;
+
+            // The window may contain data past the new end
+            windowSize_ = std::max<std::int64_t>(0, std::min(windowSize_, size_ - windowOffset_));
+            ::memset(window_ + windowSize_, 0, WindowSize - windowSize_);
+        }
+
+        void CloseImpl() override
+        {
+            try {
+                FlushWindow();
+
+                // Drop the padding of the last block
+                if (fileSize_ > size_ && ::ftruncate(fd_, size_) != 0) {
+                    throw std::runtime_error("Error while truncating file.");
+                }
+            } catch (...) {
+                ::close(fd_);
+                fd_ = -1;
+                throw;
+            }
+
+            ::close(fd_);
+            fd_ = -1;
+        }
+
+        int fd_;
+        rdfStreamAccess accessMode_;
+
+        unsigned char* window_ = nullptr;
+        // File offset of the window, always a multiple of BlockSize
+        std::int64_t windowOffset_ = 0;
+        // Number of valid bytes in the window
+        std::int64_t windowSize_ = 0;
+        bool windowDirty_ = false;
+
+        // Logical size of the stream, and the size of the file on disk,
+        // which may include the padding of the last block
+        std::int64_t size_ = 0;
+        std::int64_t fileSize_ = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    Read/write stream on an anonymous file in memory (memfd on Linux), whose
+    descriptor can be passed to other processes. Those can then map the
+    contents instead of copying them, see MappedStream.
+    */
+    class SharedMemoryStream final : public IStream
+    {
+    public:
+        explicit SharedMemoryStream(const int fd) : fd_(fd) {}
+
+        ~SharedMemoryStream()
+        {
+            if (fd_ != -1) {
+                ::close(fd_);
+            }
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            auto output = static_cast<unsigned char*>(buffer);
+            std::int64_t bytesRead = 0;
+
+            while (bytesRead < count) {
+                const auto result = ::pread(fd_, output + bytesRead,
+                    static_cast<std::size_t>(count - bytesRead), offset + bytesRead);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throw std::runtime_error("Could not read from shared memory");
+                } else if (result == 0) {
+                    break;
+                }
+
+                bytesRead += result;
+            }
+
+            return bytesRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            auto input = static_cast<const unsigned char*>(buffer);
+            std::int64_t bytesWritten = 0;
+
+            while (bytesWritten < count) {
+                const auto result = ::pwrite(fd_, input + bytesWritten,
+                    static_cast<std::size_t>(count - bytesWritten), offset + bytesWritten);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throw std::runtime_error("Could not write to shared memory");
+                }
+
+                bytesWritten += result;
+            }
+
+            size_ = std::max(size_, offset + bytesWritten);
+            return bytesWritten;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return true;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        void ReserveImpl(const std::int64_t size) override
+        {
+            ReserveFileSpace(fd_, size);
+        }
+
+        void TruncateImpl(const std::int64_t size) override
+        {
+            if (::ftruncate(fd_, size) != 0) {
+                throw std::runtime_error("Could not truncate shared memory");
+            }
+
+            size_ = size;
+        }
+
+        int GetFileDescriptorImpl() const override
+        {
+            return fd_;
+        }
+
+        void CloseImpl() override
+        {
+            if (fd_ != -1) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+
+            size_ = 0;
+        }
+
+        int fd_;
+        std::int64_t size_ = 0;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    Read-only stream on a file mapped into memory. The file must not shrink
+    while it's mapped.
+    */
+    class MappedStream final : public IStream
+    {
+    public:
+        explicit MappedStream(const int fd)
+        {
+            struct stat statBuffer;
+            if (::fstat(fd, &statBuffer) != 0) {
+                throw std::runtime_error("Could not query file size");
+            }
+
+            size_ = statBuffer.st_size;
+
+            // Mapping zero bytes is an error, empty files don't need a mapping
+            if (size_ > 0) {
+                data_ = ::mmap(nullptr, static_cast<std::size_t>(size_), PROT_READ, MAP_SHARED, fd, 0);
+                if (data_ == MAP_FAILED) {
+                    data_ = nullptr;
+                    throw std::runtime_error("Could not map file");
+                }
+            }
+        }
+
+        ~MappedStream()
+        {
+            CloseImpl();
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            if (offset > size_) {
+                throw std::runtime_error("Read offset is out of bounds");
+            }
+
+            const auto bytesToRead = std::min(size_ - offset, count);
+            if (bytesToRead > 0) {
+                ::memcpy(buffer, static_cast<const unsigned char*>(data_) + offset, bytesToRead);
+            }
+
+            return bytesToRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            (void)offset;
+            (void)count;
+            (void)buffer;
+            assert(false);
+            return 0;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return false;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        bool GetMemoryViewImpl(std::vector<MemorySegment>& segments) const override
+        {
+            if (size_ > 0) {
+                segments.push_back({data_, size_});
+            }
+
+            return true;
+        }
+
+        void CloseImpl() override
+        {
+            if (data_ != nullptr) {
+                ::munmap(data_, static_cast<std::size_t>(size_));
+                data_ = nullptr;
+            }
+
+            size_ = 0;
+        }
+
+        void* data_ = nullptr;
+        std::int64_t size_ = 0;
+    };
+#endif  // #if RDF_PLATFORM_UNIX
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    TODO Not supported on 32-bit platforms as it cannot handle buffers
+         >= 2^32 bit there
+    */
+    class ReadOnlyMemoryStream final : public IStream
+    {
+    public:
+        ReadOnlyMemoryStream(const std::int64_t size, const void* buffer)
+            : size_(size), buffer_(buffer)
+        {
+            assert(size >= 0);
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+            const std::int64_t count, void* buffer) override
+        {
+            if (offset > size_) {
+                throw std::runtime_error("Read offset is out of bounds");
+            }
+
+            auto bytesToRead = std::max(std::int64_t(0),
+                std::min(size_ - offset, count));
+            ::memcpy(buffer,
+                static_cast<const unsigned char*>(buffer_) + offset,
+                bytesToRead);
+
+            return bytesToRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+            const std::int64_t count, const void* buffer) override
+        {
+            (void)offset;
+            (void)count;
+            (void)buffer;
+            assert(false);
+            return 0;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return false;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        bool GetMemoryViewImpl(std::vector<MemorySegment>& segments) const override
+        {
+            if (size_ > 0) {
+                segments.push_back({buffer_, size_});
+            }
+
+            return true;
+        }
+
+        void CloseImpl() override
+        {
+            buffer_ = nullptr;
+            size_ = 0;
+            readPointer_ = 0;
+        }
+
+        std::int64_t size_;
+        std::size_t readPointer_ = 0;
+        const void* buffer_;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    Read/write stream backed by pages, so growing it never moves the data
+    written so far. All pages but the first one have the same size.
+
+    Small streams only allocate what they need: as long as the stream fits
+    into a single page, that page grows like a vector. Beyond that, new pages
+    are added, and new space isn't cleared unless a write leaves a gap.
+
+    Limited to 4 GiB on 32-bit platforms.
+    */
+    class MemoryStream final : public IStream
+    {
+    public:
+        static constexpr std::int64_t DefaultPageSize = 1024 * 1024;
+
+        /**
+        If a capacity hint is given, the first page has that size, so
+        streams which stay within it are stored contiguously. Pages after
+        it have the default size.
+        */
+        explicit MemoryStream(const std::int64_t capacityHint = 0)
+            : firstPageSize_(std::max(DefaultPageSize, capacityHint))
+        {
+            if (capacityHint > 0) {
+                EnsureCapacity(capacityHint);
+            }
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+            const std::int64_t count, void* buffer) override
+        {
+            auto bytesToRead = std::max(std::int64_t(0), std::min(size_ - offset, count));
+
+            auto output = static_cast<unsigned char*>(buffer);
+            ForEachPage(offset, bytesToRead, [&output](unsigned char* page, const std::int64_t n) {
+                ::memcpy(output, page, n);
+                output += n;
+            });
+
+            return bytesToRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+            const std::int64_t count, const void* buffer) override
+        {
+            const auto end = offset + count;
+
+            EnsureCapacity(end);
+            ClearGap(offset);
+
+            auto input = static_cast<const unsigned char*>(buffer);
+            ForEachPage(offset, count, [&input](unsigned char* page, const std::int64_t n) {
+                ::memcpy(page, input, n);
+                input += n;
+            });
+
+            size_ = std::max(size_, end);
+            return count;
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return true;
+        }
+
+        bool CanReadImpl() const override
+        {
+            return true;
+        }
+
+        void ReserveImpl(const std::int64_t size) override
+        {
+            EnsureCapacity(size);
+        }
+
+        void TruncateImpl(const std::int64_t size) override
+        {
+            EnsureCapacity(size);
+            ClearGap(size);
+            size_ = size;
+        }
+
+        bool GetMemoryViewImpl(std::vector<MemorySegment>& segments) const override
+        {
+            // The first page may be smaller than firstPageSize_ while it's
+            // the only one, but then it holds the whole stream
+            ForEachPage(0, size_, [&segments](unsigned char* page, const std::int64_t n) {
+                segments.push_back({page, n});
+            });
+
+            return true;
+        }
+
+        bool DetachMemoryBufferImpl(std::unique_ptr<unsigned char[]>& buffer,
+                                    std::int64_t& size) override
+        {
+            if (size_ <= firstPageSize_) {
+                // Everything is in the first page already, hand it over as-is
+                if (size_ > 0) {
+                    buffer = std::move(pages_[0]);
+                }
+            } else {
+                // Copy page by page, releasing each page right away, so the
+                // peak memory use only grows by one page
+                buffer.reset(new unsigned char[size_]);
+                for (std::int64_t offset = 0; offset < size_;) {
+                    const auto page = GetPage(offset);
+                    const auto n = std::min(GetPageSize(page), size_ - offset);
+                    ::memcpy(buffer.get() + offset, pages_[page].get(), n);
+                    pages_[page].reset();
+                    offset += n;
+                }
+            }
+
+            size = size_;
+
+            pages_.clear();
+            capacity_ = 0;
+            size_ = 0;
+
+            return true;
+        }
+
+        void CloseImpl() override
+        { 
+            pages_.clear();
+            capacity_ = 0;
+            size_ = 0;
+        }
+
+        std::int64_t GetPageSize(const std::size_t page) const
+        {
+            return page == 0 ? firstPageSize_ : DefaultPageSize;
+        }
+
+        /**
+        Get the index of the page holding offset. Only the first page may
+        differ in size, so everything past it is split evenly.
+        */
+        std::size_t GetPage(const std::int64_t offset) const
+        {
+            if (offset < firstPageSize_) {
+                return 0;
+            }
+
+            return static_cast<std::size_t>(1 + (offset - firstPageSize_) / DefaultPageSize);
+        }
+
+        std::int64_t GetPageStart(const std::size_t page) const
+        {
+            return page == 0 ? 0 : firstPageSize_ + (page - 1) * DefaultPageSize;
+        }
+
+        /**
+        Call f(pointer, size) for each contiguous piece of the given range.
+        */
+        template <typename Function>
+        void ForEachPage(std::int64_t offset, std::int64_t count, const Function& f) const
+        {
+            while (count > 0) {
+                const auto page = GetPage(offset);
+                const auto pageOffset = offset - GetPageStart(page);
+                const auto n = std::min(count, GetPageSize(page) - pageOffset);
+                f(pages_[page].get() + pageOffset, n);
+
+                offset += n;
+                count -= n;
+            }
+        }
+
+        /**
+        Zero everything between the current end and offset, as the memory
+        past the end may be uninitialized.
+        */
+        void ClearGap(const std::int64_t offset)
+        {
+            if (offset > size_) {
+                ForEachPage(size_, offset - size_, [](unsigned char* page, const std::int64_t n) {
+                    ::memset(page, 0, n);
+                });
+            }
+        }
+
+        void EnsureCapacity(const std::int64_t size)
+        {
+            if (size <= capacity_) {
+                return;
+            }
+
+            // A single page which isn't full-size yet grows geometrically,
+            // up to the size of the first page
+            if (pages_.size() <= 1 && capacity_ < firstPageSize_) {
+                const auto newCapacity = std::min(
+                    firstPageSize_, std::max<std::int64_t>({size, capacity_ * 2, 4096}));
+
+                std::unique_ptr<unsigned char[]> page(new unsigned char[newCapacity]);
+                if (size_ > 0) {
+                    ::memcpy(page.get(), pages_[0].get(), size_);
+                }
+
+                pages_.resize(1);
+                pages_[0] = std::move(page);
+                capacity_ = newCapacity;
+            }
+
+            while (capacity_ < size) {
+                pages_.emplace_back(new unsigned char[DefaultPageSize]);
+                capacity_ += DefaultPageSize;
+            }
+        }
+
+        std::int64_t firstPageSize_;
+        std::vector<std::unique_ptr<unsigned char[]>> pages_;
+        std::int64_t capacity_ = 0;
+        std::int64_t size_ = 0;
+    };
+
+    constexpr std::int64_t MemoryStream::DefaultPageSize;
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    Read cache in front of another stream, for streams where every access is
+    expensive.
+
+    Reads are served from an LRU cache of aligned blocks. Misses fetch all
+    missing blocks of a read in one request, plus readaheadBlocks more if
+    the miss continues the previous one. Writes go straight to the inner
+    stream and drop the affected blocks from the cache.
+    */
+    class CachedStream final : public IStream
+    {
+    public:
+        CachedStream(IStream* inner,
+                     const std::int64_t blockSize,
+                     const std::int64_t cacheSize,
+                     const std::int64_t readaheadBlocks)
+            : inner_(inner),
+              blockSize_(ValidateBlockSize(blockSize)),
+              maxBlocks_(std::max<std::int64_t>(1, cacheSize / blockSize_)),
+              readaheadBlocks_(readaheadBlocks)
+        {
+            if (cacheSize < 0 || readaheadBlocks < 0) {
+                throw std::runtime_error("Cache size and readahead must be positive or null");
+            }
+        }
+
+    private:
+        // Called from the initializer list, as the block count depends on it
+        static std::int64_t ValidateBlockSize(const std::int64_t blockSize)
+        {
+            if (blockSize <= 0) {
+                throw std::runtime_error("Block size must be positive");
+            }
+
+            return blockSize;
+        }
+
+        struct Block
+        {
+            std::vector<unsigned char> data;
+            std::list<std::int64_t>::iterator lruPosition;
+        };
+
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            std::int64_t bytesRead = 0;
+
+            while (bytesRead < count) {
+                const auto position = offset + bytesRead;
+                const auto blockIndex = position / blockSize_;
+                const auto lastBlockIndex = (offset + count - 1) / blockSize_;
+
+                const Block* block = FindBlock(blockIndex);
+                if (block == nullptr) {
+                    block = LoadBlocks(blockIndex, lastBlockIndex);
+                }
+
+                const auto blockOffset = position - blockIndex * blockSize_;
+                const std::int64_t blockSize = block->data.size();
+                if (blockOffset >= blockSize) {
+                    // End of the stream
+                    break;
+                }
+
+                const auto n = std::min(count - bytesRead, blockSize - blockOffset);
+                ::memcpy(static_cast<unsigned char*>(buffer) + bytesRead,
+                         block->data.data() + blockOffset,
+                         n);
+                bytesRead += n;
+
+                if (blockSize < blockSize_) {
+                    break;
+                }
+            }
+
+            return bytesRead;
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            if (count > 0) {
+                const auto first = blocks_.lower_bound(offset / blockSize_);
+                const auto last = blocks_.upper_bound((offset + count - 1) / blockSize_);
+                for (auto it = first; it != last;) {
+                    it = EraseBlock(it);
+                }
+
+                // Partial blocks at the end of the stream may grow with any
+                // write past them
+                while (!partialBlocks_.empty()) {
+                    EraseBlock(blocks_.find(*partialBlocks_.begin()));
+                }
+            }
+
+            return inner_->Write(offset, count, buffer);
+        }
+
+        /**
+        Return the block if it's cached, and mark it as most recently used.
+        */
+        const Block* FindBlock(const std::int64_t blockIndex)
+        {
+            auto it = blocks_.find(blockIndex);
+            if (it == blocks_.end()) {
+                return nullptr;
+            }
+
+            lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+            return &it->second;
+        }
+
+        /**
+        Load blockIndex and all following blocks up to lastBlockIndex (plus
+        readahead for sequential access) which aren't cached yet, in a single
+        read from the inner stream. Returns the block at blockIndex.
+        */
+        const Block* LoadBlocks(const std::int64_t blockIndex, std::int64_t lastBlockIndex)
+        {
+            if (blockIndex == lastMissEnd_) {
+                lastBlockIndex += readaheadBlocks_;
+            }
+
+            // Don't load more blocks than fit into the cache
+            lastBlockIndex = std::min(lastBlockIndex, blockIndex + maxBlocks_ - 1);
+
+            auto endBlockIndex = blockIndex + 1;
+            while (endBlockIndex <= lastBlockIndex && blocks_.find(endBlockIndex) == blocks_.end()) {
+                ++endBlockIndex;
+            }
+
+            readBuffer_.resize((endBlockIndex - blockIndex) * blockSize_);
+            const auto bytesRead =
+                inner_->Read(blockIndex * blockSize_, readBuffer_.size(), readBuffer_.data());
+
+            lastMissEnd_ = endBlockIndex;
+
+            // Insert in reverse, so the requested block ends up as the most
+            // recently used one
+            for (auto i = endBlockIndex - 1; i >= blockIndex; --i) {
+                const auto start = (i - blockIndex) * blockSize_;
+                if (start >= bytesRead && i > blockIndex) {
+                    continue;
+                }
+
+                const auto end = std::min(start + blockSize_, bytesRead);
+                InsertBlock(i, readBuffer_.data() + start, std::max<std::int64_t>(0, end - start));
+            }
+
+            return &blocks_.find(blockIndex)->second;
+        }
+
+        void InsertBlock(const std::int64_t blockIndex,
+                         const unsigned char* data,
+                         const std::int64_t size)
+        {
+            while (static_cast<std::int64_t>(blocks_.size()) >= maxBlocks_) {
+                EraseBlock(blocks_.find(lru_.back()));
+            }
+
+            lru_.push_front(blockIndex);
+
+            Block& block = blocks_[blockIndex];
+            block.data.assign(data, data + size);
+            block.lruPosition = lru_.begin();
+
+            if (size < blockSize_) {
+                partialBlocks_.insert(blockIndex);
+            }
+        }
+
+        std::map<std::int64_t, Block>::iterator EraseBlock(
+            std::map<std::int64_t, Block>::iterator it)
+        {
+            partialBlocks_.erase(it->first);
+            lru_.erase(it->second.lruPosition);
+            return blocks_.erase(it);
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return inner_->GetSize();
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return inner_->CanWrite();
+        }
+
+        bool CanReadImpl() const override
+        {
+            return inner_->CanRead();
+        }
+
+        void FlushImpl() override
+        {
+            blocks_.clear();
+            partialBlocks_.clear();
+            lru_.clear();
+            lastMissEnd_ = -1;
+
+            inner_->Flush();
+        }
+
+        void CloseImpl() override
+        {
+            // The inner stream is owned by the caller
+            blocks_.clear();
+            partialBlocks_.clear();
+            lru_.clear();
+            inner_ = nullptr;
+        }
+
+        IStream* inner_;
+        std::int64_t blockSize_;
+        std::int64_t maxBlocks_;
+        std::int64_t readaheadBlocks_;
+
+        std::map<std::int64_t, Block> blocks_;
+        // Blocks which ended at the end of the stream when they were loaded
+        std::set<std::int64_t> partialBlocks_;
+        // Most recently used block first
+        std::list<std::int64_t> lru_;
+        std::vector<unsigned char> readBuffer_;
+        // One past the last block loaded by the previous miss
+        std::int64_t lastMissEnd_ = -1;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    /**
+    View of a range of another stream. Writes can't grow the view, and the
+    parent is left open when the view gets closed.
+    */
+    class SubStream final : public IStream
+    {
+    public:
+        SubStream(IStream* parent, const std::int64_t offset, const std::int64_t size)
+            : parent_(parent), offset_(offset), size_(size)
+        {
+            if (offset < 0 || size < 0 || offset > parent->GetSize() - size) {
+                throw std::runtime_error("Sub-stream range exceeds the parent stream");
+            }
+        }
+
+    private:
+        std::int64_t ReadImpl(const std::int64_t offset,
+                              const std::int64_t count,
+                              void* buffer) override
+        {
+            if (offset > size_) {
+                throw std::runtime_error("Read offset is out of bounds");
+            }
+
+            return parent_->Read(offset_ + offset, std::min(count, size_ - offset), buffer);
+        }
+
+        std::int64_t WriteImpl(const std::int64_t offset,
+                               const std::int64_t count,
+                               const void* buffer) override
+        {
+            if (offset > size_ - count) {
+                throw std::runtime_error("Write exceeds the sub-stream");
+            }
+
+            return parent_->Write(offset_ + offset, count, buffer);
+        }
+
+        std::int64_t GetSizeImpl() const override
+        {
+            return size_;
+        }
+
+        bool CanWriteImpl() const override
+        {
+            return parent_->CanWrite();
+        }
+
+        bool CanReadImpl() const override
+        {
+            return parent_->CanRead();
+        }
+
+        bool GetMemoryViewImpl(std::vector<MemorySegment>& segments) const override
+        {
+            std::vector<MemorySegment> parentSegments;
+            if (!parent_->GetMemoryView(parentSegments)) {
+                return false;
+            }
+
+            // Clip the parent segments to our range
+            std::int64_t segmentOffset = 0;
+            for (const auto& segment : parentSegments) {
+                const auto begin = std::max(segmentOffset, offset_);
+                const auto end = std::min(segmentOffset + segment.size, offset_ + size_);
+
+                if (begin < end) {
+                    segments.push_back(
+                        {static_cast<const unsigned char*>(segment.data) + (begin - segmentOffset),
+                         end - begin});
+                }
+
+                segmentOffset += segment.size;
+            }
+
+            return true;
+        }
+
+        void FlushImpl() override
+        {
+            parent_->Flush();
+        }
+
+        void CloseImpl() override
+        {
+            parent_ = nullptr;
+            size_ = 0;
+        }
+
+        IStream* parent_;
+        std::int64_t offset_;
+        std::int64_t size_;
+    };
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateSubStream(IStream* parent,
+                                             const std::int64_t offset,
+                                             const std::int64_t size)
+    {
+        return rdf_make_unique<SubStream>(parent, offset, size);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateCachedStream(IStream* inner,
+                                                const std::int64_t blockSize,
+                                                const std::int64_t cacheSize,
+                                                const std::int64_t readaheadBlocks)
+    {
+        return rdf_make_unique<CachedStream>(inner, blockSize, cacheSize, readaheadBlocks);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateReadOnlyMemoryStream(const std::int64_t size, const void* buffer)
+    {
+        return rdf_make_unique<ReadOnlyMemoryStream>(size, buffer);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateMemoryStream(const std::int64_t capacityHint)
+    {
+        return rdf_make_unique<MemoryStream>(capacityHint);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> OpenSharedFile(const char* filename,
+                                            rdfStreamAccess accessMode,
+                                            rdfFileMode fileMode)
+    {
+#if RDF_PLATFORM_WINDOWS
+        const char* mode = nullptr;
+
+        // For a shareable file on Windows, the file needs to be opened with the CreateFile() function.
+        unsigned long desired_access = 0;
+        unsigned long share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE;
+        unsigned long creation_disposition = 0;
+        unsigned long flags_and_attributes = FILE_ATTRIBUTE_NORMAL;
+
+        if (accessMode == rdfStreamAccess::rdfStreamAccessRead) {
+            desired_access |= GENERIC_READ;
+            if (fileMode == rdfFileModeOpen) {
+                creation_disposition = OPEN_EXISTING;
+                mode = "rb";
+            } else if (fileMode == rdfFileModeCreate) {
+                throw std::runtime_error("Cannot create file in read-only mode");
+            }
+        } else if (accessMode == rdfStreamAccess::rdfStreamAccessReadWrite) {
+            desired_access |= GENERIC_READ | GENERIC_WRITE;
+            if (fileMode == rdfFileModeOpen) {
+                creation_disposition = OPEN_EXISTING;
+                mode = "r+b";
+            } else if (fileMode == rdfFileModeCreate) {
+                creation_disposition = OPEN_EXISTING;
+                mode = "w+b";
+            }
+        } else {
+            assert(false);
+        }
+
+        HANDLE object_handle = ::CreateFile(filename,
+                                            desired_access,
+                                            share_mode,
+                                            NULL,
+                                            creation_disposition,
+                                            flags_and_attributes,
+                                            NULL);
+
+        // Convert the object handle to a file descriptor.
+        int file_handle = _open_osfhandle((intptr_t)object_handle, _O_BINARY);
+        auto fd = _fdopen(file_handle, mode);
+        if (fd == nullptr) {
+            CloseHandle(object_handle);
+            throw std::runtime_error("Error opening file");
+        }
+
+        // Disable inheritance of the file handle.
+        SetHandleInformation(object_handle, HANDLE_FLAG_INHERIT, 0);
+        return rdf_make_unique<Filestream>(fd, accessMode);
+#else
+        return OpenFile(filename, accessMode, fileMode);
+#endif  // #if RDF_PLATFORM_WINDOWS
+    }
+
+
+
+        std::unique_ptr<IStream> OpenFile(const char* filename,
+                                      rdfStreamAccess accessMode,
+                                      rdfFileMode fileMode)
+    {
+        const char* mode = nullptr;
+
+        if (accessMode == rdfStreamAccessRead) {
+            if (fileMode == rdfFileModeOpen) {
+                mode = "rb";
+            } else if (fileMode == rdfFileModeCreate) {
+                throw std::runtime_error("Cannot create file in read-only mode");
+            }
+        } else if (accessMode == rdfStreamAccessReadWrite) {
+            if (fileMode == rdfFileModeOpen) {
+                mode = "r+b";
+            } else if (fileMode == rdfFileModeCreate) {
+                mode = "w+b";
+            }
+        } else {
+            assert(false);
+        }
+
+        auto fd = std::fopen(filename, mode);
+        if (fd == nullptr) {
+            throw std::runtime_error("Could not open file");
+        }
+
+#if RDF_PLATFORM_WINDOWS
+        // Disable inheritance of the file handle.
+        SetHandleInformation((HANDLE)_get_osfhandle(_fileno(fd)), HANDLE_FLAG_INHERIT, 0);
+#endif  // #if RDF_PLATFORM_WINDOWS
+        return rdf_make_unique<Filestream>(fd, accessMode);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> OpenDirectFile(const char* filename,
+                                            rdfStreamAccess accessMode,
+                                            rdfFileMode fileMode)
+    {
+#if RDF_PLATFORM_UNIX
+        int flags = 0;
+
+        if (accessMode == rdfStreamAccessRead) {
+            if (fileMode == rdfFileModeCreate) {
+                throw std::runtime_error("Cannot create file in read-only mode");
+            }
+
+            flags = O_RDONLY;
+        } else if (accessMode == rdfStreamAccessReadWrite) {
+            flags = O_RDWR;
+            if (fileMode == rdfFileModeCreate) {
+                flags |= O_CREAT | O_TRUNC;
+            }
+        } else {
+            assert(false);
+        }
+
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#endif
+
+        const int fd = ::open(filename, flags | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            throw std::runtime_error("Could not open file");
+        }
+
+#ifdef F_NOCACHE
+        ::fcntl(fd, F_NOCACHE, 1);
+#endif
+
+        return rdf_make_unique<DirectFilestream>(fd, accessMode);
+#else
+        // Unbuffered I/O isn't implemented here, use the regular file stream
+        return OpenFile(filename, accessMode, fileMode);
+#endif  // #if RDF_PLATFORM_UNIX
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateSharedMemoryStream(const char* name,
+                                                      const std::int64_t capacityHint)
+    {
+#if RDF_PLATFORM_UNIX
+#if defined(__linux__)
+        const int fd = ::memfd_create(name != nullptr ? name : "rdf", MFD_CLOEXEC);
+#else
+        // No anonymous memory files here, use an unlinked temporary file
+        // instead, which can be shared the same way
+        (void)name;
+
+        const char* tmpDir = std::getenv("TMPDIR");
+        std::string path = std::string(tmpDir != nullptr ? tmpDir : "/tmp") + "/rdf-XXXXXX";
+
+        const int fd = ::mkstemp(&path[0]);
+        if (fd != -1) {
+            ::unlink(path.c_str());
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (fd == -1) {
+            throw std::runtime_error("Could not create shared memory");
+        }
+
+        std::unique_ptr<IStream> stream = rdf_make_unique<SharedMemoryStream>(fd);
+        if (capacityHint > 0) {
+            stream->Reserve(capacityHint);
+        }
+
+        return stream;
+#else
+        (void)name;
+        (void)capacityHint;
+        throw std::runtime_error("Shared memory streams are not supported on this platform");
+#endif  // #if RDF_PLATFORM_UNIX
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> MapFileDescriptor(const int fd)
+    {
+#if RDF_PLATFORM_UNIX
+        return rdf_make_unique<MappedStream>(fd);
+#else
+        (void)fd;
+        throw std::runtime_error("Mapping file descriptors is not supported on this platform");
+#endif  // #if RDF_PLATFORM_UNIX
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    std::unique_ptr<IStream> CreateFile(const char* filename)
+    {
+        // The stream reports read access, so the file must be readable too
+        auto fd = std::fopen(filename, "w+b");
+        if (fd == nullptr) {
+            throw std::runtime_error("Could not create file");
+        }
+#if RDF_PLATFORM_WINDOWS
+        else {
+            // Disable inheritance of the file handle.
+            SetHandleInformation((HANDLE)_get_osfhandle(_fileno(fd)), HANDLE_FLAG_INHERIT, 0);
+        }
+#endif // #if RDF_PLATFORM_WINDOWS
+        return rdf_make_unique<Filestream>(fd, rdfStreamAccessReadWrite);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    bool IChunkFileIterator::IsAtEnd() const
+    {
+        return IsAtEndImpl();
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    void IChunkFileIterator::Advance()
+    {
+        return AdvanceImpl();
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    void IChunkFileIterator::Get(char identifier[RDF_IDENTIFIER_SIZE], int* index) const
+    {
+        GetImpl(identifier, index);
+    }
+}  // namespace internal
+}  // namespace rdf
+
+#define RDF_C_API_BEGIN \
+    try {
+#define RDF_C_API_END                     \
+    }                                     \
+    catch (...) {                         \
+        return rdfResult::rdfResultError; \
+    }
+
+struct rdfChunkFile
+{
+    std::unique_ptr<rdf::internal::ChunkFile> chunkFile;
+};
+
+struct rdfStream
+{
+    std::unique_ptr<rdf::internal::IStream> stream;
+
+    // This is a backwards-compatibility shim
+    int64_t filePointer = 0;
+};
+
+struct rdfChunkFileIterator
+{
+    std::unique_ptr<rdf::internal::IChunkFileIterator> iterator;
+};
+
+struct rdfChunkFileWriter
+{
+    std::unique_ptr<rdf::internal::ChunkFileWriter> writer;
+};
+
+struct rdfChunkWriter
+{
+    std::unique_ptr<rdf::internal::ChunkWriter> chunk;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a stream from a file.
+
+This is the most generic function to create a stream from a file, allowing
+to open an existing file for read/write or create a new one.
+
+The creation file mode requires read/write access, as creating a new file
+for read-only would result in an unusable stream.
+*/
+int RDF_EXPORT rdfStreamFromFile(const rdfStreamFromFileCreateInfo* info, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (info == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (info->filename == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        if (info->directIO)
+        {
+            (*handle)->stream =
+                rdf::internal::OpenDirectFile(info->filename, info->accessMode, info->fileMode);
+        }
+        else if (info->is_shareable)
+        {
+            (*handle)->stream =
+                rdf::internal::OpenSharedFile(info->filename, info->accessMode, info->fileMode);
+        }
+        else
+        {
+            (*handle)->stream =
+                rdf::internal::OpenFile(info->filename, info->accessMode, info->fileMode);
+        }
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Open a file for reading.
+
+This creates a new stream from the given file path.
+*/
+int RDF_EXPORT rdfStreamOpenFile(const char* filename, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::OpenFile(filename, rdfStreamAccessRead, rdfFileModeOpen);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a new file and open it for read/write access.
+
+This creates a new stream which points to a newly created file.
+*/
+int RDF_EXPORT rdfStreamCreateFile(const char* filename, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateFile(filename);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a stream from read-only memory.
+
+This creates a new stream which is backed by the provided memory. This is
+useful for testing, as you can load data directly from memory.
+*/
+int RDF_EXPORT rdfStreamFromReadOnlyMemory(const std::int64_t size,
+                                           const void* data,
+                                           rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (size < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateReadOnlyMemoryStream(size, data);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a read/write in-memory stream.
+
+This is useful to stage data in memory -- for example for tests, or to
+prepare data before writing to disk.
+*/
+int RDF_EXPORT rdfStreamCreateMemoryStream(rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateMemoryStream();
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a stream which caches reads from another stream.
+
+Reads are served in blocks of blockSize bytes from an LRU cache holding up to
+cacheSize bytes. Missing blocks are fetched with as few reads as possible, and
+sequential misses fetch readaheadBlocks more blocks. Writes are passed through.
+
+The inner stream must stay open until the cached stream has been closed, and
+must not be modified through other handles in the meantime.
+*/
+int RDF_EXPORT rdfStreamCreateCachedStream(const rdfCachedStreamCreateInfo* info,
+                                           rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (info == nullptr || info->stream == nullptr || handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (info->blockSize <= 0 || info->cacheSize < 0 || info->readaheadBlocks < 0) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateCachedStream(info->stream->stream.get(),
+                                                              info->blockSize,
+                                                              info->cacheSize,
+                                                              info->readaheadBlocks);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a read/write in-memory stream with a capacity hint.
+
+Memory for capacityHint bytes is allocated up front, in one piece. Growing
+the stream past that allocates more memory but never copies existing data.
+*/
+int RDF_EXPORT rdfStreamCreateMemoryStream2(const rdfMemoryStreamCreateInfo* info,
+                                            rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (info == nullptr || handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (info->capacityHint < 0) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateMemoryStream(info->capacityHint);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a read/write stream on anonymous shared memory (memfd on Linux.)
+
+Its file descriptor can be passed to other processes, which can then map the
+contents using rdfStreamMapFileDescriptor.
+*/
+int RDF_EXPORT rdfStreamCreateSharedMemoryStream(const rdfSharedMemoryStreamCreateInfo* info,
+                                                 rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (info == nullptr || handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (info->capacityHint < 0) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream =
+            rdf::internal::CreateSharedMemoryStream(info->name, info->capacityHint);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a read-only stream by mapping a file descriptor into memory.
+
+The mapping covers the size of the file at the time of the call. The stream
+doesn't take ownership of the descriptor, which can be closed right away.
+*/
+int RDF_EXPORT rdfStreamMapFileDescriptor(const int fd, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (fd < 0 || handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::MapFileDescriptor(fd);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a stream covering size bytes of another stream, starting at offset.
+
+The range must lie within the parent stream. The parent must stay open until
+the sub-stream has been closed.
+*/
+int RDF_EXPORT rdfStreamCreateSubStream(rdfStream* parent,
+                                        const std::int64_t offset,
+                                        const std::int64_t size,
+                                        rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (parent == nullptr || handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (offset < 0 || size < 0 || offset > parent->stream->GetSize() - size) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::CreateSubStream(parent->stream.get(), offset, size);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int RDF_EXPORT rdfStreamCreateFromUserStream(const rdfUserStream* userStream, rdfStream** handle)
+{
+    return rdfStreamFromUserStream(userStream, handle);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a memory stream based on user provided callbacks.
+*/
+int RDF_EXPORT rdfStreamFromUserStream(const rdfUserStream* userStream, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (userStream == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream = rdf::internal::rdf_make_unique<rdf::internal::UserStream>(*userStream);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a stream based on user provided positional callbacks.
+
+Unlike rdfStreamFromUserStream, no Seek/Tell callbacks are needed, as every
+read and write passes its offset directly.
+*/
+int RDF_EXPORT rdfStreamFromUserStream2(const rdfUserStream2* userStream, rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (userStream == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    if (handle == nullptr) {
+        return rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfStream;
+    try {
+        (*handle)->stream =
+            rdf::internal::rdf_make_unique<rdf::internal::UserStream2>(*userStream);
+    } catch (...) {
+        delete *handle;
+        *handle = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Close and destroy a stream.
+
+The handle will be reset.
+*/
+int RDF_EXPORT rdfStreamClose(rdfStream** handle)
+{
+    RDF_C_API_BEGIN
+
+    if (handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (*handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    (*handle)->stream->Close();
+
+    delete *handle;
+    *handle = nullptr;
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Read a number of bytes from the stream.
+
+If bytesRead is non-null, the number of bytes read will be stored there.
+*/
+int RDF_EXPORT rdfStreamRead(rdfStream* stream,
+                             const std::int64_t count,
+                             void* buffer,
+                             std::int64_t* bytesRead)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (count < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    auto read = stream->stream->Read(stream->filePointer, count, buffer);
+    stream->filePointer += read;
+
+    if (bytesRead) {
+        *bytesRead = read;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Write a number of bytes to the stream.
+
+If bytesWritten is non-null, the number of bytes written will be stored there.
+*/
+int RDF_EXPORT rdfStreamWrite(rdfStream* stream,
+                              const std::int64_t count,
+                              const void* buffer,
+                              std::int64_t* bytesWritten)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (count < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (!stream->stream->CanWrite()) {
+        return rdfResult::rdfResultError;
+    }
+
+    auto written = stream->stream->Write(stream->filePointer, count, buffer);
+    stream->filePointer += written;
+    if (bytesWritten) {
+        *bytesWritten = written;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+int RDF_EXPORT rdfStreamTell(rdfStream* stream, std::int64_t* position)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
+    if (position == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
 
+    *position = stream->filePointer;
 
-        std::unique_ptr<IStream> OpenFile(const char* filename,
-                                      rdfStreamAccess accessMode,
-                                      rdfFileMode fileMode)
-    {
-        const char* mode = nullptr;
+    return rdfResult::rdfResultOk;
 
-        if (accessMode == rdfStreamAccessRead) {
-            if (fileMode == rdfFileModeOpen) {
-                mode = "rb";
-            } else if (fileMode == rdfFileModeCreate) {
-                throw std::runtime_error("Cannot create file in read-only mode");
-            }
-        } else if (accessMode == rdfStreamAccessReadWrite) {
-            if (fileMode == rdfFileModeOpen) {
-                mode = "r+b";
-            } else if (fileMode == rdfFileModeCreate) {
-                mode = "w+b";
-            }
-        } else {
-            assert(false);
-        }
+    RDF_C_API_END
+}
 
-        auto fd = std::fopen(filename, mode);
-        if (fd == nullptr) {
-            throw std::runtime_error("Could not open file");
-        }
+//////////////////////////////////////////////////////////////////////////////
+/**
+Set the current stream position.
+*/
+int RDF_EXPORT rdfStreamSeek(rdfStream* stream, const std::int64_t offset)
+{
+    RDF_C_API_BEGIN
 
-#if RDF_PLATFORM_WINDOWS
-        // Disable inheritance of the file handle.
-        SetHandleInformation((HANDLE)_get_osfhandle(_fileno(fd)), HANDLE_FLAG_INHERIT, 0);
-#endif  // #if RDF_PLATFORM_WINDOWS
-        return rdf_make_unique<Filestream>(fd, accessMode);
+    if (stream == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    //////////////////////////////////////////////////////////////////////
-    std::unique_ptr<IStream> CreateFile(const char* filename)
-    {
-        auto fd = std::fopen(filename, "wb");
-        if (fd == nullptr) {
-            throw std::runtime_error("Could not create file");
-        }
-#if RDF_PLATFORM_WINDOWS
-        else {
-            // Disable inheritance of the file handle.
-            SetHandleInformation((HANDLE)_get_osfhandle(_fileno(fd)), HANDLE_FLAG_INHERIT, 0);
-        }
-#endif // #if RDF_PLATFORM_WINDOWS
-        return rdf_make_unique<Filestream>(fd, rdfStreamAccessReadWrite);
+    if (offset < 0) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    ///////////////////////////////////////////////////////////////////////////
-    bool IChunkFileIterator::IsAtEnd() const
-    {
-        return IsAtEndImpl();
+    stream->filePointer = offset;
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Get the size of the stream.
+*/
+int RDF_EXPORT rdfStreamGetSize(rdfStream* stream, std::int64_t* size)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    ///////////////////////////////////////////////////////////////////////////
-    void IChunkFileIterator::Advance()
-    {
-        return AdvanceImpl();
+    if (size == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    ///////////////////////////////////////////////////////////////////////////
-    void IChunkFileIterator::Get(char identifier[RDF_IDENTIFIER_SIZE], int* index) const
-    {
-        GetImpl(identifier, index);
+    *size = stream->stream->GetSize();
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Get pointers to the contents of a memory stream, without copying them.
+
+If segments is null, only the number of segments is returned. Otherwise,
+segmentCount must hold the capacity of segments on input, which must be large
+enough for all segments. Only memory streams support this.
+*/
+int RDF_EXPORT rdfStreamGetMemoryView(rdfStream* stream,
+                                      std::int64_t* segmentCount,
+                                      rdfMemorySegment* segments)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr || segmentCount == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
-}  // namespace internal
-}  // namespace rdf
 
-#define RDF_C_API_BEGIN \
-    try {
-#define RDF_C_API_END                     \
-    }                                     \
-    catch (...) {                         \
-        return rdfResult::rdfResultError; \
+    std::vector<rdf::internal::IStream::MemorySegment> view;
+    if (!stream->stream->GetMemoryView(view)) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-struct rdfChunkFile
-{
-    std::unique_ptr<rdf::internal::ChunkFile> chunkFile;
-};
+    if (segments != nullptr) {
+        if (*segmentCount < static_cast<std::int64_t>(view.size())) {
+            return rdfResult::rdfResultInvalidArgument;
+        }
 
-struct rdfStream
-{
-    std::unique_ptr<rdf::internal::IStream> stream;
+        for (std::size_t i = 0; i < view.size(); ++i) {
+            segments[i].data = view[i].data;
+            segments[i].size = view[i].size;
+        }
+    }
 
-    // This is a backwards-compatibility shim
-    int64_t filePointer = 0;
-};
+    *segmentCount = static_cast<std::int64_t>(view.size());
 
-struct rdfChunkFileIterator
-{
-    std::unique_ptr<rdf::internal::IChunkFileIterator> iterator;
-};
+    return rdfResult::rdfResultOk;
 
-struct rdfChunkFileWriter
-{
-    std::unique_ptr<rdf::internal::ChunkFileWriter> writer;
-};
+    RDF_C_API_END
+}
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a stream from a file.
+Take ownership of the contents of a memory stream, leaving it empty.
 
-This is the most generic function to create a stream from a file, allowing
-to open an existing file for read/write or create a new one.
-
-The creation file mode requires read/write access, as creating a new file
-for read-only would result in an unusable stream.
+Contents which fit into one segment are handed over without copying, others
+are gathered into one buffer, releasing the segments while copying. The
+buffer must be freed using rdfStreamFreeMemoryBuffer. Empty streams return a
+null buffer.
 */
-int RDF_EXPORT rdfStreamFromFile(const rdfStreamFromFileCreateInfo* info, rdfStream** handle)
+int RDF_EXPORT rdfStreamDetachMemoryBuffer(rdfStream* stream,
+                                           void** buffer,
+                                           std::int64_t* size)
 {
     RDF_C_API_BEGIN
 
-    if (info == nullptr) {
-        return rdfResultInvalidArgument;
+    if (stream == nullptr || buffer == nullptr || size == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (info->filename == nullptr) {
-        return rdfResultInvalidArgument;
+    std::unique_ptr<unsigned char[]> memory;
+    std::int64_t memorySize = 0;
+    if (!stream->stream->DetachMemoryBuffer(memory, memorySize)) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (handle == nullptr) {
-        return rdfResultInvalidArgument;
+    // The stream is empty now, so the shim has to start over as well
+    stream->filePointer = 0;
+
+    *buffer = memory.release();
+    *size = memorySize;
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Get the file descriptor of a shared memory stream. It remains owned by the
+stream.
+*/
+int RDF_EXPORT rdfStreamGetFileDescriptor(rdfStream* stream, int* fd)
+{
+    RDF_C_API_BEGIN
+
+    if (stream == nullptr || fd == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    *handle = new rdfStream;
-    try {
-        if (info->is_shareable)
-        {
-            (*handle)->stream =
-                rdf::internal::OpenSharedFile(info->filename, info->accessMode, info->fileMode);
-        }
-        else
-        {
-            (*handle)->stream =
-                rdf::internal::OpenFile(info->filename, info->accessMode, info->fileMode);
-        }
-    } catch (...) {
-        delete *handle;
-        *handle = nullptr;
-        throw;
+    const int result = stream->stream->GetFileDescriptor();
+    if (result == -1) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
+    *fd = result;
+
     return rdfResult::rdfResultOk;
 
     RDF_C_API_END
@@ -1285,21 +6061,31 @@ int RDF_EXPORT rdfStreamFromFile(const rdfStreamFromFileCreateInfo* info, rdfStr
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Open a file for reading.
-
-This creates a new stream from the given file path.
+Free a buffer returned by rdfStreamDetachMemoryBuffer.
 */
-int RDF_EXPORT rdfStreamOpenFile(const char* filename, rdfStream** handle)
+int RDF_EXPORT rdfStreamFreeMemoryBuffer(void* buffer)
 {
     RDF_C_API_BEGIN
 
-    if (handle == nullptr) {
-        return rdfResultInvalidArgument;
-    }
+    delete[] static_cast<unsigned char*>(buffer);
 
-    *handle = new rdfStream;
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Create a read-only chunk file from an existing file.
+*/
+int RDF_EXPORT rdfChunkFileOpenFile(const char* filename, rdfChunkFile** handle)
+{
+    RDF_C_API_BEGIN
+
+    *handle = new rdfChunkFile;
     try {
-        (*handle)->stream = rdf::internal::OpenFile(filename, rdfStreamAccessRead, rdfFileModeOpen);
+        (*handle)->chunkFile.reset(new rdf::internal::ChunkFile(
+            rdf::internal::OpenFile(filename, rdfStreamAccessRead, rdfFileModeOpen)));
     } catch (...) {
         delete *handle;
         *handle = nullptr;
@@ -1313,21 +6099,15 @@ int RDF_EXPORT rdfStreamOpenFile(const char* filename, rdfStream** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a new file and open it for read/write access.
-
-This creates a new stream which points to a newly created file.
+Create a read-only chunk file from an existing stream.
 */
-int RDF_EXPORT rdfStreamCreateFile(const char* filename, rdfStream** handle)
+int RDF_EXPORT rdfChunkFileOpenStream(rdfStream* stream, rdfChunkFile** handle)
 {
     RDF_C_API_BEGIN
 
-    if (handle == nullptr) {
-        return rdfResultInvalidArgument;
-    }
-
-    *handle = new rdfStream;
+    *handle = new rdfChunkFile;
     try {
-        (*handle)->stream = rdf::internal::CreateFile(filename);
+        (*handle)->chunkFile.reset(new rdf::internal::ChunkFile(stream->stream.get()));
     } catch (...) {
         delete *handle;
         *handle = nullptr;
@@ -1341,32 +6121,23 @@ int RDF_EXPORT rdfStreamCreateFile(const char* filename, rdfStream** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a stream from read-only memory.
+Re-read the index of a file which is still being written.
 
-This creates a new stream which is backed by the provided memory. This is
-useful for testing, as you can load data directly from memory.
+updated is set to 1 if new chunks were found, and 0 otherwise. It can be
+null. Iterators created before an update must not be used afterwards.
 */
-int RDF_EXPORT rdfStreamFromReadOnlyMemory(const std::int64_t size,
-                                           const void* data,
-                                           rdfStream** handle)
+int RDF_EXPORT rdfChunkFileRefresh(rdfChunkFile* handle, int* updated)
 {
     RDF_C_API_BEGIN
 
-    if (size < 0) {
-        return rdfResult::rdfResultInvalidArgument;
-    }
-
     if (handle == nullptr) {
-        return rdfResultInvalidArgument;
+        return rdfResult::rdfResultInvalidArgument;
     }
-
-    *handle = new rdfStream;
-    try {
-        (*handle)->stream = rdf::internal::CreateReadOnlyMemoryStream(size, data);
-    } catch (...) {
-        delete *handle;
-        *handle = nullptr;
-        throw;
+
+    const bool result = handle->chunkFile->Refresh();
+
+    if (updated) {
+        *updated = result ? 1 : 0;
     }
 
     return rdfResult::rdfResultOk;
@@ -1376,22 +6147,34 @@ int RDF_EXPORT rdfStreamFromReadOnlyMemory(const std::int64_t size,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a read/write in-memory stream.
+Open several streams as one chunk file.
 
-This is useful to stage data in memory -- for example for tests, or to
-prepare data before writing to disk.
+Chunks with the same identifier are numbered consecutively across the streams,
+in the order given. All streams must stay open until the chunk file has been
+closed.
 */
-int RDF_EXPORT rdfStreamCreateMemoryStream(rdfStream** handle)
+int RDF_EXPORT rdfChunkFileOpenMulti(rdfStream** streams,
+                                     const int streamCount,
+                                     rdfChunkFile** handle)
 {
     RDF_C_API_BEGIN
 
-    if (handle == nullptr) {
-        return rdfResultInvalidArgument;
+    if (streams == nullptr || streamCount <= 0 || handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    *handle = new rdfStream;
+    std::vector<rdf::internal::IStream*> inputs;
+    for (int i = 0; i < streamCount; ++i) {
+        if (streams[i] == nullptr) {
+            return rdfResult::rdfResultInvalidArgument;
+        }
+
+        inputs.push_back(streams[i]->stream.get());
+    }
+
+    *handle = new rdfChunkFile;
     try {
-        (*handle)->stream = rdf::internal::CreateMemoryStream();
+        (*handle)->chunkFile.reset(new rdf::internal::ChunkFile(inputs));
     } catch (...) {
         delete *handle;
         *handle = nullptr;
@@ -1403,31 +6186,40 @@ int RDF_EXPORT rdfStreamCreateMemoryStream(rdfStream** handle)
     RDF_C_API_END
 }
 
-//////////////////////////////////////////////////////////////////////////////
-int RDF_EXPORT rdfStreamCreateFromUserStream(const rdfUserStream* userStream, rdfStream** handle)
-{
-    return rdfStreamFromUserStream(userStream, handle);
-}
-
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a memory stream based on user provided callbacks.
+Open the data of an uncompressed chunk as a chunk file, without copying it.
+
+The outer chunk file, and its stream, must stay open until the returned chunk
+file has been closed.
 */
-int RDF_EXPORT rdfStreamFromUserStream(const rdfUserStream* userStream, rdfStream** handle)
+int RDF_EXPORT rdfChunkFileOpenChunkAsFile(rdfChunkFile* outer,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           rdfChunkFile** handle)
 {
     RDF_C_API_BEGIN
 
-    if (userStream == nullptr) {
-        return rdfResultInvalidArgument;
+    if (outer == nullptr || chunkId == nullptr || handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (handle == nullptr) {
-        return rdfResultInvalidArgument;
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
-    *handle = new rdfStream;
+    if (!outer->chunkFile->ContainsChunk(chunkId, chunkIndex)) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (outer->chunkFile->GetChunkInfo(chunkId, chunkIndex).compression !=
+        rdf::internal::Compression::None) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    *handle = new rdfChunkFile;
     try {
-        (*handle)->stream = rdf::internal::rdf_make_unique<rdf::internal::UserStream>(*userStream);
+        (*handle)->chunkFile = outer->chunkFile->OpenChunkAsFile(chunkId, chunkIndex);
     } catch (...) {
         delete *handle;
         *handle = nullptr;
@@ -1441,26 +6233,20 @@ int RDF_EXPORT rdfStreamFromUserStream(const rdfUserStream* userStream, rdfStrea
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Close and destroy a stream.
+Copy the chunks of input to output, leaving out unused space. input and output
+may be the same stream to compact a file in place.
 
-The handle will be reset.
+@since 1.5
 */
-int RDF_EXPORT rdfStreamClose(rdfStream** handle)
+int RDF_EXPORT rdfChunkFileCompact(rdfStream* input, rdfStream* output)
 {
     RDF_C_API_BEGIN
 
-    if (handle == nullptr) {
-        return rdfResult::rdfResultInvalidArgument;
-    }
-
-    if (*handle == nullptr) {
+    if (input == nullptr || output == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    (*handle)->stream->Close();
-
-    delete *handle;
-    *handle = nullptr;
+    rdf::internal::CompactChunkFile(input->stream.get(), output->stream.get());
 
     return rdfResult::rdfResultOk;
 
@@ -1469,31 +6255,24 @@ int RDF_EXPORT rdfStreamClose(rdfStream** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Read a number of bytes from the stream.
+Close a chunk file.
 
-If bytesRead is non-null, the number of bytes read will be stored there.
+This resets the handle as well.
 */
-int RDF_EXPORT rdfStreamRead(rdfStream* stream,
-                             const std::int64_t count,
-                             void* buffer,
-                             std::int64_t* bytesRead)
+int RDF_EXPORT rdfChunkFileClose(rdfChunkFile** handle)
 {
     RDF_C_API_BEGIN
 
-    if (stream == nullptr) {
+    if (handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (count < 0) {
+    if (*handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    auto read = stream->stream->Read(stream->filePointer, count, buffer);
-    stream->filePointer += read;
-
-    if (bytesRead) {
-        *bytesRead = read;
-    }
+    delete *handle;
+    *handle = nullptr;
 
     return rdfResult::rdfResultOk;
 
@@ -1502,53 +6281,32 @@ int RDF_EXPORT rdfStreamRead(rdfStream* stream,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Write a number of bytes to the stream.
-
-If bytesWritten is non-null, the number of bytes written will be stored there.
+Get the version field of a chunk stored in the chunk file.
 */
-int RDF_EXPORT rdfStreamWrite(rdfStream* stream,
-                              const std::int64_t count,
-                              const void* buffer,
-                              std::int64_t* bytesWritten)
+int RDF_EXPORT rdfChunkFileGetChunkVersion(rdfChunkFile* handle,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           std::uint32_t* chunkVersion)
 {
     RDF_C_API_BEGIN
 
-    if (stream == nullptr) {
+    if (handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (count < 0) {
+    if (chunkId == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (!stream->stream->CanWrite()) {
-        return rdfResult::rdfResultError;
-    }
-
-    auto written = stream->stream->Write(stream->filePointer, count, buffer);
-    stream->filePointer += written;
-    if (bytesWritten) {
-        *bytesWritten = written;
-    }
-
-    return rdfResult::rdfResultOk;
-
-    RDF_C_API_END
-}
-
-int RDF_EXPORT rdfStreamTell(rdfStream* stream, std::int64_t* position)
-{
-    RDF_C_API_BEGIN
-
-    if (stream == nullptr) {
+    if (chunkIndex < 0) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (position == nullptr) {
+    if (chunkVersion == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *position = stream->filePointer;
+    *chunkVersion = handle->chunkFile->GetChunkVersion(chunkId, chunkIndex);
 
     return rdfResult::rdfResultOk;
 
@@ -1557,21 +6315,35 @@ int RDF_EXPORT rdfStreamTell(rdfStream* stream, std::int64_t* position)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Set the current stream position.
+Get the compression a chunk is stored with.
+
+@since 1.5
 */
-int RDF_EXPORT rdfStreamSeek(rdfStream* stream, const std::int64_t offset)
+int RDF_EXPORT rdfChunkFileGetChunkCompression(rdfChunkFile* handle,
+                                               const char* chunkId,
+                                               const int chunkIndex,
+                                               rdfCompression* compression)
 {
     RDF_C_API_BEGIN
 
-    if (stream == nullptr) {
+    if (handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (offset < 0) {
+    if (chunkId == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    stream->filePointer = offset;
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (compression == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    *compression = static_cast<rdfCompression>(
+        handle->chunkFile->GetChunkInfo(chunkId, chunkIndex).compression);
 
     return rdfResult::rdfResultOk;
 
@@ -1580,21 +6352,33 @@ int RDF_EXPORT rdfStreamSeek(rdfStream* stream, const std::int64_t offset)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Get the size of the stream.
+Read the data stored in a chunk into the provided buffer.
+
+The correct buffer size can be obtained using rdfChunkFileGetChunkDataSize. The
+user must allocate at least that many bytes.
+
+If the chunk data size is 0, passing a nullptr as the buffer is valid.
 */
-int RDF_EXPORT rdfStreamGetSize(rdfStream* stream, std::int64_t* size)
+int RDF_EXPORT rdfChunkFileReadChunkData(rdfChunkFile* handle,
+                                         const char* chunkId,
+                                         const int chunkIndex,
+                                         void* buffer)
 {
     RDF_C_API_BEGIN
 
-    if (stream == nullptr) {
+    if (handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (size == nullptr) {
+    if (chunkId == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *size = stream->stream->GetSize();
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    handle->chunkFile->ReadChunkData(chunkId, chunkIndex, buffer);
 
     return rdfResult::rdfResultOk;
 
@@ -1603,22 +6387,34 @@ int RDF_EXPORT rdfStreamGetSize(rdfStream* stream, std::int64_t* size)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a read-only chunk file from an existing file.
+Read the chunk header into the provided buffer.
+
+The correct buffer size can be obtained using rdfChunkFileGetChunkHeaderSize. The
+user must allocate at least that many bytes.
+
+If the chunk data size is 0, passing a nullptr as the buffer is valid.
 */
-int RDF_EXPORT rdfChunkFileOpenFile(const char* filename, rdfChunkFile** handle)
+int RDF_EXPORT rdfChunkFileReadChunkHeader(rdfChunkFile* handle,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           void* buffer)
 {
     RDF_C_API_BEGIN
 
-    *handle = new rdfChunkFile;
-    try {
-        (*handle)->chunkFile.reset(new rdf::internal::ChunkFile(
-            rdf::internal::OpenFile(filename, rdfStreamAccessRead, rdfFileModeOpen)));
-    } catch (...) {
-        delete *handle;
-        *handle = nullptr;
-        throw;
+    if (handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
+    if (chunkId == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    handle->chunkFile->ReadChunkHeader(chunkId, chunkIndex, buffer);
+
     return rdfResult::rdfResultOk;
 
     RDF_C_API_END
@@ -1626,21 +6422,21 @@ int RDF_EXPORT rdfChunkFileOpenFile(const char* filename, rdfChunkFile** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Create a read-only chunk file from an existing stream.
+Read all chunk headers into memory.
+
+Subsequent calls to rdfChunkFileReadChunkHeader copy from memory, and
+rdfChunkFileGetChunkHeader can be used to access the headers directly.
 */
-int RDF_EXPORT rdfChunkFileOpenStream(rdfStream* stream, rdfChunkFile** handle)
+int RDF_EXPORT rdfChunkFileLoadAllHeaders(rdfChunkFile* handle)
 {
     RDF_C_API_BEGIN
 
-    *handle = new rdfChunkFile;
-    try {
-        (*handle)->chunkFile.reset(new rdf::internal::ChunkFile(stream->stream.get()));
-    } catch (...) {
-        delete *handle;
-        *handle = nullptr;
-        throw;
+    if (handle == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
     }
 
+    handle->chunkFile->LoadAllHeaders();
+
     return rdfResult::rdfResultOk;
 
     RDF_C_API_END
@@ -1648,11 +6444,14 @@ int RDF_EXPORT rdfChunkFileOpenStream(rdfStream* stream, rdfChunkFile** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Close a chunk file.
+Get a pointer to a chunk header loaded with rdfChunkFileLoadAllHeaders.
 
-This resets the handle as well.
+The header is set to null for chunks with an empty header.
 */
-int RDF_EXPORT rdfChunkFileClose(rdfChunkFile** handle)
+int RDF_EXPORT rdfChunkFileGetChunkHeader(rdfChunkFile* handle,
+                                          const char* chunkId,
+                                          const int chunkIndex,
+                                          const void** header)
 {
     RDF_C_API_BEGIN
 
@@ -1660,12 +6459,19 @@ int RDF_EXPORT rdfChunkFileClose(rdfChunkFile** handle)
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (*handle == nullptr) {
+    if (chunkId == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    delete *handle;
-    *handle = nullptr;
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (header == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    *header = handle->chunkFile->GetChunkHeader(chunkId, chunkIndex);
 
     return rdfResult::rdfResultOk;
 
@@ -1674,12 +6480,12 @@ int RDF_EXPORT rdfChunkFileClose(rdfChunkFile** handle)
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Get the version field of a chunk stored in the chunk file.
+Get the size of the chunk header.
 */
-int RDF_EXPORT rdfChunkFileGetChunkVersion(rdfChunkFile* handle,
-                                           const char* chunkId,
-                                           const int chunkIndex,
-                                           std::uint32_t* chunkVersion)
+int RDF_EXPORT rdfChunkFileGetChunkHeaderSize(rdfChunkFile* handle,
+                                              const char* chunkId,
+                                              const int chunkIndex,
+                                              std::int64_t* size)
 {
     RDF_C_API_BEGIN
 
@@ -1695,11 +6501,11 @@ int RDF_EXPORT rdfChunkFileGetChunkVersion(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (chunkVersion == nullptr) {
+    if (size == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *chunkVersion = handle->chunkFile->GetChunkVersion(chunkId, chunkIndex);
+    *size = handle->chunkFile->GetChunkHeaderSize(chunkId, chunkIndex);
 
     return rdfResult::rdfResultOk;
 
@@ -1708,17 +6514,12 @@ int RDF_EXPORT rdfChunkFileGetChunkVersion(rdfChunkFile* handle,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Read the data stored in a chunk into the provided buffer.
-
-The correct buffer size can be obtained using rdfChunkFileGetChunkDataSize. The
-user must allocate at least that many bytes.
-
-If the chunk data size is 0, passing a nullptr as the buffer is valid.
+Get the size of the chunk data.
 */
-int RDF_EXPORT rdfChunkFileReadChunkData(rdfChunkFile* handle,
-                                         const char* chunkId,
-                                         const int chunkIndex,
-                                         void* buffer)
+int RDF_EXPORT rdfChunkFileGetChunkDataSize(rdfChunkFile* handle,
+                                            const char* chunkId,
+                                            const int chunkIndex,
+                                            std::int64_t* size)
 {
     RDF_C_API_BEGIN
 
@@ -1734,26 +6535,24 @@ int RDF_EXPORT rdfChunkFileReadChunkData(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    handle->chunkFile->ReadChunkData(chunkId, chunkIndex, buffer);
+    if (size == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    *size = handle->chunkFile->GetChunkDataSize(chunkId, chunkIndex);
 
     return rdfResult::rdfResultOk;
 
     RDF_C_API_END
 }
 
-//////////////////////////////////////////////////////////////////////////////
-/**
-Read the chunk header into the provided buffer.
-
-The correct buffer size can be obtained using rdfChunkFileGetChunkHeaderSize. The
-user must allocate at least that many bytes.
-
-If the chunk data size is 0, passing a nullptr as the buffer is valid.
+//////////////////////////////////////////////////////////////////////////////
+/**
+Get the number of chunks using the provided chunk id.
 */
-int RDF_EXPORT rdfChunkFileReadChunkHeader(rdfChunkFile* handle,
-                                           const char* chunkId,
-                                           const int chunkIndex,
-                                           void* buffer)
+int RDF_EXPORT rdfChunkFileGetChunkCount(rdfChunkFile* handle,
+                                         const char* chunkId,
+                                         std::int64_t* count)
 {
     RDF_C_API_BEGIN
 
@@ -1765,11 +6564,11 @@ int RDF_EXPORT rdfChunkFileReadChunkHeader(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (chunkIndex < 0) {
+    if (count == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    handle->chunkFile->ReadChunkHeader(chunkId, chunkIndex, buffer);
+    *count = handle->chunkFile->GetChunkCount(chunkId);
 
     return rdfResult::rdfResultOk;
 
@@ -1778,12 +6577,12 @@ int RDF_EXPORT rdfChunkFileReadChunkHeader(rdfChunkFile* handle,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Get the size of the chunk header.
+Check if the file contains a specified chunk id.
 */
-int RDF_EXPORT rdfChunkFileGetChunkHeaderSize(rdfChunkFile* handle,
-                                              const char* chunkId,
-                                              const int chunkIndex,
-                                              std::int64_t* size)
+int RDF_EXPORT rdfChunkFileContainsChunk(rdfChunkFile* handle,
+                                         const char* chunkId,
+                                         const int chunkIndex,
+                                         int* result)
 {
     RDF_C_API_BEGIN
 
@@ -1799,11 +6598,11 @@ int RDF_EXPORT rdfChunkFileGetChunkHeaderSize(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (size == nullptr) {
+    if (result == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *size = handle->chunkFile->GetChunkHeaderSize(chunkId, chunkIndex);
+    *result = handle->chunkFile->ContainsChunk(chunkId, chunkIndex) ? 1 : 0;
 
     return rdfResult::rdfResultOk;
 
@@ -1812,12 +6611,12 @@ int RDF_EXPORT rdfChunkFileGetChunkHeaderSize(rdfChunkFile* handle,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Get the size of the chunk data.
+Get the key of a chunk. Chunks written without a key have the key 0.
 */
-int RDF_EXPORT rdfChunkFileGetChunkDataSize(rdfChunkFile* handle,
-                                            const char* chunkId,
-                                            const int chunkIndex,
-                                            std::int64_t* size)
+int RDF_EXPORT rdfChunkFileGetChunkKey(rdfChunkFile* handle,
+                                       const char* chunkId,
+                                       const int chunkIndex,
+                                       std::uint64_t* key)
 {
     RDF_C_API_BEGIN
 
@@ -1833,11 +6632,11 @@ int RDF_EXPORT rdfChunkFileGetChunkDataSize(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (size == nullptr) {
+    if (key == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *size = handle->chunkFile->GetChunkDataSize(chunkId, chunkIndex);
+    *key = handle->chunkFile->GetChunkKey(chunkId, chunkIndex);
 
     return rdfResult::rdfResultOk;
 
@@ -1846,11 +6645,17 @@ int RDF_EXPORT rdfChunkFileGetChunkDataSize(rdfChunkFile* handle,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Get the number of chunks using the provided chunk id.
+Find the chunks with a key in [first, last], ordered by key.
+
+If chunkIndices is null, count is set to the number of matching chunks.
+Otherwise, count must be large enough to hold all of them.
 */
-int RDF_EXPORT rdfChunkFileGetChunkCount(rdfChunkFile* handle,
-                                         const char* chunkId,
-                                         std::int64_t* count)
+int RDF_EXPORT rdfChunkFileFindChunksByKeyRange(rdfChunkFile* handle,
+                                                const char* chunkId,
+                                                const std::uint64_t first,
+                                                const std::uint64_t last,
+                                                std::int64_t* count,
+                                                int* chunkIndices)
 {
     RDF_C_API_BEGIN
 
@@ -1866,7 +6671,17 @@ int RDF_EXPORT rdfChunkFileGetChunkCount(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *count = handle->chunkFile->GetChunkCount(chunkId);
+    const auto indices = handle->chunkFile->FindChunksByKeyRange(chunkId, first, last);
+
+    if (chunkIndices != nullptr) {
+        if (*count < static_cast<std::int64_t>(indices.size())) {
+            return rdfResult::rdfResultInvalidArgument;
+        }
+
+        std::copy(indices.begin(), indices.end(), chunkIndices);
+    }
+
+    *count = static_cast<std::int64_t>(indices.size());
 
     return rdfResult::rdfResultOk;
 
@@ -1875,12 +6690,10 @@ int RDF_EXPORT rdfChunkFileGetChunkCount(rdfChunkFile* handle,
 
 //////////////////////////////////////////////////////////////////////////////
 /**
-Check if the file contains a specified chunk id.
+Enable or disable checking chunk data against its checksum in
+rdfChunkFileReadChunkData.
 */
-int RDF_EXPORT rdfChunkFileContainsChunk(rdfChunkFile* handle,
-                                         const char* chunkId,
-                                         const int chunkIndex,
-                                         int* result)
+int RDF_EXPORT rdfChunkFileSetVerifyChecksums(rdfChunkFile* handle, const int verify)
 {
     RDF_C_API_BEGIN
 
@@ -1888,19 +6701,30 @@ int RDF_EXPORT rdfChunkFileContainsChunk(rdfChunkFile* handle,
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (chunkId == nullptr) {
-        return rdfResult::rdfResultInvalidArgument;
-    }
+    handle->chunkFile->SetVerifyChecksums(verify != 0);
 
-    if (chunkIndex < 0) {
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Check the data of all chunks against their checksums.
+*/
+int RDF_EXPORT rdfChunkFileVerifyChecksums(rdfChunkFile* handle, std::int64_t* mismatchCount)
+{
+    RDF_C_API_BEGIN
+
+    if (handle == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    if (result == nullptr) {
+    if (mismatchCount == nullptr) {
         return rdfResult::rdfResultInvalidArgument;
     }
 
-    *result = handle->chunkFile->ContainsChunk(chunkId, chunkIndex) ? 1 : 0;
+    *mismatchCount = handle->chunkFile->VerifyChecksums();
 
     return rdfResult::rdfResultOk;
 
@@ -2091,7 +6915,8 @@ int RDF_EXPORT rdfChunkFileWriterCreate(rdfStream* stream, rdfChunkFileWriter**
 
     *writer = new rdfChunkFileWriter;
     try {
-        (*writer)->writer.reset(new rdf::internal::ChunkFileWriter(stream->stream.get(), false));
+        (*writer)->writer.reset(new rdf::internal::ChunkFileWriter(
+            stream->stream.get(), rdf::internal::ChunkFileWriter::Options()));
     } catch (...) {
         delete *writer;
         throw;
@@ -2109,6 +6934,36 @@ Create a new chunk file writer.
 The stream must allow both read and write access if appending is enabled. 
 When appending, the stream must be pointing at an existing chunk file,
 otherwise appending will fail (i.e. you can't use append on a fresh stream.)
+
+If compressionThreshold is set, compressed chunks which don't shrink to at
+most that fraction of their uncompressed size get stored uncompressed. With
+compressionSampleSize set as well, larger chunks get a trial compression of
+their first compressionSampleSize bytes, and if that fails the threshold, the
+chunk is stored uncompressed without compressing the remainder.
+
+If writeBufferSize is set, small writes are coalesced into a buffer of that
+size before they are passed on to the stream. The buffer gets flushed at the
+end of each chunk.
+
+If asyncMemoryLimit is set, chunks are compressed and written by a background
+thread. Writer functions only copy the data and return, unless more than
+asyncMemoryLimit bytes are waiting to be written, in which case they block
+until the background thread has caught up. A compressed chunk is buffered in
+full until it ends, so it can exceed the limit on its own. Errors that occur
+in the background are returned by the next writer call,
+rdfChunkFileWriterFlush or rdfChunkFileWriterDestroy.
+
+If deduplicateChunks is set, chunk data identical to the data of an earlier
+chunk written by this writer is stored only once. Matches are verified byte by
+byte, so deduplication is skipped if the stream is not readable.
+
+If chunkDataAlignment or chunkHeaderAlignment are greater than one, chunk data
+and chunk headers respectively start at offsets which are multiples of them,
+and the gaps in between are filled with zeros.
+
+If expectedFileSize is set, the stream reserves storage for that many bytes
+when the writer is created, and the file is truncated to its actual size
+when the writer gets destroyed.
 */
 int RDF_EXPORT rdfChunkFileWriterCreate2(const rdfChunkFileWriterCreateInfo* info, rdfChunkFileWriter** writer)
 {
@@ -2126,9 +6981,33 @@ int RDF_EXPORT rdfChunkFileWriterCreate2(const rdfChunkFileWriterCreateInfo* inf
         return rdfResult::rdfResultInvalidArgument;
     }
 
+    if (info->compressionThreshold < 0 || info->compressionSampleSize < 0 ||
+        info->writeBufferSize < 0 || info->asyncMemoryLimit < 0 ||
+        info->chunkDataAlignment < 0 || info->chunkHeaderAlignment < 0 ||
+        info->expectedFileSize < 0 || info->indexPublishInterval < 0 ||
+        info->indexPublishByteInterval < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    rdf::internal::ChunkFileWriter::Options options;
+    options.append = info->appendToFile;
+    options.compressionThreshold = info->compressionThreshold;
+    options.compressionSampleSize = info->compressionSampleSize;
+    options.writeBufferSize = info->writeBufferSize;
+    options.asyncMemoryLimit = info->asyncMemoryLimit;
+    options.deduplicateChunks = info->deduplicateChunks;
+    options.dataAlignment = info->chunkDataAlignment;
+    options.headerAlignment = info->chunkHeaderAlignment;
+    options.expectedFileSize = info->expectedFileSize;
+    options.indexPublishInterval = info->indexPublishInterval;
+    options.indexPublishByteInterval = info->indexPublishByteInterval;
+    options.incrementalAppend = info->incrementalAppend;
+    options.chunkChecksums = info->chunkChecksums;
+
     *writer = new rdfChunkFileWriter;
     try {
-        (*writer)->writer.reset(new rdf::internal::ChunkFileWriter(info->stream->stream.get(), info->appendToFile));
+        (*writer)->writer.reset(
+            new rdf::internal::ChunkFileWriter(info->stream->stream.get(), options));
     } catch (...) {
         delete *writer;
         throw;
@@ -2147,6 +7026,9 @@ This flushes all pending data and destroys the writer.
 
 This function also resets the handle. If the writing fails, the handle will be
 destroyed but an error code will be returned.
+
+If chunk writers opened with rdfChunkFileWriterOpenChunk are still open, the
+writer is left untouched and an error code will be returned.
 */
 int RDF_EXPORT rdfChunkFileWriterDestroy(rdfChunkFileWriter** writer)
 {
@@ -2160,6 +7042,10 @@ int RDF_EXPORT rdfChunkFileWriterDestroy(rdfChunkFileWriter** writer)
         return rdfResult::rdfResultInvalidArgument;
     }
 
+    if ((*writer)->writer->HasOpenChunkWriters()) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
     rdfResult result = rdfResult::rdfResultOk;
 
     try {
@@ -2206,7 +7092,8 @@ int RDF_EXPORT rdfChunkFileWriterBeginChunk(rdfChunkFileWriter* writer,
                                info->headerSize,
                                info->pHeader,
                                static_cast<rdf::internal::Compression>(info->compression),
-                               info->version == 0 ? 1 : info->version);
+                               info->version == 0 ? 1 : info->version,
+                               info->key);
 
     return rdfResult::rdfResultOk;
 
@@ -2303,7 +7190,8 @@ int RDF_EXPORT rdfChunkFileWriterWriteChunk(rdfChunkFileWriter* writer,
                                    size,
                                    data,
                                    static_cast<rdf::internal::Compression>(info->compression),
-                                   info->version == 0 ? 1 : info->version);
+                                   info->version == 0 ? 1 : info->version,
+                                   info->key);
 
     if (index) {
         *index = chunkIndex;
@@ -2314,6 +7202,266 @@ int RDF_EXPORT rdfChunkFileWriterWriteChunk(rdfChunkFileWriter* writer,
     RDF_C_API_END
 }
 
+//////////////////////////////////////////////////////////////////////////////
+/**
+Copy a chunk from another chunk file without decompressing it.
+
+The stored header and data are copied verbatim, and the new chunk keeps the
+compression and version of the source chunk. This is much faster than reading
+and writing the chunk data when merging compressed files.
+
+If index is non-null, the index of the new chunk is stored there.
+
+Like closing a chunk writer, this waits while another thread has a chunk open
+through rdfChunkFileWriterBeginChunk, and fails if the calling thread has one
+open.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkFileWriterCopyChunk(rdfChunkFileWriter* writer,
+                                           rdfChunkFile* source,
+                                           const char* chunkId,
+                                           const int chunkIndex,
+                                           int* index)
+{
+    RDF_C_API_BEGIN
+
+    if (writer == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (source == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunkId == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    const int newIndex = writer->writer->CopyChunk(*source->chunkFile, chunkId, chunkIndex);
+    if (index) {
+        *index = newIndex;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Wait until all data passed to the writer has been written to the stream.
+
+This is mostly useful for writers in asynchronous mode, where it waits for
+the background thread to catch up and returns any error that occurred while
+writing. Data of a compressed chunk that is still open can't be written yet.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkFileWriterFlush(rdfChunkFileWriter* writer)
+{
+    RDF_C_API_BEGIN
+
+    if (writer == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    writer->writer->Flush();
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Remove a chunk from the index written when the writer is destroyed. The chunk
+data stays in the file until it gets compacted.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkFileWriterRemoveChunk(rdfChunkFileWriter* writer,
+                                             const char* chunkId,
+                                             const int chunkIndex)
+{
+    RDF_C_API_BEGIN
+
+    if (writer == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunkId == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunkIndex < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    writer->writer->RemoveChunk(chunkId, chunkIndex);
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Open a chunk which can be written independently of other chunks.
+
+Unlike rdfChunkFileWriterBeginChunk, any number of chunks can be open at the
+same time, and each can be filled from a different thread. The chunk data is
+kept in memory until the chunk is closed with rdfChunkWriterClose, which
+compresses it on the calling thread and then adds it to the file.
+
+All chunk writers must be closed or discarded before the chunk file writer is
+destroyed. Closing a chunk writer waits while another thread has a chunk open
+through rdfChunkFileWriterBeginChunk. If the calling thread has a chunk open
+itself, closing fails instead, as that chunk could never end.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkFileWriterOpenChunk(rdfChunkFileWriter* writer,
+                                           const rdfChunkCreateInfo* info,
+                                           rdfChunkWriter** chunk)
+{
+    RDF_C_API_BEGIN
+
+    if (writer == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (info == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    *chunk = new rdfChunkWriter;
+    try {
+        (*chunk)->chunk.reset(new rdf::internal::ChunkWriter(
+            writer->writer.get(),
+            info->identifier,
+            info->headerSize,
+            info->pHeader,
+            static_cast<rdf::internal::Compression>(info->compression),
+            info->version == 0 ? 1 : info->version,
+            info->key));
+    } catch (...) {
+        delete *chunk;
+        *chunk = nullptr;
+        throw;
+    }
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Append data to a chunk opened with rdfChunkFileWriterOpenChunk.
+
+A chunk writer must not be used from multiple threads at the same time.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkWriterAppend(rdfChunkWriter* chunk,
+                                    const std::int64_t size,
+                                    const void* data)
+{
+    RDF_C_API_BEGIN
+
+    if (chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (size < 0) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    chunk->chunk->Append(size, data);
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Close a chunk writer and add the chunk to the file.
+
+If index is non-null, the chunk index is stored there. Indices are assigned
+in the order in which chunks get closed.
+
+This function also resets the handle. If writing fails, the handle will be
+destroyed but an error code will be returned.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkWriterClose(rdfChunkWriter** chunk, int* index)
+{
+    RDF_C_API_BEGIN
+
+    if (chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (*chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    rdfResult result = rdfResult::rdfResultOk;
+
+    try {
+        const int chunkIndex = (*chunk)->chunk->Close();
+        if (index) {
+            *index = chunkIndex;
+        }
+    } catch (...) {
+        result = rdfResult::rdfResultError;
+    }
+
+    delete *chunk;
+    *chunk = nullptr;
+
+    return result;
+
+    RDF_C_API_END
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/**
+Destroy a chunk writer without adding the chunk to the file.
+
+@since 1.5
+*/
+int RDF_EXPORT rdfChunkWriterDiscard(rdfChunkWriter** chunk)
+{
+    RDF_C_API_BEGIN
+
+    if (chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    if (*chunk == nullptr) {
+        return rdfResult::rdfResultInvalidArgument;
+    }
+
+    delete *chunk;
+    *chunk = nullptr;
+
+    return rdfResult::rdfResultOk;
+
+    RDF_C_API_END
+}
+
 //////////////////////////////////////////////////////////////////////////////
 /**
 Convert a rdfResult to a human-readable string.
@@ -3,7 +3,11 @@
 
 #include "amdrdf.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <thread>
 #include "test_rdf.h"
 
 namespace
@@ -12,14 +16,17 @@ struct MemoryStream
 {
     std::int64_t currentOffset = 0;
     std::vector<unsigned char> buffer;
+    int writeCount = 0;
+    int readCount = 0;
 };
 
 int MemoryStreamWrite(void* p, std::int64_t count, const void* buffer, std::int64_t* bytesWritten)
 {
     MemoryStream* ms = static_cast<MemoryStream*>(p);
-    ms->buffer.resize(ms->currentOffset + count);
+    ms->buffer.resize(std::max<std::size_t>(ms->buffer.size(), ms->currentOffset + count));
     ::memcpy(ms->buffer.data() + ms->currentOffset, buffer, count);
     ms->currentOffset += count;
+    ++ms->writeCount;
 
     if (bytesWritten) {
         *bytesWritten = count;
@@ -32,6 +39,7 @@ int MemoryStreamRead(void* p, std::int64_t count, void* buffer, std::int64_t* by
 {
     MemoryStream* ms = static_cast<MemoryStream*>(p);
     auto bytesToRead = std::min(count, static_cast<std::int64_t>(ms->buffer.size()) - ms->currentOffset);
+    ++ms->readCount;
     ::memcpy(buffer, ms->buffer.data() + ms->currentOffset, bytesToRead);
     ms->currentOffset += bytesToRead;
 
@@ -62,6 +70,28 @@ int MemoryStreamGetSize(void* p, std::int64_t* size)
     *size = ms->buffer.size();
     return rdfResultOk;
 }
+
+int MemoryStreamWriteAt(void* p,
+                        std::int64_t offset,
+                        std::int64_t count,
+                        const void* buffer,
+                        std::int64_t* bytesWritten)
+{
+    MemoryStream* ms = static_cast<MemoryStream*>(p);
+    ms->currentOffset = offset;
+    return MemoryStreamWrite(p, count, buffer, bytesWritten);
+}
+
+int MemoryStreamReadAt(void* p,
+                       std::int64_t offset,
+                       std::int64_t count,
+                       void* buffer,
+                       std::int64_t* bytesRead)
+{
+    MemoryStream* ms = static_cast<MemoryStream*>(p);
+    ms->currentOffset = std::min<std::int64_t>(offset, ms->buffer.size());
+    return MemoryStreamRead(p, count, buffer, bytesRead);
+}
 }
 
 TEST_CASE("rdf::MemoryStream", "[rdf]")
@@ -81,6 +111,273 @@ TEST_CASE("rdf::MemoryStream", "[rdf]")
 
         CHECK(::strcmp(outputBuffer, "test") == 0);
     }
+
+    SECTION("Writes across pages and past the end")
+    {
+        // Mirror all writes in memory. Gaps left by writing past the end
+        // must read as zeros
+        std::vector<unsigned char> expected;
+        std::vector<unsigned char> data;
+
+        std::uint32_t state = 5;
+        for (int i = 0; i < 100; ++i) {
+            state = state * 1664525 + 1013904223;
+            const std::int64_t offset = (state >> 8) % (5 * 1024 * 1024);
+            state = state * 1664525 + 1013904223;
+            const std::int64_t size = (state >> 8) % (i % 10 == 0 ? 3 * 1024 * 1024 : 5000);
+
+            data.assign(size, static_cast<unsigned char>(i + 1));
+            ms.Seek(offset);
+            REQUIRE(ms.Write(size, data.data()) == size);
+
+            if (static_cast<std::size_t>(offset + size) > expected.size()) {
+                expected.resize(offset + size);
+            }
+            std::copy(data.begin(), data.end(), expected.begin() + offset);
+        }
+
+        REQUIRE(ms.GetSize() == static_cast<std::int64_t>(expected.size()));
+
+        std::vector<unsigned char> output(expected.size());
+        ms.Seek(0);
+        REQUIRE(ms.Read(output.size(), output.data()) == static_cast<std::int64_t>(output.size()));
+        CHECK(output == expected);
+    }
+}
+
+TEST_CASE("rdf::MemoryStream with capacity hint", "[rdf]")
+{
+    rdfMemoryStreamCreateInfo info = {};
+    info.capacityHint = 3 * 1024 * 1024;
+
+    auto ms = rdf::Stream::CreateMemoryStream(info);
+    CHECK(ms.GetSize() == 0);
+
+    // Grow past the hint
+    std::vector<int> data(1024 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<int>(i);
+    }
+
+    ms.Write(data.size() * sizeof(int), data.data());
+    ms.Write(data.size() * sizeof(int), data.data());
+    REQUIRE(ms.GetSize() == static_cast<std::int64_t>(2 * data.size() * sizeof(int)));
+
+    std::vector<int> output(2 * data.size());
+    ms.Seek(0);
+    ms.Read(output.size() * sizeof(int), output.data());
+    CHECK(std::equal(data.begin(), data.end(), output.begin()));
+    CHECK(std::equal(data.begin(), data.end(), output.begin() + data.size()));
+
+    info.capacityHint = -1;
+    rdfStream* stream = nullptr;
+    CHECK(rdfStreamCreateMemoryStream2(&info, &stream) == rdfResultInvalidArgument);
+    CHECK(stream == nullptr);
+}
+
+TEST_CASE("rdf::MemoryStream adds default-sized pages past the capacity hint", "[rdf]")
+{
+    const std::int64_t capacityHint = 3 * 1024 * 1024 + 17;
+    const std::int64_t pageSize = 1024 * 1024;
+
+    rdfMemoryStreamCreateInfo info = {};
+    info.capacityHint = capacityHint;
+
+    auto ms = rdf::Stream::CreateMemoryStream(info);
+
+    std::vector<unsigned char> data(capacityHint + pageSize + 1);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i * 7);
+    }
+
+    // Write just past the hint, with a write crossing into the second page
+    ms.Write(capacityHint - 3, data.data());
+    ms.Write(4, data.data() + capacityHint - 3);
+
+    auto segments = ms.GetMemoryView();
+    REQUIRE(segments.size() == 2);
+    CHECK(segments[0].size == capacityHint);
+    CHECK(segments[1].size == 1);
+
+    // The second page has the default size, so filling it adds a third
+    ms.Write(data.size() - capacityHint - 1, data.data() + capacityHint + 1);
+
+    segments = ms.GetMemoryView();
+    REQUIRE(segments.size() == 3);
+    CHECK(segments[0].size == capacityHint);
+    CHECK(segments[1].size == pageSize);
+    CHECK(segments[2].size == 1);
+
+    std::vector<unsigned char> output(data.size());
+    ms.Seek(0);
+    REQUIRE(ms.Read(output.size(), output.data()) == static_cast<std::int64_t>(output.size()));
+    CHECK(output == data);
+
+    std::int64_t detachedSize = 0;
+    auto buffer = ms.DetachMemoryBuffer(detachedSize);
+    REQUIRE(detachedSize == static_cast<std::int64_t>(data.size()));
+    CHECK(::memcmp(buffer.get(), data.data(), data.size()) == 0);
+}
+
+TEST_CASE("rdf::Stream memory views", "[rdf]")
+{
+    SECTION("Views and detaches a single segment without copying")
+    {
+        rdfMemoryStreamCreateInfo info = {};
+        info.capacityHint = 64 * 1024;
+
+        auto ms = rdf::Stream::CreateMemoryStream(info);
+        {
+            rdf::ChunkFileWriter writer(ms);
+            writer.WriteChunk("chunk", 0, nullptr, 5, "test");
+            writer.Close();
+        }
+
+        const auto size = ms.GetSize();
+        const auto segments = ms.GetMemoryView();
+        REQUIRE(segments.size() == 1);
+        CHECK(segments[0].size == size);
+
+        std::int64_t detachedSize = 0;
+        auto buffer = ms.DetachMemoryBuffer(detachedSize);
+        CHECK(detachedSize == size);
+        CHECK(buffer.get() == segments[0].data);
+        CHECK(ms.GetSize() == 0);
+
+        auto view = rdf::Stream::FromReadOnlyMemory(detachedSize, buffer.get());
+        rdf::ChunkFile cf(view);
+        CHECK(cf.ContainsChunk("chunk"));
+        CHECK(view.GetMemoryView().size() == 1);
+    }
+
+    SECTION("Gathers multiple segments when detaching")
+    {
+        auto ms = rdf::Stream::CreateMemoryStream();
+
+        std::vector<unsigned char> data(3 * 1024 * 1024 + 17);
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<unsigned char>(i * 7);
+        }
+        ms.Write(data.size(), data.data());
+
+        const auto segments = ms.GetMemoryView();
+        REQUIRE(segments.size() > 1);
+
+        std::int64_t viewSize = 0;
+        for (const auto& segment : segments) {
+            CHECK(::memcmp(segment.data, data.data() + viewSize, segment.size) == 0);
+            viewSize += segment.size;
+        }
+        CHECK(viewSize == static_cast<std::int64_t>(data.size()));
+
+        std::int64_t detachedSize = 0;
+        auto buffer = ms.DetachMemoryBuffer(detachedSize);
+        REQUIRE(detachedSize == static_cast<std::int64_t>(data.size()));
+        CHECK(::memcmp(buffer.get(), data.data(), data.size()) == 0);
+
+        // The stream can be reused
+        CHECK(ms.GetMemoryView().empty());
+        ms.Write(4, "abc");
+        CHECK(ms.GetSize() == 4);
+    }
+
+    SECTION("Only memory streams support views")
+    {
+        const char* filename = "rdf-memory-view.rdf";
+        auto file = rdf::Stream::CreateFile(filename);
+
+        std::int64_t count = 0;
+        CHECK(rdfStreamGetMemoryView(static_cast<rdfStream*>(file), &count, nullptr) ==
+              rdfResultInvalidArgument);
+
+        void* buffer = nullptr;
+        std::int64_t size = 0;
+        CHECK(rdfStreamDetachMemoryBuffer(static_cast<rdfStream*>(file), &buffer, &size) ==
+              rdfResultInvalidArgument);
+
+        auto ro = rdf::Stream::FromReadOnlyMemory(4, "abc");
+        CHECK(rdfStreamDetachMemoryBuffer(static_cast<rdfStream*>(ro), &buffer, &size) ==
+              rdfResultInvalidArgument);
+
+        file.Close();
+        std::remove(filename);
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("rdf::Stream::CreateSharedMemoryStream", "[rdf]")
+{
+    rdfSharedMemoryStreamCreateInfo info = {};
+    info.name = "rdf-test";
+    info.capacityHint = 1024 * 1024;
+
+    auto shared = rdf::Stream::CreateSharedMemoryStream(info);
+
+    std::vector<int> data(64 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<int>(i);
+    }
+
+    {
+        rdf::ChunkFileWriter writer(shared);
+        writer.WriteChunk("chunk", 0, nullptr, data.size() * sizeof(int), data.data());
+        writer.Close();
+    }
+
+    const int fd = shared.GetFileDescriptor();
+    REQUIRE(fd >= 0);
+
+    auto mapped = rdf::Stream::MapFileDescriptor(fd);
+    CHECK(mapped.GetSize() == shared.GetSize());
+    CHECK(mapped.GetMemoryView().size() == 1);
+
+    // The mapping stays valid after the shared stream is gone
+    shared.Close();
+
+    rdf::ChunkFile cf(mapped);
+    REQUIRE(cf.GetChunkDataSize("chunk") == static_cast<std::int64_t>(data.size() * sizeof(int)));
+
+    std::vector<int> output(data.size());
+    cf.ReadChunkDataToBuffer("chunk", output.data());
+    CHECK(output == data);
+
+    rdfStream* stream = nullptr;
+    CHECK(rdfStreamMapFileDescriptor(-1, &stream) == rdfResultInvalidArgument);
+
+    auto ms = rdf::Stream::CreateMemoryStream();
+    int msFd = 0;
+    CHECK(rdfStreamGetFileDescriptor(static_cast<rdfStream*>(ms), &msFd) ==
+          rdfResultInvalidArgument);
+}
+#endif
+
+TEST_CASE("rdf::Stream::CreateSubStream", "[rdf]")
+{
+    auto ms = rdf::Stream::CreateMemoryStream();
+    ms.Write(10, "0123456789");
+
+    auto sub = rdf::Stream::CreateSubStream(ms, 2, 5);
+    CHECK(sub.GetSize() == 5);
+
+    char buffer[8] = {};
+    CHECK(sub.Read(8, buffer) == 5);
+    CHECK(::memcmp(buffer, "23456", 5) == 0);
+
+    sub.Seek(1);
+    CHECK(sub.Write(2, "ab") == 2);
+    CHECK_THROWS_AS(sub.Write(3, "cde"), rdf::ApiException);
+
+    const auto segments = sub.GetMemoryView();
+    REQUIRE(segments.size() == 1);
+    CHECK(segments[0].size == 5);
+    CHECK(::memcmp(segments[0].data, "2ab56", 5) == 0);
+
+    rdfStream* stream = nullptr;
+    CHECK(rdfStreamCreateSubStream(static_cast<rdfStream*>(ms), 8, 3, &stream) ==
+          rdfResultInvalidArgument);
+    CHECK(rdfStreamCreateSubStream(static_cast<rdfStream*>(ms), -1, 3, &stream) ==
+          rdfResultInvalidArgument);
+    CHECK(stream == nullptr);
 }
 
 TEST_CASE("rdfUserStream", "[rdf]")
@@ -172,6 +469,37 @@ TEST_CASE("ChunkFileWriter with write-only stream", "[rdf]")
     rdfStreamClose(&stream);
 }
 
+TEST_CASE("ChunkFileWriter doesn't deduplicate on a write-only stream", "[rdf]")
+{
+    MemoryStream ms;
+    rdfUserStream us = {};
+    us.context = &ms;
+    us.GetSize = MemoryStreamGetSize;
+    us.Read = nullptr;
+    us.Write = MemoryStreamWrite;
+    us.Seek = MemoryStreamSeek;
+    us.Tell = MemoryStreamTell;
+
+    const std::vector<unsigned char> data(4096, 7);
+
+    {
+        auto stream = rdf::Stream::FromUserStream(&us);
+
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.deduplicateChunks = true;
+
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("raw", 0, nullptr, data.size(), data.data());
+        writer.WriteChunk("raw", 0, nullptr, data.size(), data.data());
+        writer.Close();
+    }
+
+    // Both copies are stored, as the first one can't be read back to
+    // confirm the match
+    CHECK(ms.buffer.size() > 2 * data.size());
+}
+
 TEST_CASE("rdfUserStream required functions", "[rdf]") 
 {
     MemoryStream ms;
@@ -288,3 +616,524 @@ TEST_CASE("rdfUserStream Close() can throw", "[rdf]")
     CHECK(rdfStreamClose(&stream) == rdfResultOk);
     CHECK(stream == nullptr);
 }
+
+TEST_CASE("ChunkFileWriter coalesces small writes", "[rdf]")
+{
+    MemoryStream ms;
+    rdfUserStream us = {};
+    us.context = &ms;
+    us.GetSize = MemoryStreamGetSize;
+    us.Read = MemoryStreamRead;
+    us.Write = MemoryStreamWrite;
+    us.Seek = MemoryStreamSeek;
+    us.Tell = MemoryStreamTell;
+
+    rdfStream* stream = nullptr;
+    REQUIRE(rdfStreamCreateFromUserStream(&us, &stream) == rdfResultOk);
+
+    const std::int64_t writeBufferSize = GENERATE(0, 100, 64 * 1024);
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = stream;
+    info.writeBufferSize = writeBufferSize;
+
+    rdfChunkFileWriter* writer = nullptr;
+    REQUIRE(rdfChunkFileWriterCreate2(&info, &writer) == rdfResultOk);
+
+    rdfChunkCreateInfo chunkCreateInfo = {};
+    ::memcpy(chunkCreateInfo.identifier, "records", 7);
+    chunkCreateInfo.headerSize = 4;
+    chunkCreateInfo.pHeader = "head";
+
+    const int recordCount = 1000;
+    REQUIRE(rdfChunkFileWriterBeginChunk(writer, &chunkCreateInfo) == rdfResultOk);
+    for (int i = 0; i < recordCount; ++i) {
+        REQUIRE(rdfChunkFileWriterAppendToChunk(writer, sizeof(i), &i) == rdfResultOk);
+    }
+    REQUIRE(rdfChunkFileWriterEndChunk(writer, nullptr) == rdfResultOk);
+
+    // Everything must be on the stream once the chunk ended
+    const int writeCountAfterChunk = ms.writeCount;
+    CHECK(ms.buffer.size() == 32 + 4 + recordCount * sizeof(int));
+
+    REQUIRE(rdfChunkFileWriterDestroy(&writer) == rdfResultOk);
+
+    if (writeBufferSize == 0) {
+        // Header, chunk header and one write per record
+        CHECK(writeCountAfterChunk == 2 + recordCount);
+    } else if (writeBufferSize == 100) {
+        CHECK(writeCountAfterChunk == 1 + (4 + recordCount * sizeof(int) + 99) / 100);
+    } else {
+        CHECK(writeCountAfterChunk == 2);
+    }
+
+    rdfChunkFile* chunkFile = nullptr;
+    REQUIRE(rdfChunkFileOpenStream(stream, &chunkFile) == rdfResultOk);
+
+    std::int64_t size = 0;
+    REQUIRE(rdfChunkFileGetChunkDataSize(chunkFile, "records", 0, &size) == rdfResultOk);
+    REQUIRE(size == recordCount * static_cast<std::int64_t>(sizeof(int)));
+
+    std::vector<int> records(recordCount);
+    REQUIRE(rdfChunkFileReadChunkData(chunkFile, "records", 0, records.data()) == rdfResultOk);
+    for (int i = 0; i < recordCount; ++i) {
+        CHECK(records[i] == i);
+    }
+
+    rdfChunkFileClose(&chunkFile);
+    rdfStreamClose(&stream);
+}
+
+TEST_CASE("ChunkFileWriter reports errors from asynchronous writes", "[rdf]")
+{
+    struct Context
+    {
+        MemoryStream ms;
+        int writesUntilFailure = 0;
+    } ctx;
+
+    ctx.writesUntilFailure = GENERATE(1, 3);
+
+    rdfUserStream us = {};
+    us.context = &ctx;
+    us.GetSize = [](void* p, std::int64_t* size) -> int {
+        return MemoryStreamGetSize(&static_cast<Context*>(p)->ms, size);
+    };
+    us.Seek = [](void* p, std::int64_t position) -> int {
+        return MemoryStreamSeek(&static_cast<Context*>(p)->ms, position);
+    };
+    us.Tell = [](void* p, std::int64_t* position) -> int {
+        return MemoryStreamTell(&static_cast<Context*>(p)->ms, position);
+    };
+    us.Write = [](void* p, std::int64_t count, const void* buffer, std::int64_t* bytesWritten) -> int {
+        Context* context = static_cast<Context*>(p);
+        if (context->writesUntilFailure-- <= 0) {
+            return rdfResultError;
+        }
+
+        return MemoryStreamWrite(&context->ms, count, buffer, bytesWritten);
+    };
+
+    rdfStream* stream = nullptr;
+    REQUIRE(rdfStreamCreateFromUserStream(&us, &stream) == rdfResultOk);
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = stream;
+    info.asyncMemoryLimit = 1024;
+
+    rdfChunkFileWriter* writer = nullptr;
+    REQUIRE(rdfChunkFileWriterCreate2(&info, &writer) == rdfResultOk);
+
+    rdfChunkCreateInfo chunkCreateInfo = {};
+    ::memcpy(chunkCreateInfo.identifier, "chunk", 5);
+
+    // The write fails on the background thread, so it has to surface later
+    const int data[64] = {};
+    rdfResult result = rdfResultOk;
+    for (int i = 0; i < 16 && result == rdfResultOk; ++i) {
+        result = static_cast<rdfResult>(
+            rdfChunkFileWriterWriteChunk(writer, &chunkCreateInfo, sizeof(data), data, nullptr));
+    }
+
+    if (result == rdfResultOk) {
+        result = static_cast<rdfResult>(rdfChunkFileWriterFlush(writer));
+    }
+
+    CHECK(result != rdfResultOk);
+    CHECK(rdfChunkFileWriterDestroy(&writer) != rdfResultOk);
+    CHECK(writer == nullptr);
+
+    rdfStreamClose(&stream);
+}
+
+TEST_CASE("ChunkFileWriter blocks at the asynchronous memory limit", "[rdf]")
+{
+    struct Context
+    {
+        MemoryStream ms;
+        std::atomic<bool> blocked{false};
+    } ctx;
+
+    rdfUserStream us = {};
+    us.context = &ctx;
+    us.GetSize = [](void* p, std::int64_t* size) -> int {
+        return MemoryStreamGetSize(&static_cast<Context*>(p)->ms, size);
+    };
+    us.Seek = [](void* p, std::int64_t position) -> int {
+        return MemoryStreamSeek(&static_cast<Context*>(p)->ms, position);
+    };
+    us.Tell = [](void* p, std::int64_t* position) -> int {
+        return MemoryStreamTell(&static_cast<Context*>(p)->ms, position);
+    };
+    us.Write = [](void* p, std::int64_t count, const void* buffer, std::int64_t* bytesWritten) -> int {
+        Context* context = static_cast<Context*>(p);
+        while (context->blocked) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return MemoryStreamWrite(&context->ms, count, buffer, bytesWritten);
+    };
+
+    rdfStream* stream = nullptr;
+    REQUIRE(rdfStreamCreateFromUserStream(&us, &stream) == rdfResultOk);
+
+    const std::int64_t memoryLimit = 4096;
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = stream;
+    info.asyncMemoryLimit = memoryLimit;
+
+    rdfChunkFileWriter* writer = nullptr;
+    REQUIRE(rdfChunkFileWriterCreate2(&info, &writer) == rdfResultOk);
+
+    rdfChunkCreateInfo chunkCreateInfo = {};
+    ::memcpy(chunkCreateInfo.identifier, "chunk", 5);
+
+    const bool compressed = GENERATE(false, true);
+
+    // The background thread gets stuck writing the first chunk, so anything
+    // after it has to wait in memory
+    ctx.blocked = true;
+
+    const unsigned char data[256] = {};
+    std::atomic<std::int64_t> bytesAccepted{0};
+    std::thread producer([&]() -> void {
+        CHECK(rdfChunkFileWriterWriteChunk(writer, &chunkCreateInfo, sizeof(data), data, nullptr) ==
+              rdfResultOk);
+
+        rdfChunkCreateInfo compressedCreateInfo = chunkCreateInfo;
+        compressedCreateInfo.compression = rdfCompressionZstd;
+        CHECK(rdfChunkFileWriterBeginChunk(
+                  writer, compressed ? &compressedCreateInfo : &chunkCreateInfo) == rdfResultOk);
+
+        for (int i = 0; i < 64; ++i) {
+            CHECK(rdfChunkFileWriterAppendToChunk(writer, sizeof(data), data) == rdfResultOk);
+            bytesAccepted += sizeof(data);
+        }
+
+        CHECK(rdfChunkFileWriterEndChunk(writer, nullptr) == rdfResultOk);
+    });
+
+    // The producer has to stop at the limit, no matter how long we wait
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(bytesAccepted < memoryLimit);
+
+    ctx.blocked = false;
+    producer.join();
+    CHECK(bytesAccepted == 64 * sizeof(data));
+
+    CHECK(rdfChunkFileWriterDestroy(&writer) == rdfResultOk);
+    rdfStreamClose(&stream);
+}
+
+TEST_CASE("rdf::Stream::CreateFile allows reading back written data", "[rdf]")
+{
+    const char* filename = "rdf-create-file-read-back.rdf";
+
+    {
+        auto stream = rdf::Stream::CreateFile(filename);
+        REQUIRE(stream.Write(4, "data") == 4);
+
+        char buffer[4] = {};
+        stream.Seek(0);
+        CHECK(stream.Read(4, buffer) == 4);
+        CHECK(::memcmp(buffer, "data", 4) == 0);
+    }
+
+    std::remove(filename);
+}
+
+TEST_CASE("rdf::Stream direct I/O", "[rdf]")
+{
+    const char* filename = "rdf-direct-io.rdf";
+
+    rdfStreamFromFileCreateInfo info = {};
+    info.filename = filename;
+    info.accessMode = rdfStreamAccessReadWrite;
+    info.fileMode = rdfFileModeCreate;
+    info.directIO = true;
+
+    SECTION("Unaligned reads and writes")
+    {
+        // Mirror all writes into memory, crossing block and buffer
+        // boundaries and leaving gaps
+        std::vector<unsigned char> expected;
+        {
+            auto stream = rdf::Stream::FromFile(info);
+
+            std::uint32_t state = 1;
+            std::vector<unsigned char> data;
+            for (int i = 0; i < 64; ++i) {
+                state = state * 1664525 + 1013904223;
+                const std::int64_t offset = (state >> 8) % (12 * 1024 * 1024);
+                state = state * 1664525 + 1013904223;
+                const std::int64_t size = (state >> 8) % (i % 8 == 0 ? 5 * 1024 * 1024 : 6000);
+
+                data.resize(size);
+                for (auto& c : data) {
+                    c = static_cast<unsigned char>(i + 1);
+                }
+
+                stream.Seek(offset);
+                REQUIRE(stream.Write(size, data.data()) == size);
+
+                if (static_cast<std::size_t>(offset + size) > expected.size()) {
+                    expected.resize(offset + size);
+                }
+                std::copy(data.begin(), data.end(), expected.begin() + offset);
+            }
+
+            REQUIRE(stream.GetSize() == static_cast<std::int64_t>(expected.size()));
+
+            std::vector<unsigned char> readBack(expected.size());
+            stream.Seek(0);
+            REQUIRE(stream.Read(readBack.size(), readBack.data()) ==
+                    static_cast<std::int64_t>(readBack.size()));
+            CHECK(readBack == expected);
+        }
+
+        // The file must have its logical size, without block padding
+        auto stream = rdf::Stream::OpenFile(filename);
+        REQUIRE(stream.GetSize() == static_cast<std::int64_t>(expected.size()));
+
+        std::vector<unsigned char> readBack(expected.size());
+        stream.Read(readBack.size(), readBack.data());
+        CHECK(readBack == expected);
+    }
+
+    SECTION("Chunk file round-trip")
+    {
+        std::vector<int> data(300000);
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<int>(i);
+        }
+
+        {
+            auto stream = rdf::Stream::FromFile(info);
+            rdf::ChunkFileWriter writer(stream);
+            writer.WriteChunk("raw", 3, "hdr", data.size() * sizeof(int), data.data());
+            writer.WriteChunk(
+                "zstd", 0, nullptr, data.size() * sizeof(int), data.data(), rdfCompressionZstd);
+            writer.Close();
+        }
+
+        info.accessMode = rdfStreamAccessRead;
+        info.fileMode = rdfFileModeOpen;
+
+        auto stream = rdf::Stream::FromFile(info);
+        rdf::ChunkFile cf(stream);
+
+        for (const char* id : {"raw", "zstd"}) {
+            std::vector<int> output(data.size());
+            REQUIRE(cf.GetChunkDataSize(id) == static_cast<std::int64_t>(data.size() * sizeof(int)));
+            cf.ReadChunkDataToBuffer(id, output.data());
+            CHECK(output == data);
+        }
+    }
+
+    std::remove(filename);
+}
+
+TEST_CASE("rdf::ChunkFileWriter reserves the expected file size", "[rdf]")
+{
+    const char* filename = "rdf-expected-file-size.rdf";
+
+    rdfStreamFromFileCreateInfo streamInfo = {};
+    streamInfo.filename = filename;
+    streamInfo.accessMode = rdfStreamAccessReadWrite;
+    streamInfo.fileMode = rdfFileModeCreate;
+    streamInfo.directIO = GENERATE(false, true);
+
+    const int data[256] = {1, 2, 3};
+
+    {
+        auto stream = rdf::Stream::FromFile(streamInfo);
+
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.expectedFileSize = 16 * 1024 * 1024;
+
+        rdf::ChunkFileWriter writer(info);
+
+        // Reserving must not change the size of the file
+        CHECK(stream.GetSize() < info.expectedFileSize);
+
+        writer.WriteChunk("chunk", 0, nullptr, sizeof(data), data);
+        writer.Close();
+    }
+
+    {
+        auto stream = rdf::Stream::OpenFile(filename);
+        CHECK(stream.GetSize() == 32 + sizeof(data) + 64);
+
+        rdf::ChunkFile cf(stream);
+        int output[256] = {};
+        cf.ReadChunkDataToBuffer("chunk", output);
+        CHECK(::memcmp(output, data, sizeof(data)) == 0);
+    }
+
+    std::remove(filename);
+}
+
+TEST_CASE("rdfUserStream2", "[rdf]")
+{
+    MemoryStream ms;
+    rdfUserStream2 us = {};
+    us.context = &ms;
+    us.GetSize = MemoryStreamGetSize;
+    us.ReadAt = MemoryStreamReadAt;
+    us.WriteAt = MemoryStreamWriteAt;
+
+    SECTION("Chunk file round-trip")
+    {
+        const int data[64] = {1, 2, 3, 4};
+
+        {
+            auto stream = rdf::Stream::FromUserStream(&us);
+            rdf::ChunkFileWriter writer(stream);
+            writer.WriteChunk("chunk", 4, "head", sizeof(data), data);
+            writer.Close();
+        }
+
+        // File header, chunk header, chunk data, index and the final
+        // header update
+        CHECK(ms.writeCount == 5);
+
+        auto stream = rdf::Stream::FromUserStream(&us);
+        rdf::ChunkFile cf(stream);
+
+        int output[64] = {};
+        REQUIRE(cf.GetChunkDataSize("chunk") == sizeof(data));
+        cf.ReadChunkDataToBuffer("chunk", output);
+        CHECK(::memcmp(output, data, sizeof(data)) == 0);
+    }
+
+    SECTION("Read only stream works")
+    {
+        us.WriteAt = nullptr;
+        rdfStream* stream = nullptr;
+        CHECK(rdfStreamFromUserStream2(&us, &stream) == rdfResultOk);
+        rdfStreamClose(&stream);
+    }
+
+    SECTION("Fails if both read and write are null")
+    {
+        us.ReadAt = nullptr;
+        us.WriteAt = nullptr;
+        rdfStream* stream = nullptr;
+        CHECK(rdfStreamFromUserStream2(&us, &stream) != rdfResultOk);
+        CHECK(stream == nullptr);
+    }
+
+    SECTION("GetSize must not be null")
+    {
+        us.GetSize = nullptr;
+        rdfStream* stream = nullptr;
+        CHECK(rdfStreamFromUserStream2(&us, &stream) != rdfResultOk);
+        CHECK(stream == nullptr);
+    }
+}
+
+TEST_CASE("rdf::Stream::CreateCachedStream", "[rdf]")
+{
+    MemoryStream ms;
+    rdfUserStream2 us = {};
+    us.context = &ms;
+    us.GetSize = MemoryStreamGetSize;
+    us.ReadAt = MemoryStreamReadAt;
+    us.WriteAt = MemoryStreamWriteAt;
+
+    auto inner = rdf::Stream::FromUserStream(&us);
+
+    rdfCachedStreamCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(inner);
+    info.blockSize = 4096;
+    info.cacheSize = 16 * 4096;
+    info.readaheadBlocks = 2;
+
+    SECTION("Chunk files are read with few requests")
+    {
+        std::vector<unsigned char> data(1000);
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<unsigned char>(i);
+        }
+
+        {
+            rdf::ChunkFileWriter writer(inner);
+            for (int i = 0; i < 32; ++i) {
+                writer.WriteChunk("chunk", 8, "header00", data.size(), data.data());
+            }
+            writer.Close();
+        }
+
+        const auto readAllChunks = [&data](rdf::Stream& stream) -> void {
+            rdf::ChunkFile cf(stream);
+            REQUIRE(cf.GetChunkCount("chunk") == 32);
+
+            std::vector<unsigned char> output(data.size());
+            for (int i = 0; i < 32; ++i) {
+                char header[8] = {};
+                cf.ReadChunkHeaderToBuffer("chunk", i, header);
+                cf.ReadChunkDataToBuffer("chunk", i, output.data());
+                REQUIRE(output == data);
+            }
+        };
+
+        ms.readCount = 0;
+        readAllChunks(inner);
+        const int uncachedReadCount = ms.readCount;
+
+        ms.readCount = 0;
+        {
+            auto cached = rdf::Stream::CreateCachedStream(info);
+            readAllChunks(cached);
+        }
+
+        // The file is ~33 KiB, so a handful of block reads suffice
+        CHECK(ms.readCount <= 9);
+        CHECK(ms.readCount < uncachedReadCount / 4);
+    }
+
+    SECTION("Writes are visible to subsequent reads")
+    {
+        auto cached = rdf::Stream::CreateCachedStream(info);
+
+        // Mirror all writes in memory, and read back after every write, so
+        // stale blocks would be noticed
+        std::vector<unsigned char> expected;
+        std::vector<unsigned char> data, output;
+
+        std::uint32_t state = 3;
+        for (int i = 0; i < 200; ++i) {
+            state = state * 1664525 + 1013904223;
+            const std::int64_t offset = (state >> 8) % (80 * 1024);
+            state = state * 1664525 + 1013904223;
+            const std::int64_t size = (state >> 8) % 10000;
+
+            data.assign(size, static_cast<unsigned char>(i));
+            cached.Seek(offset);
+            REQUIRE(cached.Write(size, data.data()) == size);
+
+            if (static_cast<std::size_t>(offset + size) > expected.size()) {
+                expected.resize(offset + size);
+            }
+            std::copy(data.begin(), data.end(), expected.begin() + offset);
+
+            state = state * 1664525 + 1013904223;
+            const std::int64_t readOffset = (state >> 8) % expected.size();
+            output.resize(expected.size() - readOffset);
+            cached.Seek(readOffset);
+            REQUIRE(cached.Read(output.size(), output.data()) ==
+                    static_cast<std::int64_t>(output.size()));
+            REQUIRE(std::equal(output.begin(), output.end(), expected.begin() + readOffset));
+        }
+    }
+
+    SECTION("Invalid block size is rejected")
+    {
+        info.blockSize = 0;
+        rdfStream* stream = nullptr;
+        CHECK(rdfStreamCreateCachedStream(&info, &stream) == rdfResultInvalidArgument);
+        CHECK(stream == nullptr);
+    }
+}
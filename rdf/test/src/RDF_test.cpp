@@ -2,8 +2,13 @@
 #include <catch2/catch.hpp>
 
 #include "amdrdf.h"
+#include <lz4/lz4frame.h>
+#include <xxhash/xxhash.h>
 
+#include <algorithm>
 #include <cstring>
+#include <string>
+#include <thread>
 #include "test_rdf.h"
 
 
@@ -294,6 +299,55 @@ TEST_CASE("rdf::ChunkFileWriter append increments index", "[rdf]")
     CHECK(cf.ContainsChunk("chunk", 1));
 }
 
+TEST_CASE("rdf::ChunkFileWriter append reuses the space of the old index", "[rdf]")
+{
+    auto ms = rdf::Stream::CreateMemoryStream();
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(ms);
+
+    // Each chunk adds an index entry, plus its checksum or key
+    const std::int64_t entrySize = 64 + 8;
+
+    SECTION("Without a trailer")
+    {
+        info.chunkChecksums = true;
+    }
+
+    SECTION("With a trailer")
+    {
+        // Publishing the index stores the keys and the chunk counts in front
+        // of it
+        info.indexPublishInterval = 1;
+    }
+
+    {
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("chunk", 0, nullptr, 4, "Test");
+        writer.Close();
+    }
+
+    info.indexPublishInterval = 0;
+    info.appendToFile = true;
+
+    // The first append may change the layout of the index, later ones only
+    // add the chunk and one entry
+    std::int64_t previousSize = 0;
+    for (int i = 0; i < 3; ++i) {
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("chunk", 0, nullptr, 4, "Test");
+        writer.Close();
+
+        if (i > 0) {
+            CHECK(ms.GetSize() - previousSize == 4 + entrySize);
+        }
+        previousSize = ms.GetSize();
+    }
+
+    rdf::ChunkFile cf(ms);
+    CHECK(cf.GetChunkCount("chunk") == 4);
+}
+
 TEST_CASE("rdf::ChunkFileWriter writes of zero size work with nullptr", "[rdf]")
 {
     auto ms = rdf::Stream::CreateMemoryStream();
@@ -331,3 +385,1415 @@ TEST_CASE("rdf::ChunkFileWriter writes of zero size work with nullptr", "[rdf]")
     CHECK_THROWS(cf.ReadChunkHeaderToBuffer("chunk-nb", 1, nullptr));
     CHECK_THROWS(cf.ReadChunkDataToBuffer("chunk-nh", 1, nullptr));
 }
+
+TEST_CASE("rdf::ChunkFileWriter compression round-trip", "[rdf]")
+{
+    const auto compression = GENERATE(rdfCompressionZstd, rdfCompressionLz4);
+
+    // Cover an empty chunk, a tiny one, one spanning multiple LZ4 blocks and
+    // incompressible data
+    std::vector<unsigned char> compressible(9 * 1024 * 1024 + 17);
+    for (std::size_t i = 0; i < compressible.size(); ++i) {
+        compressible[i] = static_cast<unsigned char>((i / 7) % 31);
+    }
+
+    std::vector<unsigned char> incompressible(256 * 1024);
+    std::uint32_t state = 0x12345678;
+    for (auto& c : incompressible) {
+        state = state * 1664525 + 1013904223;
+        c = static_cast<unsigned char>(state >> 24);
+    }
+
+    auto ms = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(ms);
+        writer.WriteChunk("empty", 0, nullptr, 0, nullptr, compression);
+        writer.WriteChunk("tiny", 0, nullptr, 4, "Test", compression);
+        writer.WriteChunk(
+            "large", 0, nullptr, compressible.size(), compressible.data(), compression);
+        writer.WriteChunk(
+            "random", 0, nullptr, incompressible.size(), incompressible.data(), compression);
+        writer.Close();
+    }
+
+    rdf::ChunkFile cf(ms);
+
+    CHECK(cf.GetChunkDataSize("empty") == 0);
+    CHECK_NOTHROW(cf.ReadChunkDataToBuffer("empty", nullptr));
+
+    cf.ReadChunkData("tiny", [](std::int64_t size, const void* data) -> void {
+        REQUIRE(size == 4);
+        CHECK(::memcmp(data, "Test", 4) == 0);
+    });
+
+    cf.ReadChunkData("large", [&](std::int64_t size, const void* data) -> void {
+        REQUIRE(size == static_cast<std::int64_t>(compressible.size()));
+        CHECK(::memcmp(data, compressible.data(), compressible.size()) == 0);
+    });
+
+    cf.ReadChunkData("random", [&](std::int64_t size, const void* data) -> void {
+        REQUIRE(size == static_cast<std::int64_t>(incompressible.size()));
+        CHECK(::memcmp(data, incompressible.data(), incompressible.size()) == 0);
+    });
+}
+
+TEST_CASE("rdf::ChunkFile verifies LZ4 frame checksums", "[rdf]")
+{
+    std::vector<unsigned char> data(64 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>((i / 7) % 31);
+    }
+
+    // Other writers may add checksums to the frame, which we don't write
+    LZ4F_preferences_t preferences = {};
+    preferences.frameInfo.contentSize = data.size();
+    preferences.frameInfo.blockChecksumFlag = LZ4F_blockChecksumEnabled;
+    preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+    std::vector<unsigned char> frame(LZ4F_compressFrameBound(data.size(), &preferences));
+    const auto frameSize =
+        LZ4F_compressFrame(frame.data(), frame.size(), data.data(), data.size(), &preferences);
+    REQUIRE(!LZ4F_isError(frameSize));
+    frame.resize(frameSize);
+
+    // Build a file with the frame as the data of its only chunk, following the
+    // 32 byte file header, and the index after it
+    const auto createFile = [&data](const std::vector<unsigned char>& chunkData)
+        -> rdf::Stream {
+        auto stream = rdf::Stream::CreateMemoryStream();
+
+        const std::int64_t dataSize = static_cast<std::int64_t>(chunkData.size());
+        const std::int64_t indexOffset = 32 + dataSize;
+        const std::int64_t indexSize = 64;
+        const std::uint32_t version = 3;
+        const std::uint32_t flags = 0;
+
+        stream.Write(8, "AMD_RDF ");
+        stream.Write(sizeof(version), &version);
+        stream.Write(sizeof(flags), &flags);
+        stream.Write(sizeof(indexOffset), &indexOffset);
+        stream.Write(sizeof(indexSize), &indexSize);
+        stream.Write(dataSize, chunkData.data());
+
+        unsigned char entry[64] = {};
+        std::memcpy(entry, "lz4", 3);
+        entry[16] = 2;  // LZ4
+        entry[20] = 1;  // Chunk version
+        const std::int64_t fields[] = {
+            0, 0, 32, dataSize, static_cast<std::int64_t>(data.size())};
+        std::memcpy(entry + 24, fields, sizeof(fields));
+        stream.Write(sizeof(entry), entry);
+
+        return stream;
+    };
+
+    std::vector<unsigned char> output(data.size());
+    {
+        auto stream = createFile(frame);
+        rdf::ChunkFile cf(stream);
+        cf.ReadChunkDataToBuffer("lz4", 0, output.data());
+        CHECK(output == data);
+    }
+
+    // The header checksum follows the magic, the flags, the block descriptor
+    // and the content size, the content checksum ends the frame, and the first
+    // block's checksum follows its data
+    std::uint32_t firstBlockSize = 0;
+    std::memcpy(&firstBlockSize, frame.data() + 15, sizeof(firstBlockSize));
+    firstBlockSize &= 0x7FFFFFFF;
+
+    for (const std::size_t offset :
+         {std::size_t(14), std::size_t(15 + 4 + firstBlockSize), frame.size() - 1}) {
+        auto corrupted = frame;
+        corrupted[offset] ^= 0xFF;
+
+        auto stream = createFile(corrupted);
+        rdf::ChunkFile cf(stream);
+        CHECK_THROWS(cf.ReadChunkDataToBuffer("lz4", 0, output.data()));
+    }
+}
+
+TEST_CASE("rdf::ChunkFileWriter rejects unknown compression", "[rdf]")
+{
+    auto ms = rdf::Stream::CreateMemoryStream();
+    rdf::ChunkFileWriter writer(ms);
+
+    CHECK_THROWS_AS(
+        writer.WriteChunk("chunk", 0, nullptr, 4, "Test", static_cast<rdfCompression>(42)),
+        rdf::ApiException);
+}
+
+TEST_CASE("rdf::ChunkFileWriter stores incompressible chunks uncompressed", "[rdf]")
+{
+    const auto compression = GENERATE(rdfCompressionZstd, rdfCompressionLz4);
+
+    std::vector<unsigned char> data(256 * 1024);
+    std::uint32_t state = 0x12345678;
+    for (auto& c : data) {
+        state = state * 1664525 + 1013904223;
+        c = static_cast<unsigned char>(state >> 24);
+    }
+
+    // Only the first 64 KiB are random, so a sample decides differently than
+    // compressing the whole chunk would
+    std::vector<unsigned char> randomPrefix = data;
+    std::fill(randomPrefix.begin() + 64 * 1024, randomPrefix.end(), 0);
+
+    auto ms = rdf::Stream::CreateMemoryStream();
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(ms);
+    info.compressionThreshold = 0.95f;
+
+    std::int64_t expectedSize = 0;
+
+    SECTION("Random data is stored as-is")
+    {
+        {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data(), compression);
+            writer.Close();
+        }
+
+        // Header, raw data and a single index entry
+        CHECK(ms.GetSize() == static_cast<std::int64_t>(32 + data.size() + 64));
+        expectedSize = data.size();
+    }
+
+    SECTION("Sampling skips compression if the sample is incompressible")
+    {
+        info.compressionSampleSize = 64 * 1024;
+
+        {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk(
+                "chunk", 0, nullptr, randomPrefix.size(), randomPrefix.data(), compression);
+            writer.Close();
+        }
+
+        CHECK(ms.GetSize() == static_cast<std::int64_t>(32 + randomPrefix.size() + 64));
+        data = randomPrefix;
+        expectedSize = data.size();
+    }
+
+    SECTION("Without sampling, the full chunk gets compressed")
+    {
+        {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk(
+                "chunk", 0, nullptr, randomPrefix.size(), randomPrefix.data(), compression);
+            writer.Close();
+        }
+
+        CHECK(ms.GetSize() < static_cast<std::int64_t>(randomPrefix.size()));
+        data = randomPrefix;
+        expectedSize = data.size();
+    }
+
+    rdf::ChunkFile cf(ms);
+    CHECK(cf.GetChunkDataSize("chunk") == expectedSize);
+    cf.ReadChunkData("chunk", [&](std::int64_t size, const void* chunkData) -> void {
+        REQUIRE(size == static_cast<std::int64_t>(data.size()));
+        CHECK(::memcmp(chunkData, data.data(), data.size()) == 0);
+    });
+}
+
+TEST_CASE("rdf::ChunkFileWriter rejects invalid compression options", "[rdf]")
+{
+    auto ms = rdf::Stream::CreateMemoryStream();
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(ms);
+    info.compressionThreshold = -1;
+
+    rdfChunkFileWriter* writer = nullptr;
+    CHECK(rdfChunkFileWriterCreate2(&info, &writer) == rdfResultInvalidArgument);
+    CHECK(writer == nullptr);
+}
+
+TEST_CASE("rdf::ChunkFileWriter concurrent chunk writers", "[rdf]")
+{
+    const auto compression = GENERATE(rdfCompressionNone, rdfCompressionZstd);
+    const std::int64_t asyncMemoryLimit = GENERATE(0, 64 * 1024);
+
+    const int threadCount = 4;
+    const int chunksPerThread = 16;
+    const int itemsPerChunk = 1000;
+
+    auto ms = rdf::Stream::CreateMemoryStream();
+
+    {
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(ms);
+        info.asyncMemoryLimit = asyncMemoryLimit;
+
+        rdf::ChunkFileWriter writer(info);
+
+        // A regular chunk can be written while chunk writers are open
+        auto pending = writer.OpenChunk("pending", 0, nullptr);
+        pending.Append(42);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&writer, compression, t]() -> void {
+                for (int c = 0; c < chunksPerThread; ++c) {
+                    const int header[] = {t, c};
+                    auto chunk = writer.OpenChunk("queue", sizeof(header), header, compression);
+
+                    for (int i = 0; i < itemsPerChunk; ++i) {
+                        chunk.Append(t * 1000000 + c * 1000 + i);
+                    }
+
+                    chunk.Close();
+                }
+            });
+        }
+
+        writer.BeginChunk("regular", 0, nullptr);
+        writer.AppendToChunk(23);
+        writer.EndChunk();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        CHECK(pending.Close() == 0);
+
+        // Discarded chunks don't show up in the file
+        auto discarded = writer.OpenChunk("discarded", 0, nullptr);
+        discarded.Append(1);
+        discarded = writer.OpenChunk("discarded", 0, nullptr);
+        discarded = writer.OpenChunk("discarded", 0, nullptr);
+    }
+
+    rdf::ChunkFile cf(ms);
+    CHECK(cf.GetChunkCount("queue") == threadCount * chunksPerThread);
+    CHECK(cf.GetChunkCount("discarded") == 0);
+    CHECK(cf.GetChunkCount("regular") == 1);
+    CHECK(cf.GetChunkCount("pending") == 1);
+
+    // Every chunk must contain exactly the data of one producer
+    std::vector<int> seen(threadCount * chunksPerThread);
+    for (int i = 0; i < threadCount * chunksPerThread; ++i) {
+        int header[2] = {};
+        REQUIRE(cf.GetChunkHeaderSize("queue", i) == sizeof(header));
+        cf.ReadChunkHeaderToBuffer("queue", i, header);
+
+        std::vector<int> data(itemsPerChunk);
+        REQUIRE(cf.GetChunkDataSize("queue", i) == sizeof(int) * itemsPerChunk);
+        cf.ReadChunkDataToBuffer("queue", i, data.data());
+
+        std::vector<int> expected(itemsPerChunk);
+        for (int j = 0; j < itemsPerChunk; ++j) {
+            expected[j] = header[0] * 1000000 + header[1] * 1000 + j;
+        }
+        CHECK(data == expected);
+
+        seen[header[0] * chunksPerThread + header[1]] += 1;
+    }
+
+    CHECK(std::all_of(seen.begin(), seen.end(), [](int count) { return count == 1; }));
+}
+
+TEST_CASE("rdf::ChunkFileWriter requires chunk writers to be closed", "[rdf]")
+{
+    auto ms = rdf::Stream::CreateMemoryStream();
+    rdf::ChunkFileWriter writer(ms);
+
+    rdfChunkCreateInfo info = {};
+    ::memcpy(info.identifier, "chunk", 5);
+
+    rdfChunkWriter* chunk = nullptr;
+    REQUIRE(rdfChunkFileWriterOpenChunk(nullptr, &info, &chunk) == rdfResultInvalidArgument);
+    CHECK(rdfChunkWriterClose(nullptr, nullptr) == rdfResultInvalidArgument);
+
+    auto pending = writer.OpenChunk("chunk", 0, nullptr);
+
+    // The writer stays valid, so we can still finish the file
+    CHECK_THROWS_AS(writer.Close(), rdf::ApiException);
+
+    pending.Close();
+    writer.Close();
+
+    rdf::ChunkFile cf(ms);
+    CHECK(cf.GetChunkCount("chunk") == 1);
+}
+
+TEST_CASE("rdf::ChunkFileWriter rejects commits while the same thread has a chunk open", "[rdf]")
+{
+    auto source = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(source);
+        writer.WriteChunk("copy", 0, nullptr, 4, "data");
+        writer.Close();
+    }
+
+    rdf::ChunkFile sourceFile(source);
+
+    auto ms = rdf::Stream::CreateMemoryStream();
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(ms);
+    info.asyncMemoryLimit = GENERATE(0, 1024);
+
+    rdf::ChunkFileWriter writer(info);
+
+    writer.BeginChunk("open", 0, nullptr);
+    writer.AppendToChunk(4, "data");
+
+    // Waiting for the open chunk to end would never return
+    auto pending = writer.OpenChunk("pending", 0, nullptr);
+    pending.Append(4, "data");
+    CHECK_THROWS_AS(pending.Close(), rdf::ApiException);
+    CHECK_THROWS_AS(writer.CopyChunk(sourceFile, "copy", 0), rdf::ApiException);
+    CHECK_THROWS_AS(writer.BeginChunk("nested", 0, nullptr), rdf::ApiException);
+
+    writer.EndChunk();
+
+    auto closed = writer.OpenChunk("pending", 0, nullptr);
+    CHECK(closed.Close() == 0);
+    CHECK(writer.CopyChunk(sourceFile, "copy", 0) == 0);
+    writer.Close();
+
+    rdf::ChunkFile cf(ms);
+    CHECK(cf.GetChunkCount("open") == 1);
+    CHECK(cf.GetChunkCount("pending") == 1);
+    CHECK(cf.GetChunkCount("copy") == 1);
+    CHECK(cf.GetChunkCount("nested") == 0);
+}
+
+namespace
+{
+std::vector<unsigned char> ReadStream(rdf::Stream& stream)
+{
+    std::vector<unsigned char> result(stream.GetSize());
+    stream.Seek(0);
+    stream.Read(result.size(), result.data());
+    return result;
+}
+}  // namespace
+
+TEST_CASE("rdf::ChunkFileWriter asynchronous mode", "[rdf]")
+{
+    std::vector<int> records(100000);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        records[i] = static_cast<int>(i % 1000);
+    }
+
+    const auto writeFile = [&records](const std::int64_t asyncMemoryLimit) -> rdf::Stream {
+        auto ms = rdf::Stream::CreateMemoryStream();
+
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(ms);
+        info.asyncMemoryLimit = asyncMemoryLimit;
+
+        rdf::ChunkFileWriter writer(info);
+
+        for (int c = 0; c < 8; ++c) {
+            const rdfCompression compression =
+                c % 3 == 0 ? rdfCompressionNone : (c % 3 == 1 ? rdfCompressionZstd : rdfCompressionLz4);
+
+            writer.BeginChunk("records", sizeof(c), &c, compression);
+            for (std::size_t i = 0; i < records.size(); i += 100) {
+                writer.AppendToChunk(sizeof(int) * 100, records.data() + i);
+            }
+            CHECK(writer.EndChunk() == c);
+
+            auto chunk = writer.OpenChunk("handle", 0, nullptr, compression);
+            chunk.Append(c);
+            CHECK(chunk.Close() == c);
+
+            CHECK(writer.WriteChunk("empty", 0, nullptr, 0, nullptr) == c);
+        }
+
+        writer.Flush();
+        writer.Close();
+
+        return ms;
+    };
+
+    auto synchronous = writeFile(0);
+    const auto expected = ReadStream(synchronous);
+
+    // A memory limit below the chunk size forces the producer to wait for
+    // the background thread. The output must match the synchronous writer
+    const std::int64_t asyncMemoryLimit = GENERATE(1024, 64 * 1024 * 1024);
+    auto asynchronous = writeFile(asyncMemoryLimit);
+    CHECK(ReadStream(asynchronous) == expected);
+
+    rdf::ChunkFile cf(asynchronous);
+    CHECK(cf.GetChunkCount("records") == 8);
+    CHECK(cf.GetChunkDataSize("records", 7) ==
+          static_cast<std::int64_t>(records.size() * sizeof(int)));
+}
+
+TEST_CASE("rdf::ChunkFileWriter copies chunks verbatim", "[rdf]")
+{
+    std::vector<unsigned char> data(64 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i % 13);
+    }
+
+    auto source = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(source);
+        writer.WriteChunk("zstd", 4, "head", data.size(), data.data(), rdfCompressionZstd, 3);
+        writer.WriteChunk("lz4", 0, nullptr, data.size(), data.data(), rdfCompressionLz4, 1);
+        writer.WriteChunk("raw", 0, nullptr, data.size(), data.data(), rdfCompressionNone, 2);
+        writer.WriteChunk("raw", 0, nullptr, 0, nullptr, rdfCompressionNone, 2);
+        writer.Close();
+    }
+
+    rdf::ChunkFile sourceFile(source);
+
+    const std::int64_t asyncMemoryLimit = GENERATE(0, 1024);
+
+    auto target = rdf::Stream::CreateMemoryStream();
+    {
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(target);
+        info.asyncMemoryLimit = asyncMemoryLimit;
+
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("raw", 0, nullptr, 0, nullptr);
+        CHECK(writer.CopyChunk(sourceFile, "zstd", 0) == 0);
+        CHECK(writer.CopyChunk(sourceFile, "lz4", 0) == 0);
+        CHECK(writer.CopyChunk(sourceFile, "raw", 0) == 1);
+        CHECK(writer.CopyChunk(sourceFile, "raw", 1) == 2);
+        CHECK_THROWS_AS(writer.CopyChunk(sourceFile, "raw", 2), rdf::ApiException);
+        writer.Close();
+    }
+
+    rdf::ChunkFile cf(target);
+
+    CHECK(cf.GetChunkCompression("zstd", 0) == rdfCompressionZstd);
+    CHECK(cf.GetChunkCompression("lz4", 0) == rdfCompressionLz4);
+    CHECK(cf.GetChunkCompression("raw", 1) == rdfCompressionNone);
+    CHECK(cf.GetChunkVersion("zstd", 0) == 3);
+    CHECK(cf.GetChunkVersion("raw", 2) == 2);
+    CHECK(cf.GetChunkCount("raw") == 3);
+    CHECK(cf.GetChunkDataSize("raw", 2) == 0);
+
+    char header[4] = {};
+    REQUIRE(cf.GetChunkHeaderSize("zstd", 0) == 4);
+    cf.ReadChunkHeaderToBuffer("zstd", 0, header);
+    CHECK(::memcmp(header, "head", 4) == 0);
+
+    for (const char* id : {"zstd", "lz4", "raw"}) {
+        const int index = ::strcmp(id, "raw") == 0 ? 1 : 0;
+
+        std::vector<unsigned char> output(cf.GetChunkDataSize(id, index));
+        REQUIRE(output.size() == data.size());
+        cf.ReadChunkDataToBuffer(id, index, output.data());
+        CHECK(output == data);
+    }
+
+    // The copy has to be the stored compressed data, not a recompressed one
+    CHECK(target.GetSize() < static_cast<std::int64_t>(2 * data.size()));
+}
+
+
+TEST_CASE("rdf::ChunkFileWriter deduplicates chunk data", "[rdf]")
+{
+    std::vector<unsigned char> data(64 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i % 251);
+    }
+
+    std::vector<unsigned char> otherData = data;
+    otherData.back() ^= 1;
+
+    auto source = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(source);
+        writer.WriteChunk("copy", 0, nullptr, data.size(), data.data(), rdfCompressionNone);
+        writer.Close();
+    }
+
+    rdf::ChunkFile sourceFile(source);
+
+    const auto writeChunks = [&](const bool deduplicateChunks,
+                                 const std::int64_t asyncMemoryLimit) -> rdf::Stream {
+        auto stream = rdf::Stream::CreateMemoryStream();
+
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.asyncMemoryLimit = asyncMemoryLimit;
+        info.deduplicateChunks = deduplicateChunks;
+
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("raw", 0, nullptr, data.size(), data.data());
+        writer.BeginChunk("raw", 4, "head");
+        writer.AppendToChunk(data.size() / 2, data.data());
+        writer.AppendToChunk(data.size() / 2, data.data() + data.size() / 2);
+        writer.EndChunk();
+        writer.WriteChunk("raw", 0, nullptr, otherData.size(), otherData.data());
+        writer.WriteChunk("zstd", 0, nullptr, data.size(), data.data(), rdfCompressionZstd);
+        writer.WriteChunk("zstd", 0, nullptr, data.size(), data.data(), rdfCompressionZstd);
+        writer.WriteChunk("lz4", 0, nullptr, data.size(), data.data(), rdfCompressionLz4);
+        writer.CopyChunk(sourceFile, "copy", 0);
+        writer.Close();
+
+        return stream;
+    };
+
+    const std::int64_t asyncMemoryLimit = GENERATE(0, 1024);
+
+    auto stream = writeChunks(true, asyncMemoryLimit);
+    const auto reference = writeChunks(false, asyncMemoryLimit);
+
+    // Two raw and one zstd copy are stored only once, and the copied chunk
+    // matches the first raw one
+    CHECK(stream.GetSize() < reference.GetSize() - 2 * static_cast<std::int64_t>(data.size()));
+
+    rdf::ChunkFile cf(stream);
+
+    REQUIRE(cf.GetChunkCount("raw") == 3);
+    CHECK(cf.GetChunkHeaderSize("raw", 1) == 4);
+    CHECK(cf.GetChunkCompression("zstd", 1) == rdfCompressionZstd);
+    CHECK(cf.GetChunkCompression("lz4", 0) == rdfCompressionLz4);
+
+    const auto readChunk = [&cf](const char* id, const int index) -> std::vector<unsigned char> {
+        std::vector<unsigned char> output(cf.GetChunkDataSize(id, index));
+        cf.ReadChunkDataToBuffer(id, index, output.data());
+        return output;
+    };
+
+    CHECK(readChunk("raw", 0) == data);
+    CHECK(readChunk("raw", 1) == data);
+    CHECK(readChunk("raw", 2) == otherData);
+    CHECK(readChunk("zstd", 0) == data);
+    CHECK(readChunk("zstd", 1) == data);
+    CHECK(readChunk("lz4", 0) == data);
+    CHECK(readChunk("copy", 0) == data);
+}
+
+TEST_CASE("rdf::ChunkFileWriter aligns chunk data", "[rdf]")
+{
+    std::vector<unsigned char> data(1000);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i % 7 + 1);
+    }
+
+    auto source = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(source);
+        writer.WriteChunk("copy", 3, "hdr", 17, data.data());
+        writer.Close();
+    }
+
+    rdf::ChunkFile sourceFile(source);
+
+    const std::int64_t dataAlignment = GENERATE(64, 4096, 1000);
+    const std::int64_t headerAlignment = GENERATE(0, 16);
+
+    auto stream = rdf::Stream::CreateMemoryStream();
+    {
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.chunkDataAlignment = dataAlignment;
+        info.chunkHeaderAlignment = headerAlignment;
+
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("raw", 5, "head", 33, data.data());
+        writer.BeginChunk("raw", 1, "h");
+        writer.AppendToChunk(10, data.data());
+        writer.AppendToChunk(990, data.data() + 10);
+        writer.EndChunk();
+        writer.WriteChunk("zstd", 2, "hh", data.size(), data.data(), rdfCompressionZstd);
+        writer.WriteChunk("lz4", 0, nullptr, data.size(), data.data(), rdfCompressionLz4);
+        writer.CopyChunk(sourceFile, "copy", 0);
+        writer.Close();
+    }
+
+    const auto file = ReadStream(stream);
+
+    std::int64_t indexOffset = 0, indexSize = 0;
+    ::memcpy(&indexOffset, file.data() + 16, sizeof(indexOffset));
+    ::memcpy(&indexSize, file.data() + 24, sizeof(indexSize));
+    REQUIRE(indexSize == 5 * 64);
+
+    // Everything which isn't a chunk header, chunk data, the file header or
+    // the index must be padding
+    std::vector<bool> used(file.size(), false);
+    std::fill(used.begin(), used.begin() + 32, true);
+    std::fill(used.begin() + indexOffset, used.end(), true);
+
+    for (std::int64_t i = 0; i < indexSize / 64; ++i) {
+        std::int64_t headerOffset = 0, headerSize = 0, dataOffset = 0, dataSize = 0;
+        const auto entry = file.data() + indexOffset + i * 64;
+        ::memcpy(&headerOffset, entry + 24, sizeof(std::int64_t));
+        ::memcpy(&headerSize, entry + 32, sizeof(std::int64_t));
+        ::memcpy(&dataOffset, entry + 40, sizeof(std::int64_t));
+        ::memcpy(&dataSize, entry + 48, sizeof(std::int64_t));
+
+        CHECK(dataOffset % dataAlignment == 0);
+        if (headerAlignment > 0 && headerSize > 0) {
+            CHECK(headerOffset % headerAlignment == 0);
+        }
+
+        std::fill(used.begin() + headerOffset, used.begin() + headerOffset + headerSize, true);
+        std::fill(used.begin() + dataOffset, used.begin() + dataOffset + dataSize, true);
+    }
+
+    bool paddingIsZero = true;
+    for (std::size_t i = 0; i < file.size(); ++i) {
+        if (!used[i] && file[i] != 0) {
+            paddingIsZero = false;
+        }
+    }
+    CHECK(paddingIsZero);
+
+    rdf::ChunkFile cf(stream);
+
+    std::vector<unsigned char> output(data.size());
+    cf.ReadChunkDataToBuffer("raw", 1, output.data());
+    CHECK(output == data);
+    cf.ReadChunkDataToBuffer("zstd", 0, output.data());
+    CHECK(output == data);
+    cf.ReadChunkDataToBuffer("lz4", 0, output.data());
+    CHECK(output == data);
+
+    char header[3] = {};
+    cf.ReadChunkHeaderToBuffer("copy", 0, header);
+    CHECK(::memcmp(header, "hdr", 3) == 0);
+}
+
+TEST_CASE("rdf::ChunkFile opens nested chunk files", "[rdf]")
+{
+    std::vector<int> data(16 * 1024);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<int>(i * 3);
+    }
+
+    auto inner = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(inner);
+        writer.WriteChunk("data", 4, "head", data.size() * sizeof(int), data.data(), rdfCompressionZstd);
+        writer.Close();
+    }
+
+    std::vector<unsigned char> innerFile(inner.GetSize());
+    inner.Seek(0);
+    inner.Read(innerFile.size(), innerFile.data());
+
+    auto outer = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(outer);
+        writer.WriteChunk("other", 0, nullptr, 5, "other");
+        writer.WriteChunk("nested", 0, nullptr, innerFile.size(), innerFile.data());
+        writer.WriteChunk("nested", 0, nullptr, innerFile.size(), innerFile.data(), rdfCompressionZstd);
+        writer.Close();
+    }
+
+    rdf::ChunkFile outerFile(outer);
+
+    {
+        auto nested = outerFile.OpenChunkAsFile("nested", 0);
+        CHECK(nested.GetChunkCount("data") == 1);
+        CHECK(!nested.ContainsChunk("nested"));
+
+        char header[4] = {};
+        nested.ReadChunkHeaderToBuffer("data", 0, header);
+        CHECK(::memcmp(header, "head", 4) == 0);
+
+        std::vector<int> output(data.size());
+        REQUIRE(nested.GetChunkDataSize("data") == static_cast<std::int64_t>(data.size() * sizeof(int)));
+        nested.ReadChunkDataToBuffer("data", output.data());
+        CHECK(output == data);
+    }
+
+    CHECK_THROWS_AS(outerFile.OpenChunkAsFile("nested", 1), rdf::ApiException);
+    CHECK_THROWS_AS(outerFile.OpenChunkAsFile("nested", 2), rdf::ApiException);
+    CHECK_THROWS_AS(outerFile.OpenChunkAsFile("other", 0), rdf::ApiException);
+}
+
+TEST_CASE("rdf::ChunkFile opens multiple files as one", "[rdf]")
+{
+    auto first = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(first);
+        writer.WriteChunk("shared", 0, nullptr, 2, "a0");
+        writer.WriteChunk("first", 0, nullptr, 2, "f0");
+        writer.WriteChunk("shared", 0, nullptr, 2, "a1", rdfCompressionZstd);
+        writer.Close();
+    }
+
+    auto second = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(second);
+        writer.WriteChunk("shared", 2, "hd", 2, "b0", rdfCompressionNone, 7);
+        writer.WriteChunk("second", 0, nullptr, 2, "s0", rdfCompressionLz4);
+        writer.Close();
+    }
+
+    rdf::ChunkFile cf({&first, &second});
+
+    CHECK(cf.GetChunkCount("shared") == 3);
+    CHECK(cf.GetChunkCount("first") == 1);
+    CHECK(cf.GetChunkCount("second") == 1);
+    CHECK(cf.GetChunkVersion("shared", 2) == 7);
+    CHECK(cf.GetChunkHeaderSize("shared", 2) == 2);
+
+    const auto readData = [&cf](const char* id, const int index) -> std::string {
+        std::string result(cf.GetChunkDataSize(id, index), '\0');
+        cf.ReadChunkDataToBuffer(id, index, &result[0]);
+        return result;
+    };
+
+    CHECK(readData("shared", 0) == "a0");
+    CHECK(readData("shared", 1) == "a1");
+    CHECK(readData("shared", 2) == "b0");
+    CHECK(readData("first", 0) == "f0");
+    CHECK(readData("second", 0) == "s0");
+
+    int chunks = 0;
+    for (auto it = cf.GetIterator(); !it.IsAtEnd(); it.Advance()) {
+        ++chunks;
+    }
+    CHECK(chunks == 5);
+
+    // Copying from the union reads from the right file
+    auto merged = rdf::Stream::CreateMemoryStream();
+    {
+        rdf::ChunkFileWriter writer(merged);
+        writer.CopyChunk(cf, "shared", 2);
+        writer.Close();
+    }
+
+    rdf::ChunkFile mergedFile(merged);
+    char data[2] = {};
+    mergedFile.ReadChunkDataToBuffer("shared", 0, data);
+    CHECK(::memcmp(data, "b0", 2) == 0);
+
+    rdfChunkFile* handle = nullptr;
+    CHECK(rdfChunkFileOpenMulti(nullptr, 1, &handle) == rdfResultInvalidArgument);
+    rdfStream* streams[] = {static_cast<rdfStream*>(first)};
+    CHECK(rdfChunkFileOpenMulti(streams, 0, &handle) == rdfResultInvalidArgument);
+}
+
+TEST_CASE("rdf::ChunkFile follows a file while it's being written", "[rdf]")
+{
+    rdfChunkFileWriterCreateInfo info = {};
+    info.indexPublishInterval = 1;
+
+    SECTION("Shared stream")
+    {
+        auto stream = rdf::Stream::CreateMemoryStream();
+        info.stream = static_cast<rdfStream*>(stream);
+
+        rdf::ChunkFileWriter writer(info);
+
+        rdf::ChunkFile cf(stream);
+        CHECK(!cf.ContainsChunk("chunk"));
+        CHECK(!cf.Refresh());
+
+        writer.WriteChunk("chunk", 0, nullptr, 3, "abc");
+        CHECK(cf.Refresh());
+        CHECK(cf.GetChunkCount("chunk") == 1);
+        CHECK(!cf.Refresh());
+
+        // A header which doesn't match the index, as if it was read while
+        // being updated, is skipped
+        std::int64_t header[4] = {};
+        stream.Seek(0);
+        stream.Read(sizeof(header), header);
+        header[3] += 64;
+        stream.Seek(0);
+        stream.Write(sizeof(header), header);
+
+        CHECK(!cf.Refresh());
+        CHECK(cf.GetChunkCount("chunk") == 1);
+
+        writer.WriteChunk("chunk", 0, nullptr, 3, "def", rdfCompressionZstd);
+        CHECK(cf.Refresh());
+        REQUIRE(cf.GetChunkCount("chunk") == 2);
+
+        char data[3] = {};
+        cf.ReadChunkDataToBuffer("chunk", 1, data);
+        CHECK(::memcmp(data, "def", 3) == 0);
+
+        writer.Close();
+        CHECK(cf.Refresh());
+        CHECK(cf.GetChunkCount("chunk") == 2);
+    }
+
+    SECTION("Separate file handles")
+    {
+        const char* filename = "rdf-live-index.rdf";
+
+        {
+            auto output = rdf::Stream::CreateFile(filename);
+            info.stream = static_cast<rdfStream*>(output);
+
+            rdf::ChunkFileWriter writer(info);
+
+            auto input = rdf::Stream::OpenFile(filename);
+            rdf::ChunkFile cf(input);
+            CHECK(cf.GetChunkCount("chunk") == 0);
+
+            for (int i = 0; i < 3; ++i) {
+                writer.WriteChunk("chunk", 0, nullptr, sizeof(i), &i);
+                CHECK(cf.Refresh());
+                REQUIRE(cf.GetChunkCount("chunk") == i + 1);
+
+                int data = -1;
+                cf.ReadChunkDataToBuffer("chunk", i, &data);
+                CHECK(data == i);
+            }
+
+            writer.Close();
+        }
+
+        // Appending keeps publishing
+        {
+            auto output =
+                rdf::Stream::FromFile(filename, rdfStreamAccessReadWrite, rdfFileModeOpen);
+            info.stream = static_cast<rdfStream*>(output);
+            info.appendToFile = true;
+
+            rdf::ChunkFileWriter writer(info);
+
+            auto input = rdf::Stream::OpenFile(filename);
+            rdf::ChunkFile cf(input);
+            CHECK(cf.GetChunkCount("chunk") == 3);
+
+            writer.WriteChunk("chunk", 0, nullptr, 3, "abc");
+            CHECK(cf.Refresh());
+            CHECK(cf.GetChunkCount("chunk") == 4);
+
+            writer.Close();
+        }
+
+        std::remove(filename);
+    }
+
+    SECTION("Appending requires a file written with a publish interval")
+    {
+        auto stream = rdf::Stream::CreateMemoryStream();
+        {
+            rdf::ChunkFileWriter writer(stream);
+            writer.WriteChunk("chunk", 0, nullptr, 3, "abc");
+            writer.Close();
+        }
+
+        info.stream = static_cast<rdfStream*>(stream);
+        info.appendToFile = true;
+
+        rdfChunkFileWriter* writer = nullptr;
+        CHECK(rdfChunkFileWriterCreate2(&info, &writer) != rdfResultOk);
+    }
+}
+
+TEST_CASE("rdf::ChunkFile opens a file whose writer crashed", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(stream);
+    info.indexPublishByteInterval = 1024;
+
+    // Copy the file as it is right now, as if the writer stopped here
+    const auto snapshot = [&stream]() -> std::vector<unsigned char> {
+        std::vector<unsigned char> data(stream.GetSize());
+        stream.Seek(0);
+        stream.Read(data.size(), data.data());
+        return data;
+    };
+
+    const auto getVersion = [](const std::vector<unsigned char>& data) -> std::uint32_t {
+        std::uint32_t version = 0;
+        ::memcpy(&version, data.data() + 8, sizeof(version));
+        return version;
+    };
+
+    std::vector<unsigned char> data(1000);
+    std::vector<unsigned char> crashed;
+
+    {
+        rdf::ChunkFileWriter writer(info);
+
+        std::int64_t previousSize = stream.GetSize();
+        for (int i = 0; i < 8; ++i) {
+            std::fill(data.begin(), data.end(), static_cast<unsigned char>(i));
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data());
+
+            // Every other chunk crosses the interval. Publishing only adds
+            // the chunk counts, the new entries and the trailer, not the
+            // whole index
+            if (i % 2 == 1) {
+                CHECK(stream.GetSize() - previousSize == 2 * 1000 + 24 + 2 * (8 + 64) + 56);
+                previousSize = stream.GetSize();
+            }
+        }
+
+        // The last chunk isn't published yet
+        writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data());
+        crashed = snapshot();
+
+        writer.Close();
+    }
+
+    CHECK(getVersion(crashed) == 4);
+    CHECK(getVersion(snapshot()) == 3);
+
+    auto crashedStream = rdf::Stream::FromReadOnlyMemory(crashed.size(), crashed.data());
+    rdf::ChunkFile cf(crashedStream);
+    REQUIRE(cf.GetChunkCount("chunk") == 8);
+
+    for (int i = 0; i < 8; ++i) {
+        cf.ReadChunkDataToBuffer("chunk", i, data.data());
+        CHECK(data[0] == i);
+        CHECK(data[999] == i);
+    }
+
+    // Appending picks up where the last published segment ends
+    auto appended = rdf::Stream::CreateMemoryStream();
+    appended.Write(crashed.size(), crashed.data());
+
+    info.stream = static_cast<rdfStream*>(appended);
+    info.appendToFile = true;
+
+    {
+        rdf::ChunkFileWriter writer(info);
+        writer.WriteChunk("other", 0, nullptr, 3, "abc");
+        writer.Close();
+    }
+
+    rdf::ChunkFile appendedFile(appended);
+    CHECK(appendedFile.GetChunkCount("chunk") == 8);
+    CHECK(appendedFile.GetChunkCount("other") == 1);
+}
+
+TEST_CASE("rdf::ChunkFileWriter appends incrementally", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    {
+        rdf::ChunkFileWriter writer(stream);
+        for (int i = 0; i < 100; ++i) {
+            writer.WriteChunk("chunk", 0, nullptr, sizeof(i), &i);
+        }
+        writer.Close();
+    }
+
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(stream);
+    info.appendToFile = true;
+    info.incrementalAppend = true;
+
+    const auto append = [&info](const char* id, const int value) -> int {
+        rdf::ChunkFileWriter writer(info);
+        const int index = writer.WriteChunk(id, 0, nullptr, sizeof(value), &value);
+        writer.Close();
+        return index;
+    };
+
+    // The first append converts the index, so later appends can link to it
+    CHECK(append("chunk", 100) == 100);
+
+    for (int i = 0; i < 3; ++i) {
+        const auto size = stream.GetSize();
+        CHECK(append("chunk", 101 + i) == 101 + i);
+
+        // Chunk data, chunk counts, one index entry and the trailer
+        CHECK(stream.GetSize() - size == 4 + 24 + 8 + 64 + 56);
+    }
+
+    CHECK(append("other", -1) == 0);
+
+    const auto getVersion = [&stream]() -> std::uint32_t {
+        const auto data = ReadStream(stream);
+        std::uint32_t version = 0;
+        ::memcpy(&version, data.data() + 8, sizeof(version));
+        return version;
+    };
+
+    // Segmented files stay at version 4 once the writer is done
+    CHECK(getVersion() == 4);
+
+    rdf::ChunkFile cf(stream);
+    REQUIRE(cf.GetChunkCount("chunk") == 104);
+    CHECK(cf.GetChunkCount("other") == 1);
+
+    for (int i = 0; i < 104; ++i) {
+        int value = -1;
+        cf.ReadChunkDataToBuffer("chunk", i, &value);
+        CHECK(value == i);
+    }
+
+    // A regular append writes the complete index again
+    info.incrementalAppend = false;
+    CHECK(append("chunk", 104) == 104);
+
+    rdf::ChunkFile rewritten(stream);
+    CHECK(rewritten.GetChunkCount("chunk") == 105);
+    CHECK(getVersion() == 3);
+}
+
+TEST_CASE("rdf::ChunkFile::Compact removes unused space", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    std::vector<unsigned char> large(100000, 7);
+    {
+        rdf::ChunkFileWriter writer(stream);
+        writer.WriteChunk("small", 4, "hdr0", 3, "abc");
+        writer.WriteChunk("large", 0, nullptr, large.size(), large.data(), rdfCompressionZstd);
+        writer.WriteChunk("small", 4, "hdr1", 3, "def");
+        writer.WriteChunk("large", 0, nullptr, large.size(), large.data());
+        writer.WriteChunk("small", 0, nullptr, 0, nullptr);
+        writer.Close();
+    }
+
+    {
+        rdf::ChunkFileWriter writer(stream, rdf::ChunkFileWriteMode::Append);
+        writer.RemoveChunk("large", 1);
+        writer.RemoveChunk("small", 0);
+
+        // The removed chunk doesn't exist anymore, and indices moved down
+        CHECK_THROWS(writer.RemoveChunk("small", 2));
+        writer.Close();
+    }
+
+    const auto removedSize = stream.GetSize();
+
+    const auto check = [&large](rdf::Stream& compacted) -> void {
+        rdf::ChunkFile cf(compacted);
+        REQUIRE(cf.GetChunkCount("small") == 2);
+        REQUIRE(cf.GetChunkCount("large") == 1);
+
+        char header[4] = {};
+        char data[3] = {};
+        cf.ReadChunkHeaderToBuffer("small", 0, header);
+        cf.ReadChunkDataToBuffer("small", 0, data);
+        CHECK(::memcmp(header, "hdr1", 4) == 0);
+        CHECK(::memcmp(data, "def", 3) == 0);
+        CHECK(cf.GetChunkDataSize("small", 1) == 0);
+
+        CHECK(cf.GetChunkCompression("large", 0) == rdfCompressionZstd);
+        std::vector<unsigned char> output(large.size());
+        cf.ReadChunkDataToBuffer("large", 0, output.data());
+        CHECK(output == large);
+    };
+
+    SECTION("To a new stream")
+    {
+        auto compacted = rdf::Stream::CreateMemoryStream();
+        rdf::ChunkFile::Compact(stream, compacted);
+
+        CHECK(compacted.GetSize() < removedSize - static_cast<std::int64_t>(large.size()));
+        check(compacted);
+    }
+
+    SECTION("In place")
+    {
+        rdf::ChunkFile::Compact(stream, stream);
+
+        CHECK(stream.GetSize() < removedSize - static_cast<std::int64_t>(large.size()));
+        check(stream);
+    }
+}
+
+TEST_CASE("rdf::ChunkFile finds chunks by key range", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    // Keys out of order, with a duplicate
+    const std::uint64_t keys[] = {30, 10, 20, 10, 50};
+
+    {
+        rdf::ChunkFileWriter writer(stream);
+        for (const auto key : keys) {
+            writer.WriteChunk("event", 0, nullptr, 8, &key, rdfCompressionNone, 1, key);
+        }
+
+        writer.BeginChunk("other", 0, nullptr, rdfCompressionNone, 1, 20);
+        writer.EndChunk();
+        writer.WriteChunk("plain", 0, nullptr, 0, nullptr);
+        writer.Close();
+    }
+
+    const auto check = [](rdf::ChunkFile& cf) -> void {
+        CHECK(cf.GetChunkKey("event", 0) == 30);
+        CHECK(cf.GetChunkKey("event", 4) == 50);
+        CHECK(cf.GetChunkKey("plain", 0) == 0);
+
+        CHECK(cf.FindChunksByKeyRange("event", 10, 20) == std::vector<int>{1, 3, 2});
+        CHECK(cf.FindChunksByKeyRange("event", 11, 49) == std::vector<int>{2, 0});
+        CHECK(cf.FindChunksByKeyRange("event", 0, ~0ULL) == std::vector<int>{1, 3, 2, 0, 4});
+        CHECK(cf.FindChunksByKeyRange("event", 51, 100).empty());
+        CHECK(cf.FindChunksByKeyRange("event", 20, 10).empty());
+        CHECK(cf.FindChunksByKeyRange("other", 20, 20) == std::vector<int>{0});
+        CHECK(cf.FindChunksByKeyRange("missing", 0, ~0ULL).empty());
+    };
+
+    SECTION("Read")
+    {
+        rdf::ChunkFile cf(stream);
+        check(cf);
+    }
+
+    SECTION("Copied and compacted")
+    {
+        auto copy = rdf::Stream::CreateMemoryStream();
+        {
+            rdf::ChunkFile cf(stream);
+            rdf::ChunkFileWriter writer(copy);
+            for (int i = 0; i < 5; ++i) {
+                writer.CopyChunk(cf, "event", i);
+            }
+            writer.CopyChunk(cf, "other", 0);
+            writer.CopyChunk(cf, "plain", 0);
+            writer.Close();
+        }
+
+        rdf::ChunkFile::Compact(copy, copy);
+
+        rdf::ChunkFile cf(copy);
+        check(cf);
+    }
+
+    SECTION("Appended incrementally")
+    {
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.appendToFile = true;
+        info.incrementalAppend = true;
+
+        // The first append rewrites the index with room for keys, the
+        // second one only adds a segment
+        for (const std::uint64_t key : {40, 10}) {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("event", 0, nullptr, 0, nullptr, rdfCompressionNone, 1, key);
+            writer.Close();
+        }
+
+        rdf::ChunkFile cf(stream);
+        CHECK(cf.FindChunksByKeyRange("event", 10, 40) == std::vector<int>{1, 3, 6, 2, 0, 5});
+        CHECK(cf.GetChunkKey("event", 6) == 10);
+    }
+}
+
+TEST_CASE("rdf::ChunkFile::LoadAllHeaders serves headers from memory", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    // Large chunks in between force more than one read
+    std::vector<unsigned char> large(64 * 1024, 3);
+    {
+        rdf::ChunkFileWriter writer(stream);
+        for (int i = 0; i < 100; ++i) {
+            const std::string header = "header" + std::to_string(i);
+            writer.WriteChunk("chunk", header.size(), header.data(), 4, "data");
+
+            if (i % 10 == 0) {
+                writer.WriteChunk("large", 4, &i, large.size(), large.data());
+            }
+        }
+        writer.WriteChunk("empty", 0, nullptr, 4, "data");
+        writer.Close();
+    }
+
+    rdf::ChunkFile cf(stream);
+    CHECK_THROWS(cf.GetChunkHeader("chunk", 0));
+
+    cf.LoadAllHeaders();
+
+    for (int i = 0; i < 100; ++i) {
+        const std::string expected = "header" + std::to_string(i);
+        REQUIRE(cf.GetChunkHeaderSize("chunk", i) == static_cast<std::int64_t>(expected.size()));
+
+        const auto header = static_cast<const char*>(cf.GetChunkHeader("chunk", i));
+        CHECK(std::string(header, expected.size()) == expected);
+
+        std::string buffer(expected.size(), '\0');
+        cf.ReadChunkHeaderToBuffer("chunk", i, &buffer[0]);
+        CHECK(buffer == expected);
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        int header = 0;
+        cf.ReadChunkHeaderToBuffer("large", i, &header);
+        CHECK(header == i * 10);
+    }
+
+    CHECK(cf.GetChunkHeader("empty", 0) == nullptr);
+}
+
+TEST_CASE("rdf::ChunkFile verifies chunk checksums", "[rdf]")
+{
+    auto stream = rdf::Stream::CreateMemoryStream();
+
+    std::vector<unsigned char> data(10000);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<unsigned char>(i / 7);
+    }
+
+    // The first chunk has no header, so its data follows the file header
+    const auto corruptFirstChunk = [&stream](const std::int64_t offset = 32) -> void {
+        unsigned char c = 0;
+        stream.Seek(offset);
+        stream.Read(1, &c);
+        c ^= 0xFF;
+        stream.Seek(offset);
+        stream.Write(1, &c);
+    };
+
+    SECTION("Stored chunks")
+    {
+        {
+            rdfChunkFileWriterCreateInfo info = {};
+            info.stream = static_cast<rdfStream*>(stream);
+            info.chunkChecksums = true;
+
+            rdf::ChunkFileWriter writer(info);
+            writer.BeginChunk("plain", 0, nullptr);
+            writer.AppendToChunk(5000, data.data());
+            writer.AppendToChunk(5000, data.data() + 5000);
+            writer.EndChunk();
+
+            writer.WriteChunk("zstd", 4, "head", data.size(), data.data(), rdfCompressionZstd);
+            writer.WriteChunk("lz4", 0, nullptr, data.size(), data.data(), rdfCompressionLz4);
+            writer.WriteChunk("empty", 0, nullptr, 0, nullptr);
+
+            auto chunk = writer.OpenChunk("staged", 0, nullptr, rdfCompressionZstd);
+            chunk.Append(data.size(), data.data());
+            chunk.Close();
+
+            writer.Close();
+        }
+
+        {
+            rdf::ChunkFile cf(stream);
+            CHECK(cf.VerifyChecksums() == 0);
+
+            cf.SetVerifyChecksums(true);
+            std::vector<unsigned char> output(data.size());
+            for (const char* id : {"plain", "zstd", "lz4", "staged"}) {
+                cf.ReadChunkDataToBuffer(id, 0, output.data());
+                CHECK(output == data);
+            }
+        }
+
+        corruptFirstChunk();
+
+        rdf::ChunkFile cf(stream);
+        CHECK(cf.VerifyChecksums() == 1);
+
+        std::vector<unsigned char> output(data.size());
+        cf.ReadChunkDataToBuffer("plain", 0, output.data());
+
+        cf.SetVerifyChecksums(true);
+        CHECK_THROWS(cf.ReadChunkDataToBuffer("plain", 0, output.data()));
+        cf.ReadChunkDataToBuffer("zstd", 0, output.data());
+    }
+
+    SECTION("Copied chunks keep their checksum")
+    {
+        auto source = rdf::Stream::CreateMemoryStream();
+        {
+            rdfChunkFileWriterCreateInfo info = {};
+            info.stream = static_cast<rdfStream*>(source);
+            info.chunkChecksums = true;
+
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data());
+            writer.Close();
+        }
+
+        {
+            rdfChunkFileWriterCreateInfo info = {};
+            info.stream = static_cast<rdfStream*>(stream);
+            info.chunkChecksums = true;
+
+            rdf::ChunkFile cf(source);
+            rdf::ChunkFileWriter writer(info);
+            writer.CopyChunk(cf, "chunk", 0);
+            writer.Close();
+        }
+
+        corruptFirstChunk();
+
+        rdf::ChunkFile cf(stream);
+        CHECK(cf.VerifyChecksums() == 1);
+    }
+
+    SECTION("Checksums are XXH3")
+    {
+        {
+            rdfChunkFileWriterCreateInfo info = {};
+            info.stream = static_cast<rdfStream*>(stream);
+            info.chunkChecksums = true;
+
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data(), rdfCompressionZstd);
+            writer.Close();
+        }
+
+        // Without keys, the checksums are right in front of the index
+        std::int64_t indexOffset = 0;
+        stream.Seek(16);
+        stream.Read(sizeof(indexOffset), &indexOffset);
+
+        std::uint64_t checksum = 0;
+        stream.Seek(indexOffset - 8);
+        stream.Read(sizeof(checksum), &checksum);
+
+        CHECK(checksum == XXH3_64bits(data.data(), data.size()));
+    }
+
+    SECTION("Index segments")
+    {
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(stream);
+        info.chunkChecksums = true;
+        info.indexPublishInterval = 1;
+
+        {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data());
+            writer.Close();
+        }
+
+        info.indexPublishInterval = 0;
+        info.appendToFile = true;
+        info.incrementalAppend = true;
+
+        {
+            rdf::ChunkFileWriter writer(info);
+            writer.WriteChunk("chunk", 0, nullptr, data.size(), data.data(), rdfCompressionZstd);
+            writer.Close();
+        }
+
+        {
+            rdf::ChunkFile cf(stream);
+            REQUIRE(cf.GetChunkCount("chunk") == 2);
+            CHECK(cf.VerifyChecksums() == 0);
+        }
+
+        // After the empty index published when the file was created
+        corruptFirstChunk(32 + 56);
+
+        rdf::ChunkFile cf(stream);
+        CHECK(cf.VerifyChecksums() == 1);
+    }
+
+    SECTION("Corrupt compressed data is detected without checksums")
+    {
+        {
+            rdf::ChunkFileWriter writer(stream);
+            writer.WriteChunk("zstd", 0, nullptr, data.size(), data.data(), rdfCompressionZstd);
+            writer.Close();
+        }
+
+        corruptFirstChunk();
+
+        rdf::ChunkFile cf(stream);
+        std::vector<unsigned char> output(data.size());
+        CHECK_THROWS(cf.ReadChunkDataToBuffer("zstd", 0, output.data()));
+
+        // Chunks without a checksum can't be verified
+        CHECK(cf.VerifyChecksums() == 0);
+    }
+}
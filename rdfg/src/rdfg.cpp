@@ -82,6 +82,8 @@ int CreateChunkFile(const std::string& input, const std::string& output,
             const auto c = chunk["compression"].get<std::string>();
             if (c == "zstd" || c == "zstandard") {
                 compression = rdfCompressionZstd;
+            } else if (c == "lz4") {
+                compression = rdfCompressionLz4;
             }
         }
 
@@ -133,12 +135,17 @@ int CreateChunkFile(const std::string& input, const std::string& output,
 int AddToChunkFile(const std::string& chunkFileName,
                    const std::string& dataFileName, 
     const std::string& headerFileName,
-    const std::string& chunkName, const bool verbose)
+    const std::string& chunkName, const bool incremental, const bool verbose)
 {
     rdf::Stream stream = rdf::Stream::FromFile(
         chunkFileName.c_str(), rdfStreamAccess::rdfStreamAccessReadWrite, rdfFileModeOpen);
 
-    rdf::ChunkFileWriter writer(stream, rdf::ChunkFileWriteMode::Append);
+    rdfChunkFileWriterCreateInfo info = {};
+    info.stream = static_cast<rdfStream*>(stream);
+    info.appendToFile = true;
+    info.incrementalAppend = incremental;
+
+    rdf::ChunkFileWriter writer(info);
 
     const auto data = ReadFile(dataFileName);
     const auto header = ReadFile(headerFileName);
@@ -164,6 +171,7 @@ int main(int argc, char* argv[])
 
     std::string input, output;
     bool verbose = false;
+    bool incremental = false;
 
     auto createChunkFile =
         app.add_subcommand("create", "Create a chunk file from the provided input");
@@ -177,6 +185,8 @@ int main(int argc, char* argv[])
     addToChunkFile->add_option("data", data, "The file containting the data to add")->required();
     addToChunkFile->add_option("file", input, "The chunk file to add to")->required();
     addToChunkFile->add_option("--header", header, "The file containing the chunk header data");
+    addToChunkFile->add_flag(
+        "-i,--incremental", incremental, "Only write the index of the new chunk");
     addToChunkFile->add_flag("-v,--verbose", verbose);
 
     CLI11_PARSE(app, argc, argv);
@@ -185,7 +195,7 @@ int main(int argc, char* argv[])
         if (*createChunkFile) {
             return CreateChunkFile(input, output, verbose);
         } else if (*addToChunkFile) {
-            return AddToChunkFile(input, data, header, chunkName, verbose);
+            return AddToChunkFile(input, data, header, chunkName, incremental, verbose);
         }
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << std::endl;
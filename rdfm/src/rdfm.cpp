@@ -6,7 +6,15 @@
 
 #include <cstddef>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
 
 namespace
 {
@@ -36,13 +44,103 @@ std::set<std::string> GetChunkIdentifiers(rdf::ChunkFile& cf)
     return chunkIds;
 }
 
-void CopyChunks(rdf::ChunkFile& cf, rdf::ChunkFileWriter& output, const bool compress)
+/**
+A chunk which had to be decompressed and/or recompressed. It's stored as the
+only chunk of an in-memory chunk file, so the writer thread can copy it to
+the output verbatim.
+*/
+struct TranscodedChunk
 {
+    std::unique_ptr<rdf::Stream> stream;
+    std::unique_ptr<rdf::ChunkFile> chunkFile;
+    std::string id;
+};
+
+/**
+Transcoded chunks of one input, in the order in which the writer needs them.
+Workers block once too much data is queued, which bounds the memory use.
+*/
+class TranscodedChunkQueue
+{
+public:
+    static constexpr std::int64_t MaxQueuedBytes = 32 * 1024 * 1024;
+
+    void Push(TranscodedChunk&& chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() -> bool {
+            return cancelled_ || queue_.empty() || queuedBytes_ < MaxQueuedBytes;
+        });
+
+        queuedBytes_ += chunk.stream->GetSize();
+        queue_.push_back(std::move(chunk));
+        changed_.notify_all();
+    }
+
+    TranscodedChunk Pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() -> bool { return error_ || !queue_.empty(); });
+
+        // Everything before the error is still valid, so only report it once
+        // the writer got to the point where it failed
+        if (queue_.empty()) {
+            std::rethrow_exception(error_);
+        }
+
+        TranscodedChunk chunk = std::move(queue_.front());
+        queue_.pop_front();
+        queuedBytes_ -= chunk.stream->GetSize();
+        changed_.notify_all();
+
+        return chunk;
+    }
+
+    void SetError(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = error;
+        changed_.notify_all();
+    }
+
+    bool IsCancelled()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cancelled_;
+    }
+
+    void Cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_ = true;
+        changed_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<TranscodedChunk> queue_;
+    std::int64_t queuedBytes_ = 0;
+    std::exception_ptr error_;
+    bool cancelled_ = false;
+};
+
+/**
+Read all chunks of an input which can't be copied as-is, and transcode them
+into the requested compression. Runs on a worker thread, using its own handle
+to the input file.
+*/
+void TranscodeChunks(const std::string& input,
+                     const rdfCompression compression,
+                     TranscodedChunkQueue& queue)
+{
+    rdf::ChunkFile cf(input.c_str());
+
     std::vector<std::byte> headerBuffer, dataBuffer;
     auto it = cf.GetIterator();
 
     for (;;) {
-        if (it.IsAtEnd()) {
+        if (it.IsAtEnd() || queue.IsCancelled()) {
             break;
         }
 
@@ -50,13 +148,15 @@ void CopyChunks(rdf::ChunkFile& cf, rdf::ChunkFileWriter& output, const bool com
         it.GetChunkIdentifier(id);
 
         const auto index = it.GetChunkIndex();
-        const auto version = cf.GetChunkVersion(id, index);
+        it.Advance();
 
-        {
-            const auto chunkHeaderSize = cf.GetChunkHeaderSize(id, index);
-            headerBuffer.resize(chunkHeaderSize);
+        if (cf.GetChunkCompression(id, index) == compression) {
+            continue;
         }
 
+        const auto version = cf.GetChunkVersion(id, index);
+
+        headerBuffer.resize(cf.GetChunkHeaderSize(id, index));
         // if a vector is empty, .data() may return a nullptr, in which case
         // the Read*ToBuffer machinery will fail due to an invalid argument
         // That's why we need to branch here and below
@@ -64,59 +164,182 @@ void CopyChunks(rdf::ChunkFile& cf, rdf::ChunkFileWriter& output, const bool com
             cf.ReadChunkHeaderToBuffer(id, index, headerBuffer.data());
         }
 
+        dataBuffer.resize(cf.GetChunkDataSize(id, index));
+        if (!dataBuffer.empty()) {
+            cf.ReadChunkDataToBuffer(id, index, dataBuffer.data());
+        }
+
+        TranscodedChunk chunk;
+        chunk.stream = std::make_unique<rdf::Stream>(rdf::Stream::CreateMemoryStream());
+        chunk.id = id;
+
         {
-            const auto chunkDataSize = cf.GetChunkDataSize(id, index);
-            dataBuffer.resize(chunkDataSize);
+            rdf::ChunkFileWriter writer(*chunk.stream);
+            writer.WriteChunk(id,
+                              headerBuffer.size(),
+                              headerBuffer.data(),
+                              dataBuffer.size(),
+                              dataBuffer.data(),
+                              compression,
+                              version);
+            writer.Close();
         }
 
-        if (!dataBuffer.empty()) {
-            cf.ReadChunkDataToBuffer(id, index, dataBuffer.data());
+        chunk.chunkFile = std::make_unique<rdf::ChunkFile>(*chunk.stream);
+        queue.Push(std::move(chunk));
+    }
+}
+
+/**
+Copy all chunks of an input to the output, in iteration order. Chunks which
+already use the requested compression are copied directly from the input,
+all others are taken from the queue filled by TranscodeChunks.
+*/
+void CopyChunks(rdf::ChunkFile& cf,
+                rdf::ChunkFileWriter& output,
+                const rdfCompression compression,
+                TranscodedChunkQueue& transcodedChunks)
+{
+    auto it = cf.GetIterator();
+
+    for (;;) {
+        if (it.IsAtEnd()) {
+            break;
         }
 
-        output.WriteChunk(id,
-                          headerBuffer.size(),
-                          headerBuffer.data(),
-                          dataBuffer.size(),
-                          dataBuffer.data(),
-                          compress ? rdfCompressionZstd : rdfCompressionNone,
-                          version);
+        char id[RDF_IDENTIFIER_SIZE + 1] = {};
+        it.GetChunkIdentifier(id);
+
+        const auto index = it.GetChunkIndex();
+
+        if (cf.GetChunkCompression(id, index) == compression) {
+            output.CopyChunk(cf, id, index);
+        } else {
+            auto chunk = transcodedChunks.Pop();
+            output.CopyChunk(*chunk.chunkFile, chunk.id.c_str(), 0);
+        }
 
         it.Advance();
     }
 }
 
-int MergeChunkFiles(const std::string& input1,
-                    const std::string& input2,
+int MergeChunkFiles(const std::vector<std::string>& inputs,
                     const std::string& output,
-                    const bool compress)
+                    const bool compress,
+                    const int jobs)
 {
-    rdf::ChunkFile chunkFile1(input1.c_str());
-    rdf::ChunkFile chunkFile2(input2.c_str());
+    if (std::find(inputs.begin(), inputs.end(), output) != inputs.end()) {
+        std::cerr << "The output file must not be one of the input files." << std::endl;
+
+        return 1;
+    }
 
-    const auto file1Ids = GetChunkIdentifiers(chunkFile1);
-    const auto file2Ids = GetChunkIdentifiers(chunkFile2);
+    // Check for conflicts in one pass over all indices, before we start
+    // writing anything
+    {
+        std::map<std::string, std::size_t> chunkIdOwner;
+        bool hasConflicts = false;
+
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            rdf::ChunkFile chunkFile(inputs[i].c_str());
+
+            for (const auto& id : GetChunkIdentifiers(chunkFile)) {
+                const auto owner = chunkIdOwner.emplace(id, i);
+                if (!owner.second) {
+                    std::cerr << "Chunk identifier '" << id << "' is present in both '"
+                              << inputs[owner.first->second] << "' and '" << inputs[i] << "'."
+                              << std::endl;
+                    hasConflicts = true;
+                }
+            }
+        }
 
-    std::vector<std::string> intersection;
-    std::set_intersection(file1Ids.begin(),
-                          file1Ids.end(),
-                          file2Ids.begin(),
-                          file2Ids.end(),
-                          std::back_inserter(intersection));
+        if (hasConflicts) {
+            std::cerr << "Cannot merge files containing the same chunk identifiers." << std::endl;
 
-    if (!intersection.empty()) {
-        std::cerr << "Cannot merge files containing the same chunk identifiers." << std::endl;
+            return 1;
+        }
+    }
 
-        return 1;
+    const auto compression = compress ? rdfCompressionZstd : rdfCompressionNone;
+
+    // Workers pick up inputs in order, so the input the writer is working on
+    // is always being transcoded already, and workers run at most `jobs`
+    // inputs ahead of the writer
+    std::vector<TranscodedChunkQueue> queues(inputs.size());
+    std::atomic<std::size_t> nextInput{0};
+
+    const auto worker = [&]() -> void {
+        for (;;) {
+            const std::size_t i = nextInput++;
+            if (i >= inputs.size()) {
+                return;
+            }
+
+            try {
+                TranscodeChunks(inputs[i], compression, queues[i]);
+            } catch (...) {
+                queues[i].SetError(std::current_exception());
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const auto joinWorkers = [&]() -> void {
+        for (auto& queue : queues) {
+            queue.Cancel();
+        }
+
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        workers.clear();
+    };
+
+    for (int i = 0; i < std::max(jobs, 1); ++i) {
+        workers.emplace_back(worker);
+    }
+
+    try {
+        rdf::Stream outputFile = rdf::Stream::CreateFile(output.c_str());
+
+        // Let the library write in the background, so reading the next
+        // chunk overlaps with writing the previous one
+        rdfChunkFileWriterCreateInfo info = {};
+        info.stream = static_cast<rdfStream*>(outputFile);
+        info.asyncMemoryLimit = 64 * 1024 * 1024;
+
+        rdf::ChunkFileWriter chunkFileWriter(info);
+
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            rdf::ChunkFile chunkFile(inputs[i].c_str());
+            CopyChunks(chunkFile, chunkFileWriter, compression, queues[i]);
+        }
+
+        // Must close before the output file goes out of scope
+        chunkFileWriter.Close();
+    } catch (...) {
+        joinWorkers();
+        throw;
     }
 
-    rdf::Stream outputFile = rdf::Stream::CreateFile(output.c_str());
-    rdf::ChunkFileWriter chunkFileWriter(outputFile);
+    joinWorkers();
 
-    CopyChunks(chunkFile1, chunkFileWriter, compress);
-    CopyChunks(chunkFile2, chunkFileWriter, compress);
+    return 0;
+}
 
-    // Must close before the output file goes out of scope
-    chunkFileWriter.Close();
+int CompactChunkFile(const std::string& input, const std::string& output)
+{
+    if (output.empty() || output == input) {
+        auto stream =
+            rdf::Stream::FromFile(input.c_str(), rdfStreamAccessReadWrite, rdfFileModeOpen);
+        rdf::ChunkFile::Compact(stream, stream);
+    } else {
+        auto inputStream = rdf::Stream::OpenFile(input.c_str());
+        auto outputStream = rdf::Stream::CreateFile(output.c_str());
+        rdf::ChunkFile::Compact(inputStream, outputStream);
+    }
 
     return 0;
 }
@@ -126,24 +349,38 @@ int main(int argc, char* argv[])
 {
     CLI::App app{"RDFM 1.0"};
 
-    std::string input1, input2, output;
+    std::vector<std::string> files;
     bool compress = false;
+    int jobs = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
 
-    auto mergeCommand = app.add_subcommand("merge", "Merge two chunk files.");
-    mergeCommand->add_option("input1", input1)->required();
-    mergeCommand->add_option("input2", input2)->required();
-    mergeCommand->add_option("output", output)->required();
+    auto mergeCommand = app.add_subcommand(
+        "merge", "Merge chunk files. The last file is the output, all others are inputs.");
+    mergeCommand->add_option("files", files, "Input files followed by the output file")
+        ->required()
+        ->expected(3, CLI::detail::expected_max_vector_size);
     mergeCommand->add_flag("-c,--compress", compress);
+    mergeCommand->add_option("-j,--jobs", jobs, "Number of threads used to transcode chunks");
+
+    std::string compactInput, compactOutput;
+    auto compactCommand = app.add_subcommand(
+        "compact",
+        "Remove unused space from a chunk file. Without an output file, the input is compacted "
+        "in place.");
+    compactCommand->add_option("input", compactInput, "The chunk file to compact")->required();
+    compactCommand->add_option("output", compactOutput, "The compacted chunk file");
 
     CLI11_PARSE(app, argc, argv);
 
     try {
         if (*mergeCommand) {
-            return MergeChunkFiles(input1, input2, output, compress);
+            const std::vector<std::string> inputs(files.begin(), files.end() - 1);
+            return MergeChunkFiles(inputs, files.back(), compress, jobs);
+        } else if (*compactCommand) {
+            return CompactChunkFile(compactInput, compactOutput);
         }
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}